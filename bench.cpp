@@ -0,0 +1,415 @@
+/* Benchmarks for the noise kernels of every tier that is supported
+ * by this machine. Every kernel is run a few times to warm up, and is
+ * then measured over many repetitions. The results are written as CSV
+ * or JSON, so that they can be compared across commits and CPUs.
+ * The statistical quality of the hash policies is reported next to
+ * the timings: as "hash_quality" in JSON, and on stderr for CSV.
+ *
+ * Usage: simd_bench [--format csv|json] [--output <path>]
+ *                   [--tier <name>] [--filter <kernel name part>]
+ *                   [--samples <count>] [--runs <count>]
+ *                   [--warmup <count>] [--octaves <count>]
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <cpuid.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench_kernels.hpp"
+#include "noise_kernels.hpp"
+#include "simd_tiers.hpp"
+
+SIMD_DECLARE_PER_TIER(BenchKernelList, bench_kernels)
+
+static const BenchKernelList *bench_kernels_for_tier(SimdTier tier) {
+  SIMD_SELECT_PER_TIER(tier, bench_kernels);
+}
+
+/* The brand string of the CPU, or "unknown" when the CPU does not
+ * report one. */
+static std::string cpu_name() {
+  if (__get_cpuid_max(0x80000000, nullptr) < 0x80000004) {
+    return "unknown";
+  }
+  unsigned int regs[12];
+  for (unsigned int i = 0; i < 3; i++) {
+    __cpuid(0x80000002 + i, regs[i * 4], regs[i * 4 + 1],
+            regs[i * 4 + 2], regs[i * 4 + 3]);
+  }
+  char name[49];
+  memcpy(name, regs, 48);
+  name[48] = '\0';
+  std::string result = name;
+  result.erase(0, result.find_first_not_of(' '));
+  return result;
+}
+
+/* `value` as the contents of a JSON string. */
+static std::string json_escape(const std::string &value) {
+  std::string result;
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      result += '\\';
+      result += c;
+    } else if ((unsigned char)c < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      result += escaped;
+    } else {
+      result += c;
+    }
+  }
+  return result;
+}
+
+struct BenchSettings {
+  size_t samples = 1 << 16;
+  unsigned int runs = 25;
+  unsigned int warmup = 3;
+  float octaves = 5.0f;
+  std::string format = "csv";
+  std::string output;
+  std::string tier;
+  std::string filter;
+};
+
+struct BenchResult {
+  SimdTier tier;
+  const BenchKernel *kernel;
+  /* Nanoseconds per sample. */
+  double median;
+  double p99;
+  double mean;
+  double stddev;
+  double min;
+};
+
+/* Positions on a regular grid like the one used by noise_texture,
+ * with rows of 256 samples. The grid is shifted so that it also
+ * covers negative coordinates. */
+struct BenchData {
+  std::vector<float> xs, ys, zs;
+  std::vector<int32_t> x_ids, y_ids, z_ids;
+  std::vector<float> out;
+
+  BenchData(size_t count)
+      : xs(count), ys(count), zs(count), x_ids(count), y_ids(count),
+        z_ids(count), out(count) {
+    const float scale = 0.01f;
+    for (size_t i = 0; i < count; i++) {
+      xs[i] = ((float)(i % 256) - 128.0f) * scale;
+      ys[i] = ((float)(i / 256) - 64.0f) * scale;
+      zs[i] = 0.5f;
+      x_ids[i] = (int32_t)(i % 256) - 128;
+      y_ids[i] = (int32_t)(i / 256) - 64;
+      z_ids[i] = 7;
+    }
+  }
+
+  BenchInput input(float octaves) const {
+    BenchInput input;
+    input.xs = xs.data();
+    input.ys = ys.data();
+    input.zs = zs.data();
+    input.x_ids = x_ids.data();
+    input.y_ids = y_ids.data();
+    input.z_ids = z_ids.data();
+    input.count = xs.size();
+    input.octaves = octaves;
+    return input;
+  }
+};
+
+struct HashQuality {
+  const char *name;
+  /* Mean of |2 p - 1| over the low 16 bits of every input coordinate
+   * and all 32 output bits, where p is the probability that flipping
+   * the input bit flips the output bit. 0 is ideal, 1 means that the
+   * output bit does not depend on the input bit at all. */
+  double avalanche_bias;
+  /* Chi-square statistic of the low 4 bits, which select the
+   * gradient, over a 64 x 64 x 16 block of lattice points. There are
+   * 15 degrees of freedom, so values around 15 are ideal. */
+  double low_bits_chi2;
+};
+
+/* The hashes are bit-identical on all tiers, so this is independent
+ * of the tier that provides them. */
+static HashQuality measure_hash_quality(const BenchHash &hash) {
+  const size_t count = 4096;
+  const unsigned int input_bits = 16;
+  std::mt19937 random(1234);
+  std::uniform_int_distribution<int32_t> coordinate(-(1 << 20),
+                                                    1 << 20);
+  std::vector<int32_t> ids[3];
+  std::vector<int32_t> flipped[3];
+  for (unsigned int axis = 0; axis < 3; axis++) {
+    ids[axis].resize(count);
+    for (int32_t &id : ids[axis]) {
+      id = coordinate(random);
+    }
+  }
+  std::vector<int32_t> reference(count), result(count);
+  hash.bits(ids[0].data(), ids[1].data(), ids[2].data(),
+            reference.data(), count);
+
+  double bias_sum = 0.0;
+  for (unsigned int axis = 0; axis < 3; axis++) {
+    for (unsigned int bit = 0; bit < input_bits; bit++) {
+      for (unsigned int other = 0; other < 3; other++) {
+        flipped[other] = ids[other];
+      }
+      for (int32_t &id : flipped[axis]) {
+        id ^= 1 << bit;
+      }
+      hash.bits(flipped[0].data(), flipped[1].data(),
+                flipped[2].data(), result.data(), count);
+      unsigned int flips[32] = {};
+      for (size_t i = 0; i < count; i++) {
+        uint32_t difference = (uint32_t)(reference[i] ^ result[i]);
+        for (unsigned int out_bit = 0; out_bit < 32; out_bit++) {
+          flips[out_bit] += (difference >> out_bit) & 1;
+        }
+      }
+      for (unsigned int out_bit = 0; out_bit < 32; out_bit++) {
+        double p = (double)flips[out_bit] / count;
+        bias_sum += std::fabs(2.0 * p - 1.0);
+      }
+    }
+  }
+
+  const size_t grid_count = 64 * 64 * 16;
+  std::vector<int32_t> xs(grid_count), ys(grid_count), zs(grid_count);
+  for (size_t i = 0; i < grid_count; i++) {
+    xs[i] = (int32_t)(i % 64) - 32;
+    ys[i] = (int32_t)(i / 64 % 64) - 32;
+    zs[i] = (int32_t)(i / 4096);
+  }
+  result.resize(grid_count);
+  hash.bits(xs.data(), ys.data(), zs.data(), result.data(),
+            grid_count);
+  size_t histogram[16] = {};
+  for (int32_t value : result) {
+    histogram[value & 15]++;
+  }
+  double expected = grid_count / 16.0;
+  double chi2 = 0.0;
+  for (size_t bucket : histogram) {
+    chi2 += (bucket - expected) * (bucket - expected) / expected;
+  }
+
+  HashQuality quality;
+  quality.name = hash.name;
+  quality.avalanche_bias = bias_sum / (3 * input_bits * 32);
+  quality.low_bits_chi2 = chi2;
+  return quality;
+}
+
+static BenchResult run_benchmark(SimdTier tier,
+                                 const BenchKernel &kernel,
+                                 BenchData &data,
+                                 const BenchSettings &settings) {
+  using Clock = std::chrono::steady_clock;
+  BenchInput input = data.input(settings.octaves);
+
+  for (unsigned int i = 0; i < settings.warmup; i++) {
+    kernel.run(input, data.out.data());
+  }
+
+  std::vector<double> times;
+  for (unsigned int i = 0; i < settings.runs; i++) {
+    Clock::time_point start = Clock::now();
+    kernel.run(input, data.out.data());
+    Clock::time_point end = Clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - start)
+                    .count();
+    times.push_back(ns / input.count);
+  }
+  std::sort(times.begin(), times.end());
+
+  BenchResult result;
+  result.tier = tier;
+  result.kernel = &kernel;
+  result.min = times.front();
+  result.median = times[times.size() / 2];
+  /* Nearest rank percentile. */
+  size_t p99_rank = (size_t)std::ceil(0.99 * times.size());
+  result.p99 = times[std::max<size_t>(p99_rank, 1) - 1];
+  double sum = 0.0;
+  for (double time : times) {
+    sum += time;
+  }
+  result.mean = sum / times.size();
+  double variance = 0.0;
+  for (double time : times) {
+    variance += (time - result.mean) * (time - result.mean);
+  }
+  result.stddev = std::sqrt(variance / times.size());
+  return result;
+}
+
+static void write_csv(std::ostream &stream,
+                      const std::vector<BenchResult> &results) {
+  stream << "tier,kernel,width,median_ns_per_sample,"
+            "p99_ns_per_sample,mean_ns_per_sample,"
+            "stddev_ns_per_sample,min_ns_per_sample,"
+            "samples_per_sec\n";
+  for (const BenchResult &result : results) {
+    char line[512];
+    snprintf(line, sizeof(line),
+             "%s,%s,%u,%.4f,%.4f,%.4f,%.4f,%.4f,%.0f\n",
+             simd_tier_name(result.tier), result.kernel->name,
+             result.kernel->width, result.median, result.p99,
+             result.mean, result.stddev, result.min,
+             1e9 / result.median);
+    stream << line;
+  }
+}
+
+static void write_hash_quality_csv(
+    std::ostream &stream, const std::vector<HashQuality> &qualities) {
+  stream << "hash,avalanche_bias,low_bits_chi2\n";
+  for (const HashQuality &quality : qualities) {
+    char line[256];
+    snprintf(line, sizeof(line), "%s,%.4f,%.2f\n", quality.name,
+             quality.avalanche_bias, quality.low_bits_chi2);
+    stream << line;
+  }
+}
+
+static void write_json(std::ostream &stream,
+                       const std::vector<BenchResult> &results,
+                       const std::vector<HashQuality> &qualities,
+                       const BenchSettings &settings) {
+  stream << "{\n  \"cpu\": \"" << json_escape(cpu_name()) << "\",\n"
+         << "  \"samples\": " << settings.samples << ",\n"
+         << "  \"runs\": " << settings.runs << ",\n"
+         << "  \"octaves\": " << settings.octaves << ",\n"
+         << "  \"hash_quality\": [\n";
+  for (size_t i = 0; i < qualities.size(); i++) {
+    const HashQuality &quality = qualities[i];
+    char line[256];
+    snprintf(line, sizeof(line),
+             "    {\"hash\": \"%s\", \"avalanche_bias\": %.4f, "
+             "\"low_bits_chi2\": %.2f}%s\n",
+             quality.name, quality.avalanche_bias,
+             quality.low_bits_chi2,
+             i + 1 < qualities.size() ? "," : "");
+    stream << line;
+  }
+  stream << "  ],\n"
+         << "  \"results\": [\n";
+  for (size_t i = 0; i < results.size(); i++) {
+    const BenchResult &result = results[i];
+    char line[512];
+    snprintf(line, sizeof(line),
+             "    {\"tier\": \"%s\", \"kernel\": \"%s\", "
+             "\"width\": %u, "
+             "\"median_ns_per_sample\": %.4f, "
+             "\"p99_ns_per_sample\": %.4f, "
+             "\"mean_ns_per_sample\": %.4f, "
+             "\"stddev_ns_per_sample\": %.4f, "
+             "\"min_ns_per_sample\": %.4f, "
+             "\"samples_per_sec\": %.0f}%s\n",
+             simd_tier_name(result.tier), result.kernel->name,
+             result.kernel->width, result.median, result.p99,
+             result.mean, result.stddev, result.min,
+             1e9 / result.median, i + 1 < results.size() ? "," : "");
+    stream << line;
+  }
+  stream << "  ]\n}\n";
+}
+
+static bool parse_arguments(int argc, char const *argv[],
+                            BenchSettings &settings) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << arg << "\n";
+      return false;
+    }
+    const char *value = argv[++i];
+    if (arg == "--format") {
+      settings.format = value;
+    } else if (arg == "--output") {
+      settings.output = value;
+    } else if (arg == "--tier") {
+      settings.tier = value;
+    } else if (arg == "--filter") {
+      settings.filter = value;
+    } else if (arg == "--samples") {
+      settings.samples = std::max(1, atoi(value));
+    } else if (arg == "--runs") {
+      settings.runs = std::max(1, atoi(value));
+    } else if (arg == "--warmup") {
+      settings.warmup = std::max(0, atoi(value));
+    } else if (arg == "--octaves") {
+      settings.octaves = (float)atof(value);
+    } else {
+      std::cerr << "Unknown argument " << arg << "\n";
+      return false;
+    }
+  }
+  return settings.format == "csv" || settings.format == "json";
+}
+
+int main(int argc, char const *argv[]) {
+  BenchSettings settings;
+  if (!parse_arguments(argc, argv, settings)) {
+    return 1;
+  }
+
+  BenchData data(settings.samples);
+  SimdTier max_tier = detect_simd_tier();
+  std::vector<BenchResult> results;
+  std::vector<HashQuality> qualities;
+
+  for (int tier_index = 0; tier_index <= (int)max_tier;
+       tier_index++) {
+    SimdTier tier = (SimdTier)tier_index;
+    if (!settings.tier.empty() &&
+        settings.tier != simd_tier_name(tier)) {
+      continue;
+    }
+    const BenchKernelList *kernels = bench_kernels_for_tier(tier);
+    if (kernels == nullptr) {
+      continue;
+    }
+    qualities.clear();
+    for (size_t i = 0; i < kernels->hash_count; i++) {
+      qualities.push_back(measure_hash_quality(kernels->hashes[i]));
+    }
+    for (size_t i = 0; i < kernels->count; i++) {
+      const BenchKernel &kernel = kernels->kernels[i];
+      if (!settings.filter.empty() &&
+          strstr(kernel.name, settings.filter.c_str()) == nullptr) {
+        continue;
+      }
+      results.push_back(run_benchmark(tier, kernel, data, settings));
+    }
+  }
+
+  std::ofstream file;
+  if (!settings.output.empty()) {
+    file.open(settings.output);
+  }
+  std::ostream &stream = settings.output.empty() ? std::cout : file;
+  if (settings.format == "json") {
+    write_json(stream, results, qualities, settings);
+  } else {
+    write_csv(stream, results);
+    write_hash_quality_csv(std::cerr, qualities);
+  }
+  return 0;
+}
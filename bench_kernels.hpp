@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/* Kernels that are measured by simd_bench. Like the noise kernels,
+ * they are compiled once per instruction set (see
+ * bench_kernels_impl.cpp). */
+
+struct BenchInput {
+  const float *xs;
+  const float *ys;
+  const float *zs;
+  /* The same positions as lattice coordinates, for the hash. */
+  const int32_t *x_ids;
+  const int32_t *y_ids;
+  const int32_t *z_ids;
+  size_t count;
+  float octaves;
+};
+
+struct BenchKernel {
+  const char *name;
+  /* Vector width that is used, 0 when it is chosen by the kernel. */
+  unsigned int width;
+  void (*run)(const BenchInput &input, float *out);
+};
+
+/* A hash policy, evaluated at native width, for the hash quality
+ * report of simd_bench. */
+struct BenchHash {
+  const char *name;
+  void (*bits)(const int32_t *x_ids, const int32_t *y_ids,
+               const int32_t *z_ids, int32_t *out, size_t count);
+};
+
+struct BenchKernelList {
+  const BenchKernel *kernels;
+  size_t count;
+  const BenchHash *hashes;
+  size_t hash_count;
+};
@@ -0,0 +1,417 @@
+/* This file is compiled once per instruction set, see
+ * noise_kernels_impl.cpp. */
+
+#include "bench_kernels.hpp"
+#include "cellular_noise.hpp"
+#include "gradient_noise.hpp"
+#include "lattice_coord.hpp"
+#include "noise_derivatives.hpp"
+#include "noise_graph.hpp"
+#include "noise_grid.hpp"
+#include "pixel_pack.hpp"
+#include "simplex_noise.hpp"
+
+SIMD_NAMESPACE_BEGIN
+
+/* The first `lanes` values at `src`, the rest is 0. */
+template <unsigned int N>
+static float_v<N> bench_load(const float *src, unsigned int lanes) {
+  return lanes == N ? float_v<N>::loadu(src)
+                    : float_v<N>::load_partial(src, lanes);
+}
+
+template <unsigned int N>
+static int32_v<N> bench_load(const int32_t *src, unsigned int lanes) {
+  return lanes == N ? int32_v<N>::loadu(src)
+                    : int32_v<N>::load_partial(src, lanes);
+}
+
+/* Store `eval(i, lanes)` for all samples in vectors of N, including
+ * a partial vector at the end, since bench.cpp divides the time by
+ * the full sample count. */
+template <unsigned int N, typename Eval>
+static void bench_apply(const BenchInput &input, float *out,
+                        Eval eval) {
+  size_t i = 0;
+  for (; i + N <= input.count; i += N) {
+    eval(i, N).storeu(out + i);
+  }
+  unsigned int remaining = (unsigned int)(input.count - i);
+  if (remaining > 0) {
+    eval(i, remaining).store_partial(out + i, remaining);
+  }
+}
+
+template <unsigned int N, typename Hash = HashMix>
+static void bench_hash_position(const BenchInput &input, float *out) {
+  bench_apply<N>(input, out, [&](size_t i, unsigned int lanes) {
+    return hash_position<Hash>(bench_load<N>(input.x_ids + i, lanes),
+                               bench_load<N>(input.y_ids + i, lanes),
+                               bench_load<N>(input.z_ids + i, lanes));
+  });
+}
+
+template <unsigned int N, typename Hash = HashMix>
+static void bench_eval_noise(const BenchInput &input, float *out) {
+  bench_apply<N>(input, out, [&](size_t i, unsigned int lanes) {
+    return eval_noise<Hash>(bench_load<N>(input.xs + i, lanes),
+                            bench_load<N>(input.ys + i, lanes),
+                            bench_load<N>(input.zs + i, lanes));
+  });
+}
+
+template <unsigned int N>
+static void bench_eval_noise_1d(const BenchInput &input, float *out) {
+  bench_apply<N>(input, out, [&](size_t i, unsigned int lanes) {
+    return eval_noise(bench_load<N>(input.xs + i, lanes));
+  });
+}
+
+template <unsigned int N>
+static void bench_eval_noise_2d(const BenchInput &input, float *out) {
+  bench_apply<N>(input, out, [&](size_t i, unsigned int lanes) {
+    return eval_noise(bench_load<N>(input.xs + i, lanes),
+                      bench_load<N>(input.ys + i, lanes));
+  });
+}
+
+/* The input has no fourth coordinate, w is derived from x. */
+template <unsigned int N>
+static void bench_eval_noise_4d(const BenchInput &input, float *out) {
+  bench_apply<N>(input, out, [&](size_t i, unsigned int lanes) {
+    float_v<N> x = bench_load<N>(input.xs + i, lanes);
+    return eval_noise(x, bench_load<N>(input.ys + i, lanes),
+                      bench_load<N>(input.zs + i, lanes), x * 0.5f);
+  });
+}
+
+template <unsigned int N, typename Hash = HashMix>
+static void bench_gradient_noise(const BenchInput &input,
+                                 float *out) {
+  bench_apply<N>(input, out, [&](size_t i, unsigned int lanes) {
+    return eval_gradient_noise<Hash>(
+        bench_load<N>(input.xs + i, lanes),
+        bench_load<N>(input.ys + i, lanes),
+        bench_load<N>(input.zs + i, lanes));
+  });
+}
+
+template <unsigned int N>
+static void bench_simplex_noise_3d(const BenchInput &input,
+                                   float *out) {
+  bench_apply<N>(input, out, [&](size_t i, unsigned int lanes) {
+    return eval_simplex_noise(bench_load<N>(input.xs + i, lanes),
+                              bench_load<N>(input.ys + i, lanes),
+                              bench_load<N>(input.zs + i, lanes));
+  });
+}
+
+/* The input has no fourth coordinate, w is derived from x. */
+template <unsigned int N>
+static void bench_simplex_noise_4d(const BenchInput &input,
+                                   float *out) {
+  bench_apply<N>(input, out, [&](size_t i, unsigned int lanes) {
+    float_v<N> x = bench_load<N>(input.xs + i, lanes);
+    return eval_simplex_noise(x, bench_load<N>(input.ys + i, lanes),
+                              bench_load<N>(input.zs + i, lanes),
+                              x * 0.5f);
+  });
+}
+
+/* The derivatives are summed into the output so that none of them
+ * can be optimized away. */
+template <unsigned int N>
+static void bench_noise_derivatives(const BenchInput &input,
+                                    float *out) {
+  bench_apply<N>(input, out, [&](size_t i, unsigned int lanes) {
+    NoiseDerivatives<N> noise = eval_noise_with_derivatives(
+        bench_load<N>(input.xs + i, lanes),
+        bench_load<N>(input.ys + i, lanes),
+        bench_load<N>(input.zs + i, lanes));
+    return noise.value + noise.dx + noise.dy + noise.dz;
+  });
+}
+
+/* Forward differences with eval_noise, the alternative to
+ * eval_noise_with_derivatives. */
+template <unsigned int N>
+static void bench_noise_finite_differences(const BenchInput &input,
+                                           float *out) {
+  const float h = 1.0f / 1024;
+  bench_apply<N>(input, out, [&](size_t i, unsigned int lanes) {
+    float_v<N> x = bench_load<N>(input.xs + i, lanes);
+    float_v<N> y = bench_load<N>(input.ys + i, lanes);
+    float_v<N> z = bench_load<N>(input.zs + i, lanes);
+    float_v<N> value = eval_noise(x, y, z);
+    float_v<N> dx = eval_noise(x + h, y, z) - value;
+    float_v<N> dy = eval_noise(x, y + h, z) - value;
+    float_v<N> dz = eval_noise(x, y, z + h) - value;
+    return value + (dx + dy + dz) * (1.0f / h);
+  });
+}
+
+template <unsigned int N,
+          CellularDistance Distance = CellularDistance::Euclidean>
+static void bench_cellular_noise(const BenchInput &input,
+                                 float *out) {
+  cellular_noise_batch<N>(input.xs, input.ys, input.zs, out,
+                          input.count, Distance, CellularOutput::F1);
+}
+
+/* fBm domain-warped by two other fBm fields, remapped to [0, 1],
+ * masked with Worley noise and clamped. */
+static auto bench_graph() {
+  auto warp_x = node_fbm<4>(0.5f);
+  auto warp_y = node_translate(node_fbm<4>(0.5f), 5.2f, 1.3f, 0.0f);
+  auto terrain = node_remap(node_warp(node_fbm<5>(), 0.8f, warp_x,
+                                      warp_y),
+                            -1.0f, 1.0f, 0.0f, 1.0f);
+  return node_clamp(terrain * node_cellular(), 0.0f, 1.0f);
+}
+
+static void bench_noise_graph(const BenchInput &input, float *out) {
+  noise_graph_batch(bench_graph(), input.xs, input.ys, input.zs, out,
+                    input.count);
+}
+
+/* The same composition as bench_graph, but every stage goes through
+ * a buffer of the full input size. */
+static void bench_noise_graph_staged(const BenchInput &input,
+                                     float *out) {
+  size_t count = input.count;
+  std::vector<float> xs(count), ys(count), zs(count);
+  std::vector<float> warp_x(count), warp_y(count), mask(count);
+
+  for (size_t i = 0; i < count; i++) {
+    xs[i] = input.xs[i] * 0.5f;
+    ys[i] = input.ys[i] * 0.5f;
+    zs[i] = input.zs[i] * 0.5f;
+  }
+  perlin_noise_batch(xs.data(), ys.data(), zs.data(), warp_x.data(),
+                     count, 4.0f);
+  for (size_t i = 0; i < count; i++) {
+    xs[i] = (input.xs[i] + 5.2f) * 0.5f;
+    ys[i] = (input.ys[i] + 1.3f) * 0.5f;
+  }
+  perlin_noise_batch(xs.data(), ys.data(), zs.data(), warp_y.data(),
+                     count, 4.0f);
+  for (size_t i = 0; i < count; i++) {
+    xs[i] = input.xs[i] + warp_x[i] * 0.8f;
+    ys[i] = input.ys[i] + warp_y[i] * 0.8f;
+  }
+  perlin_noise_batch(xs.data(), ys.data(), input.zs, out, count,
+                     5.0f);
+  cellular_noise_batch(input.xs, input.ys, input.zs, mask.data(),
+                       count, CellularDistance::Euclidean,
+                       CellularOutput::F1);
+  for (size_t i = 0; i < count; i++) {
+    float value = (out[i] * 0.5f + 0.5f) * mask[i];
+    out[i] = std::min(std::max(value, 0.0f), 1.0f);
+  }
+}
+
+static void bench_perlin_noise(const BenchInput &input, float *out) {
+  for (size_t i = 0; i < input.count; i++) {
+    out[i] = perlin_noise(input.xs[i], input.ys[i], input.zs[i],
+                          input.octaves);
+  }
+}
+
+template <unsigned int N>
+static void bench_perlin_noise_batch(const BenchInput &input,
+                                     float *out) {
+  perlin_noise_batch<N>(input.xs, input.ys, input.zs, out,
+                        input.count, input.octaves);
+}
+
+/* Every sample has its own seed, to compare with the unseeded
+ * perlin_noise_batch. */
+template <unsigned int N>
+static void bench_perlin_noise_batch_seeded(const BenchInput &input,
+                                            float *out) {
+  perlin_noise_batch<N>(input.xs, input.ys, input.zs, input.x_ids,
+                        out, input.count, input.octaves);
+}
+
+/* The same positions, moved 2^32 cells away from the origin and
+ * split from doubles. Filling the doubles is part of the time. */
+static void bench_perlin_noise_batch_double(const BenchInput &input,
+                                            float *out) {
+  std::vector<double> xs(input.count), ys(input.count),
+      zs(input.count);
+  for (size_t i = 0; i < input.count; i++) {
+    xs[i] = input.xs[i] + 4294967296.0;
+    ys[i] = input.ys[i] - 4294967296.0;
+    zs[i] = input.zs[i];
+  }
+  perlin_noise_batch_double(xs.data(), ys.data(), zs.data(),
+                            nullptr, out, input.count,
+                            input.octaves);
+}
+
+/* The runtime octave loop, for comparison with the unrolled fbm
+ * kernels that perlin_noise_batch uses for common octave counts. */
+template <unsigned int N>
+static void bench_fbm_runtime(const BenchInput &input, float *out) {
+  perlin_noise_batch__apply<N>(
+      input.xs, input.ys, input.zs, out, input.count,
+      [&input](float_v<N> x, float_v<N> y, float_v<N> z) {
+        return perlin_noise__octaves(x, y, z, input.octaves);
+      });
+}
+
+/* Rows of 256 samples, like a texture. Only the x coordinates of the
+ * input are used. */
+static void bench_perlin_noise_row(const BenchInput &input,
+                                   float *out) {
+  const size_t row_size = 256;
+  for (size_t i = 0; i < input.count; i += row_size) {
+    size_t count = std::min(row_size, input.count - i);
+    perlin_noise_row(input.xs + i, input.ys[i], input.zs[i], out + i,
+                     count, input.octaves);
+  }
+}
+
+static void bench_perlin_noise_row_2d(const BenchInput &input,
+                                      float *out) {
+  const size_t row_size = 256;
+  for (size_t i = 0; i < input.count; i += row_size) {
+    size_t count = std::min(row_size, input.count - i);
+    perlin_noise_row(input.xs + i, input.ys[i], out + i, count,
+                     input.octaves);
+  }
+}
+
+template <typename Hash>
+static void bench_hash_bits(const int32_t *x_ids,
+                            const int32_t *y_ids,
+                            const int32_t *z_ids, int32_t *out,
+                            size_t count) {
+  const unsigned int N = SIMD_NATIVE_WIDTH;
+  size_t i = 0;
+  for (; i + N <= count; i += N) {
+    hash_position_bits<Hash>(int32_v<N>::loadu(x_ids + i),
+                             int32_v<N>::loadu(y_ids + i),
+                             int32_v<N>::loadu(z_ids + i))
+        .storeu(out + i);
+  }
+  for (; i < count; i++) {
+    out[i] = hash_position_bits<Hash>(int32_v<1>(x_ids[i]),
+                                      int32_v<1>(y_ids[i]),
+                                      int32_v<1>(z_ids[i]))
+                 .value();
+  }
+}
+
+static const BenchHash hashes[] = {
+    {"mix", bench_hash_bits<HashMix>},
+    {"xorshift", bench_hash_bits<HashXorshift>},
+    {"permutation", bench_hash_bits<HashPermutation>},
+};
+
+/* The positions are packed in place of the noise values. */
+template <unsigned int N, PixelFormat Format>
+static void bench_pack_pixels(const BenchInput &input, float *out) {
+  pack_pixels<N>(input.xs, input.count, Format, -1.0f, 1.0f, out);
+}
+
+static const BenchKernel kernels[] = {
+    {"hash_position", 1, bench_hash_position<1>},
+    {"hash_position", 4, bench_hash_position<4>},
+    {"hash_position", 8, bench_hash_position<8>},
+    {"hash_position", 16, bench_hash_position<16>},
+    {"hash_position_xorshift", 1,
+     bench_hash_position<1, HashXorshift>},
+    {"hash_position_xorshift", 4,
+     bench_hash_position<4, HashXorshift>},
+    {"hash_position_xorshift", 8,
+     bench_hash_position<8, HashXorshift>},
+    {"hash_position_xorshift", 16,
+     bench_hash_position<16, HashXorshift>},
+    {"hash_position_permutation", 1,
+     bench_hash_position<1, HashPermutation>},
+    {"hash_position_permutation", 4,
+     bench_hash_position<4, HashPermutation>},
+    {"hash_position_permutation", 8,
+     bench_hash_position<8, HashPermutation>},
+    {"hash_position_permutation", 16,
+     bench_hash_position<16, HashPermutation>},
+    {"eval_noise", 1, bench_eval_noise<1>},
+    {"eval_noise", 4, bench_eval_noise<4>},
+    {"eval_noise", 8, bench_eval_noise<8>},
+    {"eval_noise", 16, bench_eval_noise<16>},
+    {"eval_noise_xorshift", SIMD_NATIVE_WIDTH,
+     bench_eval_noise<SIMD_NATIVE_WIDTH, HashXorshift>},
+    {"eval_noise_permutation", SIMD_NATIVE_WIDTH,
+     bench_eval_noise<SIMD_NATIVE_WIDTH, HashPermutation>},
+    {"eval_noise_1d", SIMD_NATIVE_WIDTH,
+     bench_eval_noise_1d<SIMD_NATIVE_WIDTH>},
+    {"eval_noise_2d", SIMD_NATIVE_WIDTH,
+     bench_eval_noise_2d<SIMD_NATIVE_WIDTH>},
+    {"eval_noise_4d", SIMD_NATIVE_WIDTH,
+     bench_eval_noise_4d<SIMD_NATIVE_WIDTH>},
+    {"gradient_noise", 1, bench_gradient_noise<1>},
+    {"gradient_noise", 4, bench_gradient_noise<4>},
+    {"gradient_noise", 8, bench_gradient_noise<8>},
+    {"gradient_noise", 16, bench_gradient_noise<16>},
+    {"gradient_noise_xorshift", SIMD_NATIVE_WIDTH,
+     bench_gradient_noise<SIMD_NATIVE_WIDTH, HashXorshift>},
+    {"gradient_noise_permutation", SIMD_NATIVE_WIDTH,
+     bench_gradient_noise<SIMD_NATIVE_WIDTH, HashPermutation>},
+    {"simplex_noise_3d", 1, bench_simplex_noise_3d<1>},
+    {"simplex_noise_3d", 4, bench_simplex_noise_3d<4>},
+    {"simplex_noise_3d", 8, bench_simplex_noise_3d<8>},
+    {"simplex_noise_3d", 16, bench_simplex_noise_3d<16>},
+    {"simplex_noise_4d", 1, bench_simplex_noise_4d<1>},
+    {"simplex_noise_4d", 4, bench_simplex_noise_4d<4>},
+    {"simplex_noise_4d", 8, bench_simplex_noise_4d<8>},
+    {"simplex_noise_4d", 16, bench_simplex_noise_4d<16>},
+    {"noise_derivatives", SIMD_NATIVE_WIDTH,
+     bench_noise_derivatives<SIMD_NATIVE_WIDTH>},
+    {"noise_finite_differences", SIMD_NATIVE_WIDTH,
+     bench_noise_finite_differences<SIMD_NATIVE_WIDTH>},
+    {"cellular_noise", 1, bench_cellular_noise<1>},
+    {"cellular_noise", 4, bench_cellular_noise<4>},
+    {"cellular_noise", 8, bench_cellular_noise<8>},
+    {"cellular_noise", 16, bench_cellular_noise<16>},
+    {"cellular_noise_manhattan", SIMD_NATIVE_WIDTH,
+     bench_cellular_noise<SIMD_NATIVE_WIDTH,
+                          CellularDistance::Manhattan>},
+    {"cellular_noise_chebyshev", SIMD_NATIVE_WIDTH,
+     bench_cellular_noise<SIMD_NATIVE_WIDTH,
+                          CellularDistance::Chebyshev>},
+    {"noise_graph", SIMD_NATIVE_WIDTH, bench_noise_graph},
+    {"noise_graph_staged", SIMD_NATIVE_WIDTH,
+     bench_noise_graph_staged},
+    {"perlin_noise", 4, bench_perlin_noise},
+    {"perlin_noise_batch", 1, bench_perlin_noise_batch<1>},
+    {"perlin_noise_batch", 4, bench_perlin_noise_batch<4>},
+    {"perlin_noise_batch", 8, bench_perlin_noise_batch<8>},
+    {"perlin_noise_batch", 16, bench_perlin_noise_batch<16>},
+    {"perlin_noise_batch_seeded", SIMD_NATIVE_WIDTH,
+     bench_perlin_noise_batch_seeded<SIMD_NATIVE_WIDTH>},
+    {"perlin_noise_batch_double", SIMD_NATIVE_WIDTH,
+     bench_perlin_noise_batch_double},
+    {"fbm_runtime", SIMD_NATIVE_WIDTH,
+     bench_fbm_runtime<SIMD_NATIVE_WIDTH>},
+    {"perlin_noise_row", SIMD_NATIVE_WIDTH, bench_perlin_noise_row},
+    {"perlin_noise_row_2d", SIMD_NATIVE_WIDTH,
+     bench_perlin_noise_row_2d},
+    {"pack_float16", 1, bench_pack_pixels<1, PixelFormat::Float16>},
+    {"pack_float16", 4, bench_pack_pixels<4, PixelFormat::Float16>},
+    {"pack_float16", 8, bench_pack_pixels<8, PixelFormat::Float16>},
+    {"pack_float16", 16,
+     bench_pack_pixels<16, PixelFormat::Float16>},
+    {"pack_bfloat16", SIMD_NATIVE_WIDTH,
+     bench_pack_pixels<SIMD_NATIVE_WIDTH, PixelFormat::BFloat16>},
+    {"pack_unorm8", SIMD_NATIVE_WIDTH,
+     bench_pack_pixels<SIMD_NATIVE_WIDTH, PixelFormat::UNorm8>},
+    {"pack_unorm16", SIMD_NATIVE_WIDTH,
+     bench_pack_pixels<SIMD_NATIVE_WIDTH, PixelFormat::UNorm16>},
+};
+
+extern const BenchKernelList bench_kernels = {
+    kernels, sizeof(kernels) / sizeof(*kernels), hashes,
+    sizeof(hashes) / sizeof(*hashes)};
+
+SIMD_NAMESPACE_END
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <cstdlib>
+#include <limits>
+
+#include "noise_kernels.hpp"
+#include "perlin_noise.hpp"
+
+SIMD_NAMESPACE_BEGIN
+
+/* Distances to the closest and second closest feature point and the
+ * hash of the cell that contains the closest one. */
+template <unsigned int N> struct CellularNoise {
+  float_v<N> f1;
+  float_v<N> f2;
+  int32_v<N> cell_id;
+};
+
+/* Distance from the origin to (x, y, z). The Euclidean distance is
+ * left squared, the square root is only taken for the final
+ * results. */
+template <CellularDistance Distance, unsigned int N>
+static float_v<N> cellular_distance(float_v<N> x, float_v<N> y,
+                                    float_v<N> z) {
+  switch (Distance) {
+    case CellularDistance::Manhattan:
+      return abs(x) + abs(y) + abs(z);
+    case CellularDistance::Chebyshev:
+      return max(max(abs(x), abs(y)), abs(z));
+    case CellularDistance::Euclidean:
+    default:
+      return x * x + y * y + z * z;
+  }
+}
+
+/* Cells up to this many cells away from the cell of a position can
+ * hold one of the two closest feature points. The closer side of the
+ * cell has a neighbour whose feature point lies at most 1.5 cells
+ * away along that axis and 1 along the others, which bounds F2 by
+ * 1.5 (Chebyshev), sqrt(4.25) (Euclidean) and 3.5 (Manhattan). Every
+ * point in a cell d > 0 cells away along an axis is more than d - 1
+ * away. */
+template <CellularDistance Distance>
+constexpr int cellular_search_radius() {
+  return Distance == CellularDistance::Chebyshev   ? 2
+         : Distance == CellularDistance::Euclidean ? 3
+                                                   : 4;
+}
+
+/* Lower bound for the distance along one axis from a position at
+ * `frac` within its cell to any point in the cell `offset` cells
+ * away. */
+template <unsigned int N>
+static float_v<N> cellular_gap(int offset, float_v<N> frac) {
+  if (offset > 0) {
+    return float_v<N>((float)offset) - frac;
+  }
+  if (offset < 0) {
+    return frac - float_v<N>((float)(offset + 1));
+  }
+  return 0.0f;
+}
+
+/* Evaluate Worley noise at N separate positions. Every lattice cell
+ * contains one feature point, whose position within the cell comes
+ * from three 10 bit fields of the cell's hash_position_bits. F1 and
+ * F2 are kept sorted with min/max and the cell ID with a select.
+ *
+ * The 27 cells around a position are always searched. The cells
+ * further out, up to cellular_search_radius, are only visited when
+ * their lower bound is below F2 in at least one lane, which is rare.
+ * Whole planes and rows of cells are skipped the same way. The
+ * result is exact for all three distances. */
+template <CellularDistance Distance = CellularDistance::Euclidean,
+          unsigned int N>
+static CellularNoise<N> eval_cellular_noise(float_v<N> x,
+                                            float_v<N> y,
+                                            float_v<N> z,
+                                            int32_v<N> seed = 0) {
+  float_v<N> x_low = x.floor();
+  float_v<N> y_low = y.floor();
+  float_v<N> z_low = z.floor();
+  float_v<N> x_frac = x - x_low;
+  float_v<N> y_frac = y - y_low;
+  float_v<N> z_frac = z - z_low;
+  int32_v<N> x_id = x_low.as_int32();
+  int32_v<N> y_id = y_low.as_int32();
+  int32_v<N> z_id = z_low.as_int32();
+
+  const int32_v<N> field_mask = int32_v<N>(1023);
+  const float field_scale = 1.0f / 1024;
+
+  CellularNoise<N> result;
+  result.f1 = std::numeric_limits<float>::max();
+  result.f2 = std::numeric_limits<float>::max();
+  result.cell_id = 0;
+
+  auto visit = [&](int dx, int dy, int dz) {
+    const int32_v<N> ids[3] = {x_id + int32_v<N>(dx),
+                               y_id + int32_v<N>(dy),
+                               z_id + int32_v<N>(dz)};
+    int32_v<N> hash = hash_position_bits(ids, seed);
+
+    /* Offset from the position to the cell's feature point. */
+    float_v<N> point_x = (hash & field_mask).as_float();
+    float_v<N> point_y =
+        (hash.template shift_right<10>() & field_mask).as_float();
+    float_v<N> point_z =
+        (hash.template shift_right<20>() & field_mask).as_float();
+    float_v<N> cell_x = float_v<N>((float)dx) - x_frac;
+    float_v<N> cell_y = float_v<N>((float)dy) - y_frac;
+    float_v<N> cell_z = float_v<N>((float)dz) - z_frac;
+    float_v<N> offset_x = fmadd(point_x, field_scale, cell_x);
+    float_v<N> offset_y = fmadd(point_y, field_scale, cell_y);
+    float_v<N> offset_z = fmadd(point_z, field_scale, cell_z);
+
+    float_v<N> distance =
+        cellular_distance<Distance>(offset_x, offset_y, offset_z);
+    result.f2 = min(result.f2, max(result.f1, distance));
+    result.cell_id =
+        select(distance < result.f1, hash, result.cell_id);
+    result.f1 = min(result.f1, distance);
+  };
+
+  for (int dz = -1; dz <= 1; dz++) {
+    for (int dy = -1; dy <= 1; dy++) {
+      for (int dx = -1; dx <= 1; dx++) {
+        visit(dx, dy, dz);
+      }
+    }
+  }
+
+  /* The bounds never exceed the rounded distances of the cells, so
+   * a skipped cell could not have changed the result. */
+  const int radius = cellular_search_radius<Distance>();
+  const float_v<N> zero = 0.0f;
+  for (int dz = -radius; dz <= radius; dz++) {
+    float_v<N> gap_z = cellular_gap(dz, z_frac);
+    if (!(cellular_distance<Distance>(zero, zero, gap_z) < result.f2)
+             .any()) {
+      continue;
+    }
+    for (int dy = -radius; dy <= radius; dy++) {
+      float_v<N> gap_y = cellular_gap(dy, y_frac);
+      if (!(cellular_distance<Distance>(zero, gap_y, gap_z) <
+            result.f2)
+               .any()) {
+        continue;
+      }
+      bool inner_row = std::abs(dz) <= 1 && std::abs(dy) <= 1;
+      for (int dx = -radius; dx <= radius; dx++) {
+        if (inner_row && std::abs(dx) <= 1) {
+          continue;
+        }
+        float_v<N> gap_x = cellular_gap(dx, x_frac);
+        if ((cellular_distance<Distance>(gap_x, gap_y, gap_z) <
+             result.f2)
+                .any()) {
+          visit(dx, dy, dz);
+        }
+      }
+    }
+  }
+
+  if (Distance == CellularDistance::Euclidean) {
+    result.f1 = sqrt(result.f1);
+    result.f2 = sqrt(result.f2);
+  }
+  return result;
+}
+
+template <unsigned int N>
+static float_v<N> cellular_noise_output(const CellularNoise<N> &noise,
+                                        CellularOutput output) {
+  switch (output) {
+    case CellularOutput::F2:
+      return noise.f2;
+    case CellularOutput::F2MinusF1:
+      return noise.f2 - noise.f1;
+    case CellularOutput::CellId:
+      return noise.cell_id.as_float() * (1.0f / (1 << 31));
+    case CellularOutput::F1:
+    default:
+      return noise.f1;
+  }
+}
+
+template <CellularDistance Distance, unsigned int N>
+static float_v<N> cellular_noise_output(float_v<N> x, float_v<N> y,
+                                        float_v<N> z,
+                                        CellularOutput output,
+                                        int32_v<N> seed = 0) {
+  return cellular_noise_output(
+      eval_cellular_noise<Distance>(x, y, z, seed), output);
+}
+
+/* Evaluate cellular noise for `count` positions given as separate
+ * coordinate arrays, like perlin_noise_batch. */
+template <unsigned int N = SIMD_NATIVE_WIDTH>
+static void cellular_noise_batch(const float *xs, const float *ys,
+                                 const float *zs, float *out,
+                                 size_t count,
+                                 CellularDistance distance,
+                                 CellularOutput output) {
+  switch (distance) {
+    case CellularDistance::Manhattan:
+      perlin_noise_batch__apply<N>(
+          xs, ys, zs, out, count,
+          [output](float_v<N> x, float_v<N> y, float_v<N> z) {
+            return cellular_noise_output<CellularDistance::Manhattan>(
+                x, y, z, output);
+          });
+      break;
+    case CellularDistance::Chebyshev:
+      perlin_noise_batch__apply<N>(
+          xs, ys, zs, out, count,
+          [output](float_v<N> x, float_v<N> y, float_v<N> z) {
+            return cellular_noise_output<CellularDistance::Chebyshev>(
+                x, y, z, output);
+          });
+      break;
+    case CellularDistance::Euclidean:
+    default:
+      perlin_noise_batch__apply<N>(
+          xs, ys, zs, out, count,
+          [output](float_v<N> x, float_v<N> y, float_v<N> z) {
+            return cellular_noise_output<CellularDistance::Euclidean>(
+                x, y, z, output);
+          });
+      break;
+  }
+}
+
+SIMD_NAMESPACE_END
@@ -0,0 +1,386 @@
+#include <algorithm>
+#include <cstring>
+
+#include "chunk_service.hpp"
+#include "noise_pyramid.hpp"
+#include "timeit.hpp"
+
+ChunkHandle::ChunkHandle(ChunkService *service, uint32_t slot)
+    : m_service(service), m_slot(slot) {
+  m_service->m_slots[m_slot].pins++;
+}
+
+ChunkHandle::ChunkHandle(const ChunkHandle &other)
+    : m_service(other.m_service), m_slot(other.m_slot) {
+  if (m_service) {
+    m_service->m_slots[m_slot].pins++;
+  }
+}
+
+ChunkHandle::ChunkHandle(ChunkHandle &&other) noexcept
+    : m_service(other.m_service), m_slot(other.m_slot) {
+  other.m_service = nullptr;
+}
+
+ChunkHandle &ChunkHandle::operator=(ChunkHandle other) noexcept {
+  std::swap(m_service, other.m_service);
+  std::swap(m_slot, other.m_slot);
+  return *this;
+}
+
+ChunkHandle::~ChunkHandle() {
+  if (m_service) {
+    m_service->m_slots[m_slot].pins--;
+  }
+}
+
+const float *ChunkHandle::pixels() const {
+  const ChunkService &service = *m_service;
+  return service.m_arena.get() + m_slot * service.m_chunk_pixels;
+}
+
+unsigned int ChunkHandle::size() const {
+  return m_service->m_settings.chunk_size;
+}
+
+ChunkService::ChunkService(const ChunkServiceSettings &settings)
+    : m_settings(settings) {
+  m_chunk_pixels = (size_t)settings.chunk_size * settings.chunk_size;
+  size_t chunk_bytes = m_chunk_pixels * sizeof(float);
+  m_capacity = (uint32_t)std::max<size_t>(
+      settings.memory_limit / chunk_bytes, 1);
+
+  m_arena.reset(new float[m_capacity * m_chunk_pixels]);
+  m_slots.reset(new Slot[m_capacity]);
+  for (uint32_t i = 0; i < m_capacity; i++) {
+    m_slots[i].waiters.reserve(reserved_waiters);
+  }
+  m_free_slots.reserve(m_capacity);
+  for (uint32_t i = m_capacity; i > 0; i--) {
+    m_free_slots.push_back(i - 1);
+  }
+
+  size_t table_size = 1;
+  while (table_size < 2 * (size_t)m_capacity) {
+    table_size *= 2;
+  }
+  m_table.assign(table_size, -1);
+  m_queue.resize(m_capacity);
+
+  m_stats.capacity_chunks = m_capacity;
+  m_stats.memory_bytes = m_capacity * chunk_bytes;
+
+  unsigned int thread_count = settings.thread_count;
+  if (thread_count == 0) {
+    unsigned int hardware = std::thread::hardware_concurrency();
+    thread_count = hardware > 1 ? hardware - 1 : 1;
+  }
+  for (unsigned int i = 0; i < thread_count; i++) {
+    m_threads.emplace_back([this]() { worker(); });
+  }
+}
+
+ChunkService::~ChunkService() {
+  std::vector<Waiter> waiters;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_shutdown = true;
+    /* Chunks that were not generated yet are never delivered. */
+    for (size_t i = 0; i < m_queue_size; i++) {
+      Slot &slot = m_slots[m_queue[(m_queue_begin + i) % m_capacity]];
+      waiters.insert(waiters.end(), slot.waiters.begin(),
+                     slot.waiters.end());
+      slot.waiters.clear();
+    }
+    m_queue_size = 0;
+  }
+  m_work_available.notify_all();
+  for (std::thread &thread : m_threads) {
+    thread.join();
+  }
+  for (const Waiter &waiter : waiters) {
+    waiter.function(waiter.context, ChunkHandle());
+  }
+}
+
+size_t ChunkService::table_index(const ChunkKey &key) const {
+  uint64_t hash = (uint32_t)key.x * 0x9E3779B1u;
+  hash ^= (uint32_t)key.y * 0x85EBCA77u;
+  hash ^= key.lod * 0xC2B2AE3Du;
+  hash ^= hash >> 15;
+  return (size_t)hash & (m_table.size() - 1);
+}
+
+int32_t ChunkService::table_find(const ChunkKey &key) const {
+  size_t mask = m_table.size() - 1;
+  for (size_t i = table_index(key);; i = (i + 1) & mask) {
+    int32_t slot = m_table[i];
+    if (slot < 0 || m_slots[slot].key == key) {
+      return slot;
+    }
+  }
+}
+
+void ChunkService::table_insert(const ChunkKey &key, uint32_t slot) {
+  size_t mask = m_table.size() - 1;
+  size_t i = table_index(key);
+  while (m_table[i] >= 0) {
+    i = (i + 1) & mask;
+  }
+  m_table[i] = (int32_t)slot;
+}
+
+/* Linear probing without tombstones: after removing an entry, later
+ * entries of the same probe sequence are moved into the gap. */
+void ChunkService::table_erase(const ChunkKey &key) {
+  size_t mask = m_table.size() - 1;
+  size_t i = table_index(key);
+  while (!(m_slots[m_table[i]].key == key)) {
+    i = (i + 1) & mask;
+  }
+  m_table[i] = -1;
+  for (size_t j = (i + 1) & mask; m_table[j] >= 0;
+       j = (j + 1) & mask) {
+    size_t home = table_index(m_slots[m_table[j]].key);
+    /* Move the entry when its home position is not within (i, j]. */
+    bool in_range = i <= j ? (i < home && home <= j)
+                           : (i < home || home <= j);
+    if (!in_range) {
+      m_table[i] = m_table[j];
+      m_table[j] = -1;
+      i = j;
+    }
+  }
+}
+
+void ChunkService::lru_unlink(uint32_t slot) {
+  Slot &s = m_slots[slot];
+  if (s.lru_prev >= 0) {
+    m_slots[s.lru_prev].lru_next = s.lru_next;
+  } else {
+    m_lru_head = s.lru_next;
+  }
+  if (s.lru_next >= 0) {
+    m_slots[s.lru_next].lru_prev = s.lru_prev;
+  } else {
+    m_lru_tail = s.lru_prev;
+  }
+  s.lru_prev = -1;
+  s.lru_next = -1;
+}
+
+void ChunkService::lru_push_front(uint32_t slot) {
+  Slot &s = m_slots[slot];
+  s.lru_prev = -1;
+  s.lru_next = m_lru_head;
+  if (m_lru_head >= 0) {
+    m_slots[m_lru_head].lru_prev = (int32_t)slot;
+  } else {
+    m_lru_tail = (int32_t)slot;
+  }
+  m_lru_head = (int32_t)slot;
+}
+
+int32_t ChunkService::allocate_slot() {
+  if (!m_free_slots.empty()) {
+    uint32_t slot = m_free_slots.back();
+    m_free_slots.pop_back();
+    return (int32_t)slot;
+  }
+  /* Only ready chunks are in the LRU list. */
+  for (int32_t slot = m_lru_tail; slot >= 0;
+       slot = m_slots[slot].lru_prev) {
+    Slot &s = m_slots[slot];
+    if (s.pins == 0) {
+      lru_unlink(slot);
+      table_erase(s.key);
+      s.state = SlotState::Free;
+      m_stats.evictions++;
+      return slot;
+    }
+  }
+  return -1;
+}
+
+ChunkHandle ChunkService::try_get(int32_t x, int32_t y,
+                                  unsigned int lod) {
+  if (lod > max_lod) {
+    return ChunkHandle();
+  }
+  std::lock_guard<std::mutex> lock(m_mutex);
+  int32_t slot = table_find({x, y, lod});
+  if (slot < 0 || m_slots[slot].state != SlotState::Ready) {
+    return ChunkHandle();
+  }
+  m_stats.hits++;
+  lru_unlink(slot);
+  lru_push_front(slot);
+  return ChunkHandle(this, (uint32_t)slot);
+}
+
+void ChunkService::request(int32_t x, int32_t y, unsigned int lod,
+                           CallbackFunction function, void *context) {
+  ChunkKey key = {x, y, lod};
+  ChunkHandle result;
+  if (lod > max_lod) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stats.rejected++;
+    }
+    function(context, std::move(result));
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    int32_t slot = table_find(key);
+    if (slot >= 0 && m_slots[slot].state == SlotState::Ready) {
+      m_stats.hits++;
+      lru_unlink(slot);
+      lru_push_front(slot);
+      result = ChunkHandle(this, (uint32_t)slot);
+    } else if (slot >= 0) {
+      m_stats.pending_hits++;
+      m_slots[slot].waiters.push_back({function, context});
+      return;
+    } else {
+      slot = allocate_slot();
+      if (slot < 0) {
+        m_stats.rejected++;
+      } else {
+        m_stats.misses++;
+        Slot &s = m_slots[slot];
+        s.key = key;
+        s.state = SlotState::Pending;
+        s.waiters.push_back({function, context});
+        table_insert(key, slot);
+        m_queue[(m_queue_begin + m_queue_size) % m_capacity] = slot;
+        m_queue_size++;
+        m_work_available.notify_one();
+        return;
+      }
+    }
+  }
+  function(context, std::move(result));
+}
+
+void ChunkService::request(int32_t x, int32_t y, unsigned int lod,
+                           Callback callback) {
+  request(
+      x, y, lod,
+      [](void *context, ChunkHandle chunk) {
+        std::unique_ptr<Callback> callback((Callback *)context);
+        (*callback)(std::move(chunk));
+      },
+      new Callback(std::move(callback)));
+}
+
+std::future<ChunkHandle> ChunkService::request(int32_t x, int32_t y,
+                                               unsigned int lod) {
+  using Promise = std::promise<ChunkHandle>;
+  Promise *promise = new Promise();
+  std::future<ChunkHandle> future = promise->get_future();
+  request(
+      x, y, lod,
+      [](void *context, ChunkHandle chunk) {
+        std::unique_ptr<Promise> promise((Promise *)context);
+        promise->set_value(std::move(chunk));
+      },
+      promise);
+  return future;
+}
+
+ChunkServiceStats ChunkService::stats() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  ChunkServiceStats stats = m_stats;
+  stats.cached_chunks = m_capacity - m_free_slots.size();
+  return stats;
+}
+
+void ChunkService::worker() {
+  NoiseLevelScratch scratch;
+  /* Reused for every chunk, like the waiter lists of the slots. */
+  std::vector<Waiter> waiters;
+  std::vector<ChunkHandle> handles;
+  waiters.reserve(reserved_waiters);
+  handles.reserve(reserved_waiters);
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_work_available.wait(
+        lock, [this]() { return m_shutdown || m_queue_size > 0; });
+    if (m_shutdown) {
+      return;
+    }
+    uint32_t slot = m_queue[m_queue_begin];
+    m_queue_begin = (m_queue_begin + 1) % m_capacity;
+    m_queue_size--;
+
+    lock.unlock();
+    generate(slot, scratch);
+    lock.lock();
+
+    Slot &s = m_slots[slot];
+    s.state = SlotState::Ready;
+    lru_push_front(slot);
+    /* Pin the chunk for every waiter before it can be evicted. The
+     * waiters are copied, so that the slot keeps its capacity. */
+    waiters.assign(s.waiters.begin(), s.waiters.end());
+    s.waiters.clear();
+    for (size_t i = 0; i < waiters.size(); i++) {
+      handles.push_back(ChunkHandle(this, slot));
+    }
+
+    lock.unlock();
+    for (size_t i = 0; i < waiters.size(); i++) {
+      waiters[i].function(waiters[i].context, std::move(handles[i]));
+    }
+    handles.clear();
+    lock.lock();
+  }
+}
+
+void ChunkService::generate(uint32_t slot,
+                            NoiseLevelScratch &scratch) {
+  const ChunkKey &key = m_slots[slot].key;
+  float *pixels = m_arena.get() + slot * m_chunk_pixels;
+  TileCache *disk_cache = m_settings.disk_cache;
+  if (disk_cache &&
+      disk_cache->settings().tile_size == m_settings.chunk_size) {
+    TileKey tile_key = {m_settings.seed,  m_settings.octaves,
+                        m_settings.scale, key.x,
+                        key.y,            key.lod};
+    /* A single capture fits into the inline storage of the
+     * std::function. */
+    struct Generation {
+      ChunkService *service;
+      const ChunkKey &key;
+      NoiseLevelScratch &scratch;
+    } generation = {this, key, scratch};
+    TileCacheHandle tile = disk_cache->get(
+        tile_key,
+        [&generation](const TileKey &, float *tile_pixels) {
+          generation.service->generate_pixels(
+              generation.key, tile_pixels, generation.scratch);
+        });
+    if (tile) {
+      memcpy(pixels, tile.pixels(), m_chunk_pixels * sizeof(float));
+      return;
+    }
+  }
+  this->generate_pixels(key, pixels, scratch);
+}
+
+void ChunkService::generate_pixels(const ChunkKey &key, float *pixels,
+                                   NoiseLevelScratch &scratch) {
+  PROFILE_ZONE("generate chunk");
+  /* request() rejects larger lods. The texel coordinates of chunks
+   * far from the origin do not fit into an int. */
+  int64_t size = m_settings.chunk_size;
+  int64_t x_begin = key.x * size;
+  int64_t y_begin = key.y * size;
+  float spacing = m_settings.scale * (float)(1u << key.lod);
+  float octaves = noise_pyramid_octaves(spacing, m_settings.octaves);
+  noise_level_tile_double(pixels, (size_t)size, key.lod, x_begin,
+                          x_begin + size, y_begin, y_begin + size,
+                          m_settings.scale, octaves,
+                          (int32_t)m_settings.seed, scratch);
+}
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "tile_cache.hpp"
+
+/* Streams square noise tiles ("chunks") of an infinite 2D world. A
+ * chunk is identified by its position in chunk units and a level of
+ * detail: chunk (x, y) at lod L covers the level 0 pixels
+ * [x * size * 2^L, (x + 1) * size * 2^L) horizontally (same for y)
+ * with size x size texels, i.e. it is a tile of mip level L of the
+ * texture that noise_texture_tiled produces for the same scale. The
+ * level of detail is at most ChunkService::max_lod.
+ *
+ * Generated chunks are kept in a bounded LRU cache. All chunk memory
+ * is allocated once up front. Chunks that are not cached are
+ * generated asynchronously on background threads. Requests with a
+ * CallbackFunction do not allocate once the waiter lists and the
+ * scratch space of the threads have grown to their working size. The
+ * std::function and future overloads allocate their callback state
+ * on every request. */
+
+struct ChunkServiceSettings {
+  /* Width and height of a chunk in texels. */
+  unsigned int chunk_size = 64;
+  float scale = 0.01f;
+  float octaves = 5.0f;
+  /* Selects the noise field like in perlin_noise_batch_seeded. Seed
+   * 0 gives the unseeded noise. */
+  uint32_t seed = 0;
+  /* Upper bound for the pixel memory of all cached chunks. At least
+   * one chunk is always kept. */
+  size_t memory_limit = 64 << 20;
+  /* Number of background threads. 0 uses all hardware threads but
+   * one. */
+  unsigned int thread_count = 0;
+  /* Optional persistent cache with the same tile size as the chunks.
+   * Chunks that are not in memory are read from it when possible, and
+   * generated chunks are added to it. It has to outlive the
+   * service. */
+  TileCache *disk_cache = nullptr;
+};
+
+struct ChunkServiceStats {
+  /* Requests for chunks that were already generated. */
+  uint64_t hits;
+  /* Requests for chunks that were still being generated. */
+  uint64_t pending_hits;
+  /* Requests that started a new generation. */
+  uint64_t misses;
+  /* Cached chunks that were dropped to make room for new ones. */
+  uint64_t evictions;
+  /* Requests that could not be served because every chunk was in use
+   * or pending. */
+  uint64_t rejected;
+  size_t cached_chunks;
+  size_t capacity_chunks;
+  size_t memory_bytes;
+};
+
+class ChunkService;
+struct NoiseLevelScratch;
+
+/* Keeps a chunk's pixels alive. A chunk is never evicted while a
+ * handle to it exists, so handles should not be held longer than
+ * necessary. An empty handle means that the request was rejected.
+ * Handles have to be released before the service is destroyed. */
+class ChunkHandle {
+ private:
+  ChunkService *m_service = nullptr;
+  uint32_t m_slot = 0;
+
+  friend class ChunkService;
+  ChunkHandle(ChunkService *service, uint32_t slot);
+
+ public:
+  ChunkHandle() = default;
+  ChunkHandle(const ChunkHandle &other);
+  ChunkHandle(ChunkHandle &&other) noexcept;
+  ChunkHandle &operator=(ChunkHandle other) noexcept;
+  ~ChunkHandle();
+
+  explicit operator bool() const { return m_service != nullptr; }
+
+  /* chunk_size x chunk_size texels, row by row. */
+  const float *pixels() const;
+  unsigned int size() const;
+};
+
+class ChunkService {
+ public:
+  using Callback = std::function<void(ChunkHandle chunk)>;
+  /* Callback without state of its own. `context` is passed through
+   * unchanged. */
+  using CallbackFunction = void (*)(void *context, ChunkHandle chunk);
+
+  /* Chunks at a coarser level of detail are rejected. A texel of it
+   * covers 2^31 level 0 pixels. */
+  static constexpr unsigned int max_lod = 31;
+
+ private:
+  friend class ChunkHandle;
+
+  enum class SlotState : uint8_t { Free, Pending, Ready };
+
+  struct Waiter {
+    CallbackFunction function;
+    void *context;
+  };
+
+  /* Waiters per slot that are reserved up front. The lists only grow
+   * when more requests wait for the same chunk, and keep their
+   * capacity after that. */
+  static constexpr size_t reserved_waiters = 4;
+
+  struct ChunkKey {
+    int32_t x;
+    int32_t y;
+    uint32_t lod;
+
+    bool operator==(const ChunkKey &other) const {
+      return x == other.x && y == other.y && lod == other.lod;
+    }
+  };
+
+  /* Chunk memory and bookkeeping. The LRU list links slots by index,
+   * the most recently used slot is at the front. */
+  struct Slot {
+    ChunkKey key;
+    SlotState state = SlotState::Free;
+    std::atomic<uint32_t> pins{0};
+    int32_t lru_prev = -1;
+    int32_t lru_next = -1;
+    std::vector<Waiter> waiters;
+  };
+
+  ChunkServiceSettings m_settings;
+  size_t m_chunk_pixels;
+  uint32_t m_capacity;
+  std::unique_ptr<float[]> m_arena;
+  std::unique_ptr<Slot[]> m_slots;
+  std::vector<uint32_t> m_free_slots;
+  int32_t m_lru_head = -1;
+  int32_t m_lru_tail = -1;
+
+  /* Open addressing table from ChunkKey to slot index (-1 if
+   * empty), with at least twice as many entries as slots. */
+  std::vector<int32_t> m_table;
+
+  /* Ring buffer of pending slots. Every slot is queued at most once,
+   * so it never overflows. */
+  std::vector<uint32_t> m_queue;
+  size_t m_queue_begin = 0;
+  size_t m_queue_size = 0;
+
+  ChunkServiceStats m_stats = {};
+
+  mutable std::mutex m_mutex;
+  std::condition_variable m_work_available;
+  bool m_shutdown = false;
+  std::vector<std::thread> m_threads;
+
+ public:
+  explicit ChunkService(const ChunkServiceSettings &settings = {});
+  ~ChunkService();
+
+  ChunkService(const ChunkService &) = delete;
+  ChunkService &operator=(const ChunkService &) = delete;
+
+  /* Return the chunk if it is cached, without generating it. An
+   * invalid lod gives an empty handle. */
+  ChunkHandle try_get(int32_t x, int32_t y, unsigned int lod);
+
+  /* Request a chunk. `function` is called with `context` and the
+   * chunk right away when it is cached, and otherwise on a background
+   * thread once it has been generated. It gets an empty handle when
+   * the request is rejected because all cache slots are in use or
+   * pending, or because lod is above max_lod. */
+  void request(int32_t x, int32_t y, unsigned int lod,
+               CallbackFunction function, void *context);
+
+  /* Same as above with a std::function, which is moved to the heap
+   * until it is called. */
+  void request(int32_t x, int32_t y, unsigned int lod,
+               Callback callback);
+
+  /* Same as above, but returns a future. */
+  std::future<ChunkHandle> request(int32_t x, int32_t y,
+                                   unsigned int lod);
+
+  ChunkServiceStats stats() const;
+  const ChunkServiceSettings &settings() const { return m_settings; }
+
+ private:
+  size_t table_index(const ChunkKey &key) const;
+  int32_t table_find(const ChunkKey &key) const;
+  void table_insert(const ChunkKey &key, uint32_t slot);
+  void table_erase(const ChunkKey &key);
+
+  void lru_unlink(uint32_t slot);
+  void lru_push_front(uint32_t slot);
+
+  /* Take a free slot or evict the least recently used chunk that is
+   * not pinned. Returns -1 when there is none. */
+  int32_t allocate_slot();
+
+  void worker();
+  /* Fill the chunk of a pending slot, from the disk cache or by
+   * evaluating it with the scratch space of the worker. */
+  void generate(uint32_t slot, NoiseLevelScratch &scratch);
+  void generate_pixels(const ChunkKey &key, float *pixels,
+                       NoiseLevelScratch &scratch);
+};
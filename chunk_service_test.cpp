@@ -0,0 +1,335 @@
+/* Test of the bookkeeping of ChunkService: the LRU order, the hash
+ * table with its backward-shift deletion, pinning by handles, and
+ * the requests that are rejected. The pixels of every chunk are
+ * compared against noise_level_tile_double, so that a table entry
+ * that points to the wrong slot is noticed as well.
+ *
+ * Usage: simd_chunk_service_test
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <random>
+#include <vector>
+
+#include "chunk_service.hpp"
+#include "noise_pyramid.hpp"
+
+struct Key {
+  int32_t x;
+  int32_t y;
+  unsigned int lod;
+
+  bool operator==(const Key &other) const {
+    return x == other.x && y == other.y && lod == other.lod;
+  }
+};
+
+/* Allocations of all threads, see test_allocations. */
+static std::atomic<uint64_t> allocations{0};
+
+void *operator new(size_t size) {
+  allocations++;
+  if (void *memory = malloc(size ? size : 1)) {
+    return memory;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept { free(memory); }
+
+void operator delete(void *memory, size_t) noexcept { free(memory); }
+
+static size_t checks = 0;
+static size_t failures = 0;
+
+static void check(bool condition, const char *what) {
+  checks++;
+  if (!condition) {
+    failures++;
+    std::cout << "FAILED: " << what << "\n";
+  }
+}
+
+/* A service with room for `capacity` chunks of 8 x 8 texels. */
+static ChunkServiceSettings small_settings(size_t capacity) {
+  ChunkServiceSettings settings;
+  settings.chunk_size = 8;
+  settings.memory_limit = capacity * 8 * 8 * sizeof(float);
+  settings.thread_count = 1;
+  return settings;
+}
+
+/* Whether the chunk holds the texels of `key`. */
+static bool chunk_matches(const ChunkServiceSettings &settings,
+                          const ChunkHandle &chunk, const Key &key) {
+  if (!chunk) {
+    return false;
+  }
+  int64_t size = settings.chunk_size;
+  std::vector<float> expected((size_t)(size * size));
+  float spacing = settings.scale * (float)(1u << key.lod);
+  float octaves = noise_pyramid_octaves(spacing, settings.octaves);
+  NoiseLevelScratch scratch;
+  int64_t x_begin = key.x * size;
+  int64_t y_begin = key.y * size;
+  noise_level_tile_double(expected.data(), (size_t)size, key.lod,
+                          x_begin, x_begin + size, y_begin,
+                          y_begin + size, settings.scale, octaves,
+                          (int32_t)settings.seed, scratch);
+  return memcmp(chunk.pixels(), expected.data(),
+                expected.size() * sizeof(float)) == 0;
+}
+
+static ChunkHandle request(ChunkService &service, const Key &key) {
+  return service.request(key.x, key.y, key.lod).get();
+}
+
+/* Random requests for more keys than fit, checked against a model of
+ * the LRU cache. 12 keys share a table of 8 entries, so most
+ * evictions move entries back within a probe sequence. */
+static void test_lru() {
+  ChunkServiceSettings settings = small_settings(4);
+  ChunkService service(settings);
+  std::vector<Key> keys;
+  for (int32_t y = -1; y < 2; y++) {
+    for (int32_t x = -1; x < 1; x++) {
+      keys.push_back({x, y, 0});
+      keys.push_back({x, y, 2});
+    }
+  }
+
+  /* Most recently used first. */
+  std::vector<Key> model;
+  uint64_t hits = 0, misses = 0, evictions = 0;
+  bool pixels_match = true;
+  std::mt19937 rng(1);
+  for (int i = 0; i < 2000; i++) {
+    const Key &key = keys[rng() % keys.size()];
+    auto cached = std::find(model.begin(), model.end(), key);
+    if (cached != model.end()) {
+      hits++;
+      model.erase(cached);
+    } else {
+      misses++;
+      if (model.size() == 4) {
+        evictions++;
+        model.pop_back();
+      }
+    }
+    model.insert(model.begin(), key);
+    pixels_match &=
+        chunk_matches(settings, request(service, key), key);
+  }
+  check(pixels_match, "lru: every chunk has its own pixels");
+
+  ChunkServiceStats stats = service.stats();
+  check(stats.hits == hits, "lru: hits");
+  check(stats.misses == misses, "lru: misses");
+  check(stats.evictions == evictions, "lru: evictions");
+  check(stats.cached_chunks == 4, "lru: cached chunks");
+
+  /* try_get counts as a use as well, so the model is only checked
+   * from the least recently used chunk on. */
+  for (auto it = model.rbegin(); it != model.rend(); ++it) {
+    check(chunk_matches(settings,
+                        service.try_get(it->x, it->y, it->lod), *it),
+          "lru: cached chunks are found");
+  }
+  for (const Key &key : keys) {
+    if (std::find(model.begin(), model.end(), key) == model.end()) {
+      check(!service.try_get(key.x, key.y, key.lod),
+            "lru: evicted chunks are not found");
+    }
+  }
+}
+
+/* Pinned chunks are skipped by the eviction, and requests are
+ * rejected when every chunk is pinned. */
+static void test_pinning() {
+  ChunkServiceSettings settings = small_settings(2);
+  ChunkService service(settings);
+  const Key a = {0, 0, 0}, b = {1, 0, 0}, c = {2, 0, 0};
+
+  ChunkHandle chunk_a = request(service, a);
+  ChunkHandle chunk_b = request(service, b);
+  check(!request(service, c), "pinning: rejected when all pinned");
+  check(service.stats().rejected == 1, "pinning: rejected count");
+
+  /* Using a leaves b as the least recently used chunk, which is
+   * still pinned. */
+  check(bool(service.try_get(a.x, a.y, a.lod)), "pinning: try_get");
+  chunk_a = ChunkHandle();
+  ChunkHandle chunk_c = request(service, c);
+  check(chunk_matches(settings, chunk_c, c), "pinning: evicts a");
+  check(!service.try_get(a.x, a.y, a.lod), "pinning: a is evicted");
+  check(chunk_matches(settings, chunk_b, b), "pinning: b is kept");
+  check(chunk_matches(settings, service.try_get(b.x, b.y, b.lod), b),
+        "pinning: b is still cached");
+}
+
+/* Whether the texels of the chunk are all different and match the
+ * noise at positions that are computed independently in long double
+ * and evaluated with the scalar kernels. Positions that collapse in
+ * float precision give equal neighbors. */
+static bool chunk_is_precise(const ChunkServiceSettings &settings,
+                             const ChunkHandle &chunk,
+                             const Key &key) {
+  if (!chunk) {
+    return false;
+  }
+  size_t size = settings.chunk_size;
+  std::vector<float> texels(chunk.pixels(),
+                            chunk.pixels() + size * size);
+  std::sort(texels.begin(), texels.end());
+  if (std::unique(texels.begin(), texels.end()) != texels.end()) {
+    return false;
+  }
+
+  const NoiseKernels &scalar =
+      *noise_kernels_for_tier(SimdTier::Scalar);
+  float spacing = settings.scale * (float)(1u << key.lod);
+  float octaves = noise_pyramid_octaves(spacing, settings.octaves);
+  auto position = [&](int64_t chunk_index, size_t i) {
+    long double texel = (long double)chunk_index * size + i;
+    return (double)(((texel + 0.5L) * (1u << key.lod) - 0.5L) *
+                    settings.scale);
+  };
+  std::vector<double> xs(size), ys(size), zs(size, 0.0);
+  std::vector<float> expected(size);
+  for (size_t i = 0; i < size; i++) {
+    xs[i] = position(key.x, i);
+  }
+  for (size_t y = 0; y < size; y++) {
+    std::fill(ys.begin(), ys.end(), position(key.y, y));
+    scalar.perlin_noise_batch_double(xs.data(), ys.data(),
+                                     zs.data(), nullptr,
+                                     expected.data(), size, octaves);
+    for (size_t x = 0; x < size; x++) {
+      if (std::abs(chunk.pixels()[y * size + x] - expected[x]) >
+          1e-4f) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/* Levels of detail above max_lod are rejected, the texel coordinates
+ * of the outermost chunks do not overflow, and chunks far from the
+ * origin keep the full precision. */
+static void test_limits() {
+  ChunkServiceSettings settings = small_settings(4);
+  ChunkService service(settings);
+  const unsigned int max_lod = ChunkService::max_lod;
+
+  check(!request(service, {0, 0, max_lod + 1}),
+        "limits: lod above max_lod is rejected");
+  check(!request(service, {0, 0, ~0u}), "limits: huge lod");
+  check(service.stats().rejected == 2, "limits: rejected count");
+  check(!service.try_get(0, 0, max_lod + 1),
+        "limits: try_get with lod above max_lod");
+
+  const Key far_chunks[] = {{INT32_MAX / 2, 0, 0},
+                            {INT32_MAX, INT32_MIN, 0},
+                            {INT32_MIN, INT32_MAX, 0}};
+  for (const Key &key : far_chunks) {
+    check(chunk_is_precise(settings, request(service, key), key),
+          "limits: chunks far from the origin are precise");
+  }
+  const Key coarsest = {INT32_MAX, INT32_MAX, max_lod};
+  check(chunk_matches(settings, request(service, coarsest), coarsest),
+        "limits: chunk at max_lod");
+}
+
+/* The seed of the settings selects the noise field. */
+static void test_seed() {
+  ChunkServiceSettings settings = small_settings(2);
+  ChunkServiceSettings seeded_settings = settings;
+  seeded_settings.seed = 7;
+  ChunkService service(settings);
+  ChunkService seeded_service(seeded_settings);
+  const Key key = {3, -2, 0};
+
+  ChunkHandle chunk = request(service, key);
+  ChunkHandle seeded_chunk = request(seeded_service, key);
+  check(chunk_matches(seeded_settings, seeded_chunk, key),
+        "seed: chunk has the pixels of its seed");
+  size_t pixels = (size_t)settings.chunk_size * settings.chunk_size;
+  check(chunk && seeded_chunk &&
+            memcmp(chunk.pixels(), seeded_chunk.pixels(),
+                   pixels * sizeof(float)) != 0,
+        "seed: seeds give different chunks");
+}
+
+/* Counts the delivered chunks of requests with a CallbackFunction. */
+struct Delivery {
+  std::mutex mutex;
+  std::condition_variable delivered;
+  size_t count = 0;
+  size_t empty = 0;
+
+  static void deliver(void *context, ChunkHandle chunk) {
+    Delivery &delivery = *(Delivery *)context;
+    std::lock_guard<std::mutex> lock(delivery.mutex);
+    delivery.count++;
+    delivery.empty += chunk ? 0 : 1;
+    delivery.delivered.notify_all();
+  }
+
+  void wait(size_t expected) {
+    std::unique_lock<std::mutex> lock(mutex);
+    delivered.wait(lock, [&]() { return count >= expected; });
+  }
+};
+
+/* Once every slot and thread has seen the working set, streaming with
+ * a CallbackFunction does not allocate: generated chunks, cache hits
+ * and several waiters for the same pending chunk. */
+static void test_allocations() {
+  ChunkServiceSettings settings = small_settings(4);
+  settings.thread_count = 2;
+  ChunkService service(settings);
+  Delivery delivery;
+  size_t requested = 0;
+  auto stream = [&](int pass) {
+    for (int32_t x = 0; x < 6; x++) {
+      for (int waiter = 0; waiter < 3; waiter++) {
+        service.request(x, pass, 0, Delivery::deliver, &delivery);
+        requested++;
+      }
+      service.request(x - 1, pass, 0, Delivery::deliver, &delivery);
+      requested++;
+      delivery.wait(requested);
+    }
+  };
+
+  stream(0);
+  uint64_t warm_allocations = allocations;
+  for (int pass = 1; pass < 20; pass++) {
+    stream(pass);
+  }
+  check(allocations == warm_allocations,
+        "allocations: streaming does not allocate");
+  check(delivery.empty == 0, "allocations: no request is rejected");
+}
+
+int main() {
+  test_lru();
+  test_pinning();
+  test_limits();
+  test_seed();
+  test_allocations();
+
+  std::cout << checks - failures << " of " << checks
+            << " checks passed\n";
+  return failures == 0 ? 0 : 1;
+}
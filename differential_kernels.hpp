@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/* Kernels that are checked by simd_differential_test. Like the bench
+ * kernels, they are compiled once per instruction set (see
+ * differential_kernels_impl.cpp) and exist for several vector widths
+ * per tier, including widths above the native one that use the
+ * generic recursive implementation. */
+
+struct DifferentialInput {
+  const float *xs;
+  const float *ys;
+  const float *zs;
+  const float *ws;
+  /* Arbitrary lattice coordinates for the hashes. */
+  const int32_t *x_ids;
+  const int32_t *y_ids;
+  const int32_t *z_ids;
+  /* A multiple of every tested width. */
+  size_t count;
+};
+
+struct DifferentialKernel {
+  const char *name;
+  /* 0 for kernels that only serve as a reference. */
+  unsigned int width;
+  /* Values that are written per sample. Output k of sample i is
+   * stored at out[k * count + i]. */
+  unsigned int outputs;
+  /* Allowed distance to the reference in units in the last place of
+   * max(|reference|, 1), see differential_test.cpp. 0 requires
+   * bit-identical results, which is used for integer outputs that
+   * are stored as their bit pattern. */
+  float max_ulps;
+  void (*run)(const DifferentialInput &input, float *out);
+  /* Name of the scalar kernel whose output is expected, e.g. a
+   * slower brute-force version. Null to compare against the width 1
+   * kernel of the same name. */
+  const char *reference;
+};
+
+struct DifferentialKernelList {
+  const DifferentialKernel *kernels;
+  size_t count;
+};
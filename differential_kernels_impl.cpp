@@ -0,0 +1,840 @@
+/* This file is compiled once per instruction set, see
+ * noise_kernels_impl.cpp. */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "cellular_noise.hpp"
+#include "differential_kernels.hpp"
+#include "gradient_noise.hpp"
+#include "lattice_coord.hpp"
+#include "noise_grid.hpp"
+#include "noise_derivatives.hpp"
+#include "noise_graph.hpp"
+#include "pixel_pack.hpp"
+#include "simplex_noise.hpp"
+
+SIMD_NAMESPACE_BEGIN
+
+/* Integer results are stored as their bit pattern. */
+template <unsigned int N>
+static void store_bits(int32_v<N> value, float *dst) {
+  int32_t bits[N];
+  value.storeu(bits);
+  memcpy(dst, bits, sizeof(bits));
+}
+
+/* Reads every lane through get<Index>, which exercises the index
+ * computation for the upper half in the generic implementation. */
+template <unsigned int N, unsigned int Index = 0> struct LaneReader {
+  static void read(float_v<N> value, int32_v<N> ids, float *values,
+                   int32_t *id_values) {
+    values[Index] = value.template get<(int)Index>();
+    id_values[Index] = ids.template get<(int)Index>();
+    LaneReader<N, Index + 1>::read(value, ids, values, id_values);
+  }
+};
+
+template <unsigned int N> struct LaneReader<N, N> {
+  static void read(float_v<N>, int32_v<N>, float *, int32_t *) {}
+};
+
+template <unsigned int N>
+static void differential_lanes(const DifferentialInput &input,
+                               float *out) {
+  for (size_t i = 0; i < input.count; i += N) {
+    int32_t ids[N];
+    LaneReader<N>::read(float_v<N>::loadu(input.xs + i),
+                        int32_v<N>::loadu(input.x_ids + i), out + i,
+                        ids);
+    memcpy(out + input.count + i, ids, sizeof(ids));
+  }
+}
+
+template <unsigned int N>
+static void
+differential_floor_as_int32(const DifferentialInput &input,
+                            float *out) {
+  for (size_t i = 0; i < input.count; i += N) {
+    float_v<N> x = float_v<N>::loadu(input.xs + i);
+    store_bits(x.floor().as_int32(), out + i);
+  }
+}
+
+template <unsigned int N>
+static void
+differential_round_as_int32(const DifferentialInput &input,
+                            float *out) {
+  for (size_t i = 0; i < input.count; i += N) {
+    float_v<N> x = float_v<N>::loadu(input.xs + i);
+    store_bits(x.as_int32(), out + i);
+  }
+}
+
+template <unsigned int N, typename Hash>
+static void differential_hash(const DifferentialInput &input,
+                              float *out) {
+  for (size_t i = 0; i < input.count; i += N) {
+    store_bits(
+        hash_position_bits<Hash>(int32_v<N>::loadu(input.x_ids + i),
+                                 int32_v<N>::loadu(input.y_ids + i),
+                                 int32_v<N>::loadu(input.z_ids + i)),
+        out + i);
+  }
+}
+
+/* Same lattice points as differential_hash, with the z coordinate
+ * also used as the seed. */
+template <unsigned int N, typename Hash>
+static void differential_hash_seeded(const DifferentialInput &input,
+                                     float *out) {
+  for (size_t i = 0; i < input.count; i += N) {
+    const int32_v<N> ids[3] = {int32_v<N>::loadu(input.x_ids + i),
+                               int32_v<N>::loadu(input.y_ids + i),
+                               int32_v<N>::loadu(input.z_ids + i)};
+    store_bits(hash_position_bits<Hash>(ids, ids[2]), out + i);
+  }
+}
+
+template <unsigned int N>
+static void
+differential_value_noise_1d(const DifferentialInput &input,
+                            float *out) {
+  for (size_t i = 0; i < input.count; i += N) {
+    eval_noise(float_v<N>::loadu(input.xs + i)).storeu(out + i);
+  }
+}
+
+template <unsigned int N>
+static void
+differential_value_noise_2d(const DifferentialInput &input,
+                            float *out) {
+  for (size_t i = 0; i < input.count; i += N) {
+    eval_noise(float_v<N>::loadu(input.xs + i),
+               float_v<N>::loadu(input.ys + i))
+        .storeu(out + i);
+  }
+}
+
+template <unsigned int N>
+static void
+differential_value_noise_3d(const DifferentialInput &input,
+                            float *out) {
+  for (size_t i = 0; i < input.count; i += N) {
+    eval_noise(float_v<N>::loadu(input.xs + i),
+               float_v<N>::loadu(input.ys + i),
+               float_v<N>::loadu(input.zs + i))
+        .storeu(out + i);
+  }
+}
+
+template <unsigned int N>
+static void
+differential_value_noise_4d(const DifferentialInput &input,
+                            float *out) {
+  for (size_t i = 0; i < input.count; i += N) {
+    eval_noise(float_v<N>::loadu(input.xs + i),
+               float_v<N>::loadu(input.ys + i),
+               float_v<N>::loadu(input.zs + i),
+               float_v<N>::loadu(input.ws + i))
+        .storeu(out + i);
+  }
+}
+
+template <unsigned int N>
+static void
+differential_gradient_noise(const DifferentialInput &input,
+                            float *out) {
+  for (size_t i = 0; i < input.count; i += N) {
+    eval_gradient_noise(float_v<N>::loadu(input.xs + i),
+                        float_v<N>::loadu(input.ys + i),
+                        float_v<N>::loadu(input.zs + i))
+        .storeu(out + i);
+  }
+}
+
+template <unsigned int N>
+static void differential_simplex_3d(const DifferentialInput &input,
+                                    float *out) {
+  for (size_t i = 0; i < input.count; i += N) {
+    eval_simplex_noise(float_v<N>::loadu(input.xs + i),
+                       float_v<N>::loadu(input.ys + i),
+                       float_v<N>::loadu(input.zs + i))
+        .storeu(out + i);
+  }
+}
+
+template <unsigned int N>
+static void differential_simplex_4d(const DifferentialInput &input,
+                                    float *out) {
+  for (size_t i = 0; i < input.count; i += N) {
+    eval_simplex_noise(float_v<N>::loadu(input.xs + i),
+                       float_v<N>::loadu(input.ys + i),
+                       float_v<N>::loadu(input.zs + i),
+                       float_v<N>::loadu(input.ws + i))
+        .storeu(out + i);
+  }
+}
+
+template <unsigned int N>
+static void differential_derivatives(const DifferentialInput &input,
+                                     float *out) {
+  size_t count = input.count;
+  for (size_t i = 0; i < count; i += N) {
+    NoiseDerivatives<N> noise = eval_noise_with_derivatives(
+        float_v<N>::loadu(input.xs + i),
+        float_v<N>::loadu(input.ys + i),
+        float_v<N>::loadu(input.zs + i));
+    noise.value.storeu(out + i);
+    noise.dx.storeu(out + count + i);
+    noise.dy.storeu(out + 2 * count + i);
+    noise.dz.storeu(out + 3 * count + i);
+  }
+}
+
+template <unsigned int N, CellularDistance Distance>
+static void differential_cellular(const DifferentialInput &input,
+                                  float *out) {
+  for (size_t i = 0; i < input.count; i += N) {
+    float_v<N> x = float_v<N>::loadu(input.xs + i);
+    float_v<N> y = float_v<N>::loadu(input.ys + i);
+    float_v<N> z = float_v<N>::loadu(input.zs + i);
+    CellularNoise<N> noise = eval_cellular_noise<Distance>(x, y, z);
+    noise.f1.storeu(out + i);
+    noise.f2.storeu(out + input.count + i);
+    cellular_noise_output(noise, CellularOutput::CellId)
+        .storeu(out + 2 * input.count + i);
+  }
+}
+
+/* Reference for differential_cellular: every cell within a radius
+ * of 4 is visited, with the same arithmetic per cell. The 27 inner
+ * cells come first, like in eval_cellular_noise, so that equal
+ * distances, which are common for Manhattan distances, keep the same
+ * cell ID. */
+template <unsigned int N, CellularDistance Distance>
+static void
+differential_cellular_brute_force(const DifferentialInput &input,
+                                  float *out) {
+  const int radius = 4;
+  for (size_t i = 0; i < input.count; i++) {
+    float_v<1> x = input.xs[i];
+    float_v<1> y = input.ys[i];
+    float_v<1> z = input.zs[i];
+    float_v<1> x_frac = x - x.floor();
+    float_v<1> y_frac = y - y.floor();
+    float_v<1> z_frac = z - z.floor();
+    int32_v<1> x_id = x.floor().as_int32();
+    int32_v<1> y_id = y.floor().as_int32();
+    int32_v<1> z_id = z.floor().as_int32();
+
+    float f1 = std::numeric_limits<float>::max();
+    float f2 = std::numeric_limits<float>::max();
+    int32_t cell_id = 0;
+    for (int pass = 0; pass < 2; pass++) {
+      for (int dz = -radius; dz <= radius; dz++) {
+        for (int dy = -radius; dy <= radius; dy++) {
+          for (int dx = -radius; dx <= radius; dx++) {
+            bool inner = std::abs(dx) <= 1 && std::abs(dy) <= 1 &&
+                         std::abs(dz) <= 1;
+            if (inner != (pass == 0)) {
+              continue;
+            }
+            const int32_v<1> ids[3] = {x_id + int32_v<1>(dx),
+                                       y_id + int32_v<1>(dy),
+                                       z_id + int32_v<1>(dz)};
+            int32_t hash = hash_position_bits(ids).value();
+            float_v<1> offset_x =
+                fmadd(float_v<1>((float)(hash & 1023)), 1.0f / 1024,
+                      float_v<1>((float)dx) - x_frac);
+            float_v<1> offset_y =
+                fmadd(float_v<1>((float)((hash >> 10) & 1023)),
+                      1.0f / 1024, float_v<1>((float)dy) - y_frac);
+            float_v<1> offset_z =
+                fmadd(float_v<1>((float)((hash >> 20) & 1023)),
+                      1.0f / 1024, float_v<1>((float)dz) - z_frac);
+            float distance = cellular_distance<Distance>(
+                                 offset_x, offset_y, offset_z)
+                                 .value();
+            if (distance < f1) {
+              f2 = f1;
+              f1 = distance;
+              cell_id = hash;
+            } else if (distance < f2) {
+              f2 = distance;
+            }
+          }
+        }
+      }
+    }
+    if (Distance == CellularDistance::Euclidean) {
+      f1 = std::sqrt(f1);
+      f2 = std::sqrt(f2);
+    }
+    out[i] = f1;
+    out[input.count + i] = f2;
+    out[2 * input.count + i] = (float)cell_id * (1.0f / (1 << 31));
+  }
+}
+
+template <unsigned int N>
+static void differential_fbm_5(const DifferentialInput &input,
+                               float *out) {
+  for (size_t i = 0; i < input.count; i += N) {
+    fbm<5>(float_v<N>::loadu(input.xs + i),
+           float_v<N>::loadu(input.ys + i),
+           float_v<N>::loadu(input.zs + i))
+        .storeu(out + i);
+  }
+}
+
+template <unsigned int N>
+static void differential_fbm_5_seeded(const DifferentialInput &input,
+                                      float *out) {
+  for (size_t i = 0; i < input.count; i += N) {
+    fbm<5>(float_v<N>::loadu(input.xs + i),
+           float_v<N>::loadu(input.ys + i),
+           float_v<N>::loadu(input.zs + i),
+           int32_v<N>::loadu(input.x_ids + i))
+        .storeu(out + i);
+  }
+}
+
+/* The lattice coordinates as cells, far away from the origin, with
+ * the fractional part of the positions. */
+template <unsigned int N>
+static void differential_fbm_lattice(const DifferentialInput &input,
+                                     float *out) {
+  for (size_t i = 0; i < input.count; i += N) {
+    const LatticeCoord<N> position[3] = {
+        lattice_coord(int32_v<N>::loadu(input.x_ids + i),
+                      float_v<N>::loadu(input.xs + i)),
+        lattice_coord(int32_v<N>::loadu(input.y_ids + i),
+                      float_v<N>::loadu(input.ys + i)),
+        lattice_coord(int32_v<N>::loadu(input.z_ids + i),
+                      float_v<N>::loadu(input.zs + i))};
+    fbm_lattice(position, 3.5f).storeu(out + i);
+  }
+}
+
+/* The positions wrapped into (-range, range), by default a range
+ * where the lattice coordinates of all octaves fit into an int32.
+ * fmod is exact. */
+static std::vector<float>
+differential_wrapped(const float *values, size_t count,
+                     float range = 65536.0f) {
+  std::vector<float> wrapped(count);
+  for (size_t i = 0; i < count; i++) {
+    wrapped[i] = std::fmod(values[i], range);
+  }
+  return wrapped;
+}
+
+/* The wrapped positions, split into cells and fractions, with seeds.
+ * Checked against perlin_noise_batch with the same seeds. */
+template <unsigned int N>
+static void differential_batch_split(const DifferentialInput &input,
+                                     float *out) {
+  const float *coordinates[3] = {input.xs, input.ys, input.zs};
+  std::vector<int32_t> cells[3];
+  std::vector<float> fractions[3];
+  SplitPositions positions;
+  for (unsigned int d = 0; d < 3; d++) {
+    std::vector<float> wrapped =
+        differential_wrapped(coordinates[d], input.count);
+    cells[d].resize(input.count);
+    fractions[d].resize(input.count);
+    for (size_t i = 0; i < input.count; i++) {
+      LatticeCoord<1> split = lattice_coord(float_v<1>(wrapped[i]));
+      cells[d][i] = split.cell.value();
+      fractions[d][i] = split.fraction.value();
+    }
+    positions.cells[d] = cells[d].data();
+    positions.fractions[d] = fractions[d].data();
+  }
+  perlin_noise_batch_split<N>(positions, input.x_ids, out,
+                              input.count, 5.0f);
+}
+
+template <unsigned int N>
+static void
+differential_batch_split_reference(const DifferentialInput &input,
+                                   float *out) {
+  std::vector<float> xs = differential_wrapped(input.xs, input.count);
+  std::vector<float> ys = differential_wrapped(input.ys, input.count);
+  std::vector<float> zs = differential_wrapped(input.zs, input.count);
+  perlin_noise_batch<N>(xs.data(), ys.data(), zs.data(), input.x_ids,
+                        out, input.count, 5.0f);
+}
+
+/* Split the samples into rows of 1 to 37 samples, so that most rows
+ * end with a partial vector. The rows share y and z of their first
+ * sample and cycle through three kinds: sorted x within a few cells,
+ * which uses the lattice cache, sorted x from the full input range,
+ * and unsorted x, which falls back to perlin_noise_batch. */
+template <typename Row>
+static void differential_rows(const DifferentialInput &input,
+                              Row row) {
+  std::vector<float> xs;
+  size_t row_index = 0;
+  for (size_t begin = 0; begin < input.count; row_index++) {
+    size_t count = std::min<size_t>(row_index % 37 + 1,
+                                    input.count - begin);
+    xs.assign(input.xs + begin, input.xs + begin + count);
+    if (row_index % 3 != 1) {
+      for (float &x : xs) {
+        x = std::fmod(x, 16.0f);
+      }
+    }
+    if (row_index % 3 != 2) {
+      std::sort(xs.begin(), xs.end());
+    }
+    row(xs.data(), input.ys[begin], input.zs[begin], begin, count);
+    begin += count;
+  }
+}
+
+/* perlin_noise_row is bit-identical to perlin_noise_batch of the
+ * same width and tier, which the scalar reference cannot show. The
+ * output is the XOR of the bit patterns of both, 0 when they are
+ * identical. */
+template <unsigned int N, unsigned int Dims>
+static void differential_perlin_row(const DifferentialInput &input,
+                                    float *out) {
+  std::vector<float> ys, zs, expected;
+  differential_rows(input, [&](const float *xs, float y, float z,
+                               size_t begin, size_t count) {
+    ys.assign(count, y);
+    zs.assign(count, Dims > 2 ? z : 0.0f);
+    expected.resize(count);
+    perlin_noise_batch<N>(xs, ys.data(), zs.data(), expected.data(),
+                          count, 4.5f);
+    if (Dims > 2) {
+      perlin_noise_row<N>(xs, y, z, out + begin, count, 4.5f);
+    } else {
+      perlin_noise_row<N>(xs, y, out + begin, count, 4.5f);
+    }
+    for (size_t i = 0; i < count; i++) {
+      uint32_t row_bits, batch_bits;
+      memcpy(&row_bits, out + begin + i, sizeof(row_bits));
+      memcpy(&batch_bits, &expected[i], sizeof(batch_bits));
+      row_bits ^= batch_bits;
+      memcpy(out + begin + i, &row_bits, sizeof(row_bits));
+    }
+  });
+}
+
+template <unsigned int N>
+static void differential_perlin_row_2d(const DifferentialInput &input,
+                                       float *out) {
+  differential_perlin_row<N, 2>(input, out);
+}
+
+template <unsigned int N>
+static void differential_perlin_row_3d(const DifferentialInput &input,
+                                       float *out) {
+  differential_perlin_row<N, 3>(input, out);
+}
+
+/* Reference of kernels that output 0 when they succeed. */
+template <unsigned int N>
+static void differential_zero(const DifferentialInput &input,
+                              float *out) {
+  std::fill(out, out + input.count, 0.0f);
+}
+
+/* The graph of bench_noise_graph. The warp turns the rounding
+ * differences of the warp noise with and without FMA into position
+ * offsets, which grow with the distance from the origin. The
+ * positions are kept within 64 and the graph kernels allow 256
+ * ulps. */
+static auto differential_graph() {
+  auto warp_x = node_fbm<4>(0.5f);
+  auto warp_y = node_translate(node_fbm<4>(0.5f), 5.2f, 1.3f, 0.0f);
+  auto terrain = node_remap(node_warp(node_fbm<5>(), 0.8f, warp_x,
+                                      warp_y),
+                            -1.0f, 1.0f, 0.0f, 1.0f);
+  return node_clamp(terrain * node_cellular(), 0.0f, 1.0f);
+}
+
+template <unsigned int N>
+static void differential_noise_graph(const DifferentialInput &input,
+                                     float *out) {
+  size_t count = input.count;
+  std::vector<float> xs =
+      differential_wrapped(input.xs, count, 64.0f);
+  std::vector<float> ys =
+      differential_wrapped(input.ys, count, 64.0f);
+  std::vector<float> zs =
+      differential_wrapped(input.zs, count, 64.0f);
+  noise_graph_batch<N>(differential_graph(), xs.data(), ys.data(),
+                       zs.data(), out, count);
+}
+
+/* differential_graph composed from batch calls, with a buffer per
+ * stage, like bench_noise_graph_staged. */
+template <unsigned int N>
+static void
+differential_noise_graph_staged(const DifferentialInput &input,
+                                float *out) {
+  size_t count = input.count;
+  std::vector<float> xs =
+      differential_wrapped(input.xs, count, 64.0f);
+  std::vector<float> ys =
+      differential_wrapped(input.ys, count, 64.0f);
+  std::vector<float> zs =
+      differential_wrapped(input.zs, count, 64.0f);
+  std::vector<float> stage_xs(count), stage_ys(count);
+  std::vector<float> stage_zs(count);
+  std::vector<float> warp_x(count), warp_y(count), mask(count);
+
+  for (size_t i = 0; i < count; i++) {
+    stage_xs[i] = xs[i] * 0.5f;
+    stage_ys[i] = ys[i] * 0.5f;
+    stage_zs[i] = zs[i] * 0.5f;
+  }
+  perlin_noise_batch<N>(stage_xs.data(), stage_ys.data(),
+                        stage_zs.data(), warp_x.data(), count, 4.0f);
+  for (size_t i = 0; i < count; i++) {
+    stage_xs[i] = (xs[i] + 5.2f) * 0.5f;
+    stage_ys[i] = (ys[i] + 1.3f) * 0.5f;
+  }
+  perlin_noise_batch<N>(stage_xs.data(), stage_ys.data(),
+                        stage_zs.data(), warp_y.data(), count, 4.0f);
+  for (size_t i = 0; i < count; i++) {
+    stage_xs[i] = xs[i] + warp_x[i] * 0.8f;
+    stage_ys[i] = ys[i] + warp_y[i] * 0.8f;
+  }
+  perlin_noise_batch<N>(stage_xs.data(), stage_ys.data(), zs.data(),
+                        out, count, 5.0f);
+  cellular_noise_batch<N>(xs.data(), ys.data(), zs.data(),
+                          mask.data(), count,
+                          CellularDistance::Euclidean,
+                          CellularOutput::F1);
+  for (size_t i = 0; i < count; i++) {
+    float value = (out[i] * 0.5f + 0.5f) * mask[i];
+    out[i] = std::min(std::max(value, 0.0f), 1.0f);
+  }
+}
+
+/* Splits the samples into tiles of 37 texels per row and up to 8
+ * rows, so that every row ends with a partial vector, and calls
+ * `tile(out, x_begin, y_begin, width, height)` for each. The last
+ * samples form a single row. The tile origins come from the lattice
+ * coordinates of the input. */
+template <typename Tile>
+static void differential_graph_tiles(const DifferentialInput &input,
+                                     float *out, Tile tile) {
+  const size_t width = 37;
+  for (size_t begin = 0; begin < input.count;) {
+    size_t remaining = input.count - begin;
+    size_t tile_width = std::min(width, remaining);
+    size_t tile_height = std::min<size_t>(remaining / tile_width, 8);
+    unsigned int x = (uint32_t)input.x_ids[begin] % 4096;
+    unsigned int y = (uint32_t)input.y_ids[begin] % 4096;
+    tile(out + begin, x, y, (unsigned int)tile_width,
+         (unsigned int)tile_height);
+    begin += tile_width * tile_height;
+  }
+}
+
+template <unsigned int N>
+static void
+differential_noise_graph_tile(const DifferentialInput &input,
+                              float *out) {
+  auto graph = differential_graph();
+  differential_graph_tiles(
+      input, out,
+      [&](float *tile, unsigned int x, unsigned int y,
+          unsigned int width, unsigned int height) {
+        noise_graph_tile<N>(graph, tile, width, x, x + width, y,
+                            y + height, 0.013f);
+      });
+}
+
+/* The texel positions of differential_noise_graph_tile, evaluated
+ * with noise_graph_batch. */
+template <unsigned int N>
+static void differential_noise_graph_tile_reference(
+    const DifferentialInput &input, float *out) {
+  auto graph = differential_graph();
+  std::vector<float> xs, ys, zs;
+  differential_graph_tiles(
+      input, out,
+      [&](float *tile, unsigned int x, unsigned int y,
+          unsigned int width, unsigned int height) {
+        size_t count = (size_t)width * height;
+        xs.resize(count);
+        ys.resize(count);
+        zs.assign(count, 0.0f);
+        for (size_t i = 0; i < count; i++) {
+          xs[i] = (float)(x + i % width) * 0.013f;
+          ys[i] = (float)(y + i / width) * 0.013f;
+        }
+        noise_graph_batch<N>(graph, xs.data(), ys.data(), zs.data(),
+                             tile, count);
+      });
+}
+
+template <unsigned int N>
+static void differential_lattice_fixed(const DifferentialInput &input,
+                                       float *out) {
+  for (size_t i = 0; i < input.count; i += N) {
+    LatticeCoord<N> position =
+        lattice_coord_fixed<16>(int32_v<N>::loadu(input.x_ids + i));
+    position = lattice_coord_double(position);
+    store_bits(position.cell, out + i);
+    position.fraction.storeu(out + input.count + i);
+  }
+}
+
+template <unsigned int N>
+static void differential_fbm_runtime(const DifferentialInput &input,
+                                     float *out) {
+  for (size_t i = 0; i < input.count; i += N) {
+    perlin_noise__octaves(float_v<N>::loadu(input.xs + i),
+                          float_v<N>::loadu(input.ys + i),
+                          float_v<N>::loadu(input.zs + i), 3.5f)
+        .storeu(out + i);
+  }
+}
+
+template <unsigned int N>
+static void differential_hash_mix(const DifferentialInput &input,
+                                  float *out) {
+  differential_hash<N, HashMix>(input, out);
+}
+
+template <unsigned int N>
+static void differential_hash_xorshift(const DifferentialInput &input,
+                                       float *out) {
+  differential_hash<N, HashXorshift>(input, out);
+}
+
+template <unsigned int N>
+static void
+differential_hash_permutation(const DifferentialInput &input,
+                              float *out) {
+  differential_hash<N, HashPermutation>(input, out);
+}
+
+template <unsigned int N>
+static void
+differential_hash_mix_seeded(const DifferentialInput &input,
+                             float *out) {
+  differential_hash_seeded<N, HashMix>(input, out);
+}
+
+template <unsigned int N>
+static void
+differential_hash_xorshift_seeded(const DifferentialInput &input,
+                                  float *out) {
+  differential_hash_seeded<N, HashXorshift>(input, out);
+}
+
+template <unsigned int N>
+static void
+differential_hash_permutation_seeded(const DifferentialInput &input,
+                                     float *out) {
+  differential_hash_seeded<N, HashPermutation>(input, out);
+}
+
+template <unsigned int N>
+static void
+differential_cellular_euclidean(const DifferentialInput &input,
+                                float *out) {
+  differential_cellular<N, CellularDistance::Euclidean>(input, out);
+}
+
+template <unsigned int N>
+static void
+differential_cellular_manhattan(const DifferentialInput &input,
+                                float *out) {
+  differential_cellular<N, CellularDistance::Manhattan>(input, out);
+}
+
+template <unsigned int N>
+static void
+differential_cellular_chebyshev(const DifferentialInput &input,
+                                float *out) {
+  differential_cellular<N, CellularDistance::Chebyshev>(input, out);
+}
+
+template <unsigned int N>
+static void differential_cellular_euclidean_brute_force(
+    const DifferentialInput &input, float *out) {
+  differential_cellular_brute_force<N, CellularDistance::Euclidean>(
+      input, out);
+}
+
+template <unsigned int N>
+static void differential_cellular_manhattan_brute_force(
+    const DifferentialInput &input, float *out) {
+  differential_cellular_brute_force<N, CellularDistance::Manhattan>(
+      input, out);
+}
+
+template <unsigned int N>
+static void differential_cellular_chebyshev_brute_force(
+    const DifferentialInput &input, float *out) {
+  differential_cellular_brute_force<N, CellularDistance::Chebyshev>(
+      input, out);
+}
+
+/* The packed pixels are stored as their bit pattern. A count that is
+ * not a multiple of the width also covers the partial vector at the
+ * end, the remaining outputs stay 0. */
+template <unsigned int N, PixelFormat Format>
+static void differential_pack(const DifferentialInput &input,
+                              float *out) {
+  std::vector<uint16_t> packed(input.count);
+  pack_pixels<N>(input.xs, input.count - 3, Format, -300.0f, 300.0f,
+                 packed.data());
+  const uint8_t *bytes = (const uint8_t *)packed.data();
+  for (size_t i = 0; i < input.count; i++) {
+    int32_t bits =
+        Format == PixelFormat::UNorm8 ? bytes[i] : packed[i];
+    memcpy(out + i, &bits, sizeof(bits));
+  }
+}
+
+template <unsigned int N>
+static void differential_pack_float16(const DifferentialInput &input,
+                                      float *out) {
+  differential_pack<N, PixelFormat::Float16>(input, out);
+}
+
+template <unsigned int N>
+static void
+differential_pack_bfloat16(const DifferentialInput &input,
+                           float *out) {
+  differential_pack<N, PixelFormat::BFloat16>(input, out);
+}
+
+template <unsigned int N>
+static void differential_pack_unorm8(const DifferentialInput &input,
+                                     float *out) {
+  differential_pack<N, PixelFormat::UNorm8>(input, out);
+}
+
+template <unsigned int N>
+static void differential_pack_unorm16(const DifferentialInput &input,
+                                      float *out) {
+  differential_pack<N, PixelFormat::UNorm16BigEndian>(input, out);
+}
+
+/* Every kernel at the widths 1, 4, 8 and 16, which have their own
+ * specializations, and 32, which always uses the generic one. */
+#define DIFFERENTIAL_KERNEL_AGAINST(name, reference, outputs,       \
+                                   max_ulps, function)               \
+  {name, 1, outputs, max_ulps, function<1>, reference},              \
+      {name, 4, outputs, max_ulps, function<4>, reference},          \
+      {name, 8, outputs, max_ulps, function<8>, reference},          \
+      {name, 16, outputs, max_ulps, function<16>, reference},        \
+      {name, 32, outputs, max_ulps, function<32>, reference}
+
+#define DIFFERENTIAL_KERNEL(name, outputs, max_ulps, function)       \
+  DIFFERENTIAL_KERNEL_AGAINST(name, nullptr, outputs, max_ulps,      \
+                              function)
+
+/* Only run as the reference of another kernel. */
+#define DIFFERENTIAL_REFERENCE(name, outputs, function)              \
+  {name, 0, outputs, 0, function<1>, nullptr}
+
+static const DifferentialKernel kernels[] = {
+    DIFFERENTIAL_KERNEL("lanes", 2, 0, differential_lanes),
+    DIFFERENTIAL_KERNEL("floor_as_int32", 1, 0,
+                        differential_floor_as_int32),
+    DIFFERENTIAL_KERNEL("round_as_int32", 1, 0,
+                        differential_round_as_int32),
+    DIFFERENTIAL_KERNEL("hash_mix", 1, 0, differential_hash_mix),
+    DIFFERENTIAL_KERNEL("hash_xorshift", 1, 0,
+                        differential_hash_xorshift),
+    DIFFERENTIAL_KERNEL("hash_permutation", 1, 0,
+                        differential_hash_permutation),
+    DIFFERENTIAL_KERNEL("hash_mix_seeded", 1, 0,
+                        differential_hash_mix_seeded),
+    DIFFERENTIAL_KERNEL("hash_xorshift_seeded", 1, 0,
+                        differential_hash_xorshift_seeded),
+    DIFFERENTIAL_KERNEL("hash_permutation_seeded", 1, 0,
+                        differential_hash_permutation_seeded),
+    DIFFERENTIAL_KERNEL("value_noise_1d", 1, 16,
+                        differential_value_noise_1d),
+    DIFFERENTIAL_KERNEL("value_noise_2d", 1, 48,
+                        differential_value_noise_2d),
+    DIFFERENTIAL_KERNEL("value_noise_3d", 1, 48,
+                        differential_value_noise_3d),
+    DIFFERENTIAL_KERNEL("value_noise_4d", 1, 48,
+                        differential_value_noise_4d),
+    DIFFERENTIAL_KERNEL("gradient_noise", 1, 48,
+                        differential_gradient_noise),
+    DIFFERENTIAL_KERNEL("simplex_3d", 1, 8, differential_simplex_3d),
+    DIFFERENTIAL_KERNEL("simplex_4d", 1, 8, differential_simplex_4d),
+    DIFFERENTIAL_KERNEL("derivatives", 4, 96,
+                        differential_derivatives),
+    DIFFERENTIAL_KERNEL_AGAINST(
+        "cellular_euclidean", "cellular_euclidean_brute_force", 3, 8,
+        differential_cellular_euclidean),
+    DIFFERENTIAL_KERNEL_AGAINST(
+        "cellular_manhattan", "cellular_manhattan_brute_force", 3, 8,
+        differential_cellular_manhattan),
+    DIFFERENTIAL_KERNEL_AGAINST(
+        "cellular_chebyshev", "cellular_chebyshev_brute_force", 3, 8,
+        differential_cellular_chebyshev),
+    DIFFERENTIAL_REFERENCE(
+        "cellular_euclidean_brute_force", 3,
+        differential_cellular_euclidean_brute_force),
+    DIFFERENTIAL_REFERENCE(
+        "cellular_manhattan_brute_force", 3,
+        differential_cellular_manhattan_brute_force),
+    DIFFERENTIAL_REFERENCE(
+        "cellular_chebyshev_brute_force", 3,
+        differential_cellular_chebyshev_brute_force),
+    DIFFERENTIAL_KERNEL("fbm_5", 1, 64, differential_fbm_5),
+    DIFFERENTIAL_KERNEL("fbm_5_seeded", 1, 64,
+                        differential_fbm_5_seeded),
+    DIFFERENTIAL_KERNEL("fbm_runtime", 1, 64,
+                        differential_fbm_runtime),
+    DIFFERENTIAL_KERNEL("fbm_lattice", 1, 64,
+                        differential_fbm_lattice),
+    DIFFERENTIAL_KERNEL_AGAINST("batch_split",
+                                "batch_split_reference",
+                                1, 64, differential_batch_split),
+    DIFFERENTIAL_REFERENCE("batch_split_reference", 1,
+                           differential_batch_split_reference),
+    DIFFERENTIAL_KERNEL_AGAINST("perlin_row_2d", "zero", 1, 0,
+                                differential_perlin_row_2d),
+    DIFFERENTIAL_KERNEL_AGAINST("perlin_row_3d", "zero", 1, 0,
+                                differential_perlin_row_3d),
+    DIFFERENTIAL_REFERENCE("zero", 1, differential_zero),
+    DIFFERENTIAL_KERNEL_AGAINST("noise_graph", "noise_graph_staged",
+                                1, 256, differential_noise_graph),
+    DIFFERENTIAL_REFERENCE("noise_graph_staged", 1,
+                           differential_noise_graph_staged),
+    DIFFERENTIAL_KERNEL_AGAINST("noise_graph_tile",
+                                "noise_graph_tile_reference", 1, 256,
+                                differential_noise_graph_tile),
+    DIFFERENTIAL_REFERENCE("noise_graph_tile_reference", 1,
+                           differential_noise_graph_tile_reference),
+    DIFFERENTIAL_KERNEL("lattice_fixed", 2, 0,
+                        differential_lattice_fixed),
+    DIFFERENTIAL_KERNEL("pack_float16", 1, 0,
+                        differential_pack_float16),
+    DIFFERENTIAL_KERNEL("pack_bfloat16", 1, 0,
+                        differential_pack_bfloat16),
+    DIFFERENTIAL_KERNEL("pack_unorm8", 1, 0,
+                        differential_pack_unorm8),
+    DIFFERENTIAL_KERNEL("pack_unorm16", 1, 0,
+                        differential_pack_unorm16),
+};
+
+#undef DIFFERENTIAL_KERNEL
+
+extern const DifferentialKernelList differential_kernels = {
+    kernels, sizeof(kernels) / sizeof(*kernels)};
+
+SIMD_NAMESPACE_END
@@ -0,0 +1,298 @@
+/* Differential test of the vector types and noise kernels. Every
+ * kernel in differential_kernels_impl.cpp is run for every tier that
+ * this machine supports and for every vector width, and is compared
+ * against the width 1 version of the scalar tier, or against the
+ * scalar kernel named by its reference. The inputs cover
+ * random positions, negative values, exact integers and their
+ * neighbours, values close to zero, and huge coordinates where the
+ * lattice indices no longer fit into an int32.
+ *
+ * Floating point results may differ slightly, because the FMA tiers
+ * fuse multiplies and adds while the scalar code rounds twice. The
+ * difference is measured in units in the last place of
+ * max(|reference|, 1), since the noise values lie around [-1, 1] and
+ * the precision near zero is not meaningful for them. Integer results
+ * have to be bit-identical.
+ *
+ * It also prints the time per sample of every kernel, so that an
+ * optimization of simd_core.hpp can be checked for correctness and
+ * speed with a single run.
+ *
+ * Usage: simd_differential_test [--samples <count>]
+ *            [--seed <seed>] [--tier <name>] [--filter <name part>]
+ */
+
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "differential_kernels.hpp"
+#include "noise_kernels.hpp"
+#include "simd_tiers.hpp"
+
+SIMD_DECLARE_PER_TIER(DifferentialKernelList, differential_kernels)
+
+static const DifferentialKernelList *
+differential_kernels_for_tier(SimdTier tier) {
+  SIMD_SELECT_PER_TIER(tier, differential_kernels);
+}
+
+struct DifferentialSettings {
+  size_t samples = 1 << 20;
+  unsigned int seed = 1;
+  std::string tier;
+  std::string filter;
+};
+
+/* Largest width in differential_kernels_impl.cpp. */
+static const size_t max_width = 32;
+
+struct DifferentialData {
+  std::vector<float> xs, ys, zs, ws;
+  std::vector<int32_t> x_ids, y_ids, z_ids;
+
+  DifferentialData(size_t count, unsigned int seed) {
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> uniform(-300.0f, 300.0f);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::uniform_int_distribution<int> integer(-1000, 1000);
+    std::uniform_int_distribution<int> exponent(20, 40);
+    std::uniform_int_distribution<int> kind(0, 7);
+    auto coordinate = [&]() {
+      switch (kind(random)) {
+      case 4:
+        return (float)integer(random);
+      case 5: {
+        /* The neighbours of an integer. */
+        float value = (float)integer(random);
+        float direction = unit(random) < 0.5f ? -INFINITY : INFINITY;
+        return std::nextafter(value, direction);
+      }
+      case 6: {
+        /* 2^20 to 2^41, including values beyond the int32 range. */
+        float sign = unit(random) < 0.5f ? -1.0f : 1.0f;
+        float mantissa = 1.0f + unit(random);
+        return sign * std::ldexp(mantissa, exponent(random));
+      }
+      case 7:
+        return unit(random) < 0.1f ? -0.0f
+                                   : (unit(random) - 0.5f) * 1e-3f;
+      default:
+        return uniform(random);
+      }
+    };
+    std::uniform_int_distribution<int32_t> any_id(INT32_MIN,
+                                                  INT32_MAX);
+    auto id = [&]() {
+      return unit(random) < 0.5f ? integer(random) : any_id(random);
+    };
+
+    count = (count + max_width - 1) / max_width * max_width;
+    for (size_t i = 0; i < count; i++) {
+      xs.push_back(coordinate());
+      ys.push_back(coordinate());
+      zs.push_back(coordinate());
+      ws.push_back(coordinate());
+      x_ids.push_back(id());
+      y_ids.push_back(id());
+      z_ids.push_back(id());
+    }
+  }
+
+  DifferentialInput input() const {
+    DifferentialInput input;
+    input.xs = xs.data();
+    input.ys = ys.data();
+    input.zs = zs.data();
+    input.ws = ws.data();
+    input.x_ids = x_ids.data();
+    input.y_ids = y_ids.data();
+    input.z_ids = z_ids.data();
+    input.count = xs.size();
+    return input;
+  }
+};
+
+/* Distance in units in the last place of max(|reference|, 1). NaN
+ * only matches NaN and infinities only match themselves. */
+static double ulp_error(float value, float reference) {
+  if (std::isnan(value) || std::isnan(reference)) {
+    return std::isnan(value) && std::isnan(reference) ? 0.0
+                                                      : INFINITY;
+  }
+  if (value == reference) {
+    return 0.0;
+  }
+  if (std::isinf(value) || std::isinf(reference)) {
+    return INFINITY;
+  }
+  float magnitude = std::max(std::fabs(reference), 1.0f);
+  double ulp = std::ldexp(1.0, std::ilogb(magnitude) - 23);
+  return std::fabs((double)value - (double)reference) / ulp;
+}
+
+static const DifferentialKernel *
+find_reference(const DifferentialKernel &kernel) {
+  const DifferentialKernelList &list =
+      *differential_kernels_for_tier(SimdTier::Scalar);
+  for (size_t i = 0; i < list.count; i++) {
+    const DifferentialKernel &candidate = list.kernels[i];
+    if (kernel.reference != nullptr) {
+      if (strcmp(candidate.name, kernel.reference) == 0) {
+        return &candidate;
+      }
+    } else if (candidate.width == 1 &&
+               strcmp(candidate.name, kernel.name) == 0) {
+      return &candidate;
+    }
+  }
+  return nullptr;
+}
+
+/* Compare one kernel against the reference output and print the
+ * result. Returns whether it is within the tolerance. */
+static bool check_kernel(SimdTier tier,
+                         const DifferentialKernel &kernel,
+                         const DifferentialData &data,
+                         const std::vector<float> &reference,
+                         std::vector<float> &out) {
+  using Clock = std::chrono::steady_clock;
+  DifferentialInput input = data.input();
+  Clock::time_point start = Clock::now();
+  kernel.run(input, out.data());
+  Clock::time_point end = Clock::now();
+  double ns = std::chrono::duration<double, std::nano>(end - start)
+                  .count();
+
+  size_t mismatches = 0;
+  size_t first_mismatch = 0;
+  double max_error = 0.0;
+  for (size_t i = 0; i < reference.size(); i++) {
+    double error;
+    if (kernel.max_ulps == 0) {
+      error = memcmp(&out[i], &reference[i], sizeof(float)) ? INFINITY
+                                                              : 0.0;
+    } else {
+      error = ulp_error(out[i], reference[i]);
+    }
+    max_error = std::max(max_error, error);
+    if (error > kernel.max_ulps) {
+      if (mismatches == 0) {
+        first_mismatch = i;
+      }
+      mismatches++;
+    }
+  }
+
+  char line[256];
+  snprintf(line, sizeof(line),
+           "%-7s %-19s %2u  max %8.2f ulp  %7.2f ns/sample  %s\n",
+           simd_tier_name(tier), kernel.name, kernel.width, max_error,
+           ns / input.count, mismatches == 0 ? "ok" : "FAILED");
+  std::cout << line;
+  if (mismatches > 0) {
+    size_t sample = first_mismatch % input.count;
+    snprintf(line, sizeof(line),
+             "  %zu mismatches, first at sample %zu output %zu: "
+             "(%.9g, %.9g, %.9g, %.9g) ids (%d, %d, %d) "
+             "gave %.9g instead of %.9g\n",
+             mismatches, sample, first_mismatch / input.count,
+             input.xs[sample], input.ys[sample], input.zs[sample],
+             input.ws[sample], input.x_ids[sample],
+             input.y_ids[sample], input.z_ids[sample],
+             out[first_mismatch], reference[first_mismatch]);
+    std::cout << line;
+  }
+  return mismatches == 0;
+}
+
+static bool parse_arguments(int argc, char const *argv[],
+                            DifferentialSettings &settings) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << arg << "\n";
+      return false;
+    }
+    const char *value = argv[++i];
+    if (arg == "--samples") {
+      settings.samples = std::max(1, atoi(value));
+    } else if (arg == "--seed") {
+      settings.seed = (unsigned int)atoi(value);
+    } else if (arg == "--tier") {
+      settings.tier = value;
+    } else if (arg == "--filter") {
+      settings.filter = value;
+    } else {
+      std::cerr << "Unknown argument " << arg << "\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char const *argv[]) {
+  DifferentialSettings settings;
+  if (!parse_arguments(argc, argv, settings)) {
+    return 2;
+  }
+
+  DifferentialData data(settings.samples, settings.seed);
+  SimdTier max_tier = detect_simd_tier();
+  std::vector<float> reference, out;
+  const DifferentialKernel *reference_kernel = nullptr;
+  size_t failures = 0;
+  size_t checks = 0;
+
+  const DifferentialKernelList &scalar_kernels =
+      *differential_kernels_for_tier(SimdTier::Scalar);
+  for (size_t k = 0; k < scalar_kernels.count; k++) {
+    /* The kernels are grouped by name, one entry per width. */
+    const char *name = scalar_kernels.kernels[k].name;
+    if (scalar_kernels.kernels[k].width != 1 ||
+        (!settings.filter.empty() &&
+         strstr(name, settings.filter.c_str()) == nullptr)) {
+      continue;
+    }
+    reference_kernel = find_reference(scalar_kernels.kernels[k]);
+    size_t size = data.xs.size() * reference_kernel->outputs;
+    reference.assign(size, 0.0f);
+    out.assign(size, 0.0f);
+    reference_kernel->run(data.input(), reference.data());
+
+    for (int tier_index = 0; tier_index <= (int)max_tier;
+         tier_index++) {
+      SimdTier tier = (SimdTier)tier_index;
+      const DifferentialKernelList *kernels =
+          differential_kernels_for_tier(tier);
+      bool skipped = !settings.tier.empty() &&
+                     settings.tier != simd_tier_name(tier);
+      if (kernels == nullptr || skipped) {
+        continue;
+      }
+      for (size_t i = 0; i < kernels->count; i++) {
+        const DifferentialKernel &kernel = kernels->kernels[i];
+        if (strcmp(kernel.name, name) != 0) {
+          continue;
+        }
+        checks++;
+        if (!check_kernel(tier, kernel, data, reference, out)) {
+          failures++;
+        }
+      }
+    }
+  }
+
+  std::cout << checks - failures << " of " << checks
+            << " checks passed with " << data.xs.size()
+            << " samples\n";
+  return failures == 0 && checks > 0 ? 0 : 1;
+}
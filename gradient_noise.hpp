@@ -0,0 +1,72 @@
+#pragma once
+
+#include "noise_common.hpp"
+
+SIMD_NAMESPACE_BEGIN
+
+/* Evaluate gradient (Perlin) noise at N separate positions. Unlike
+ * eval_noise, every lattice point holds a gradient instead of a
+ * value, and the corners contribute the dot product of that gradient
+ * with the offset to the position. The result is zero at all lattice
+ * points and lies within about [-1, 1]. `Hash` is one of the hash
+ * policies from noise_common.hpp, `seed` is passed on to it. */
+template <typename Hash = HashMix, unsigned int N>
+static float_v<N> eval_gradient_noise(float_v<N> x, float_v<N> y,
+                                      float_v<N> z,
+                                      int32_v<N> seed = 0) {
+  /* Compute grid cell boundaries for every point. */
+  float_v<N> x_low = x.floor();
+  float_v<N> y_low = y.floor();
+  float_v<N> z_low = z.floor();
+
+  /* Offsets to the low and high corners of the cell. */
+  float_v<N> x0 = x - x_low;
+  float_v<N> y0 = y - y_low;
+  float_v<N> z0 = z - z_low;
+  float_v<N> x1 = x0 - 1.0f;
+  float_v<N> y1 = y0 - 1.0f;
+  float_v<N> z1 = z0 - 1.0f;
+
+  /* Compute interpolation factors in cell. */
+  float_v<N> x_fac = fade(x0);
+  float_v<N> y_fac = fade(y0);
+  float_v<N> z_fac = fade(z0);
+
+  int32_v<N> x_low_id = x_low.as_int32();
+  int32_v<N> y_low_id = y_low.as_int32();
+  int32_v<N> z_low_id = z_low.as_int32();
+  int32_v<N> x_high_id = x_low_id + int32_v<N>(1);
+  int32_v<N> y_high_id = y_low_id + int32_v<N>(1);
+  int32_v<N> z_high_id = z_low_id + int32_v<N>(1);
+
+  auto corner = [seed](int32_v<N> x_id, int32_v<N> y_id,
+                       int32_v<N> z_id, float_v<N> x, float_v<N> y,
+                       float_v<N> z) {
+    const int32_v<N> ids[3] = {x_id, y_id, z_id};
+    return gradient_dot(hash_position_bits<Hash>(ids, seed), x, y, z);
+  };
+  float_v<N> corner_lll =
+      corner(x_low_id, y_low_id, z_low_id, x0, y0, z0);
+  float_v<N> corner_llh =
+      corner(x_low_id, y_low_id, z_high_id, x0, y0, z1);
+  float_v<N> corner_lhl =
+      corner(x_low_id, y_high_id, z_low_id, x0, y1, z0);
+  float_v<N> corner_lhh =
+      corner(x_low_id, y_high_id, z_high_id, x0, y1, z1);
+  float_v<N> corner_hll =
+      corner(x_high_id, y_low_id, z_low_id, x1, y0, z0);
+  float_v<N> corner_hlh =
+      corner(x_high_id, y_low_id, z_high_id, x1, y0, z1);
+  float_v<N> corner_hhl =
+      corner(x_high_id, y_high_id, z_low_id, x1, y1, z0);
+  float_v<N> corner_hhh =
+      corner(x_high_id, y_high_id, z_high_id, x1, y1, z1);
+
+  /* Interpolate corner values for position in cell. */
+  return interpolate_trilinear(x_fac, y_fac, z_fac, corner_lll,
+                               corner_llh, corner_lhl, corner_lhh,
+                               corner_hll, corner_hlh, corner_hhl,
+                               corner_hhh);
+}
+
+SIMD_NAMESPACE_END
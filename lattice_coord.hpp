@@ -0,0 +1,234 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "noise_kernels.hpp"
+#include "perlin_noise.hpp"
+
+SIMD_NAMESPACE_BEGIN
+
+/* A coordinate split into its lattice cell and the position within
+ * that cell. A float coordinate loses one bit of the fraction for
+ * every doubling of the distance to the origin: at 2^20 only 4 bits
+ * are left, at 2^24 none, and beyond 2^31 the cell no longer fits
+ * into as_int32. In the split form the fraction keeps its precision
+ * at any distance. Cells wrap around at 2^32, which the lattice hash
+ * handles like any other cell. */
+template <unsigned int N> struct LatticeCoord {
+  int32_v<N> cell;
+  /* In [0, 1). */
+  float_v<N> fraction;
+};
+
+/* Move a fraction of 1, which is what rounding a fraction just below
+ * 1 to float can give, into the cell. */
+template <unsigned int N>
+static LatticeCoord<N> lattice_coord__carry(int32_v<N> cell,
+                                            float_v<N> fraction) {
+  mask_v<N> carry = fraction >= 1.0f;
+  LatticeCoord<N> result;
+  result.cell = cell + select(carry, int32_v<N>(1), int32_v<N>(0));
+  result.fraction = select(carry, float_v<N>(0.0f), fraction);
+  return result;
+}
+
+/* Split a float coordinate, like eval_noise does. */
+template <unsigned int N>
+static LatticeCoord<N> lattice_coord(float_v<N> x) {
+  float_v<N> low = x.floor();
+  LatticeCoord<N> result;
+  result.cell = low.as_int32();
+  result.fraction = x - low;
+  return result;
+}
+
+/* cell + fraction, where the fraction can lie outside of [0, 1),
+ * e.g. for an offset within a chunk. Its integer part is moved into
+ * the cell. */
+template <unsigned int N>
+static LatticeCoord<N> lattice_coord(int32_v<N> cell,
+                                     float_v<N> fraction) {
+  float_v<N> whole = fraction.floor();
+  return lattice_coord__carry(cell + whole.as_int32(),
+                              fraction - whole);
+}
+
+/* 32.32 fixed point: the cell and the lower 32 bits of the fraction.
+ * The fraction is truncated to 24 bits, which makes it exact as a
+ * float. */
+template <unsigned int N>
+static LatticeCoord<N> lattice_coord_fixed(int32_v<N> cell,
+                                           int32_v<N> fraction_bits) {
+  LatticeCoord<N> result;
+  result.cell = cell;
+  result.fraction =
+      fraction_bits.template shift_right<8>().as_float() *
+      (1.0f / (1 << 24));
+  return result;
+}
+
+/* Fixed point with `FractionBits` fraction bits in one int32, e.g.
+ * 16.16. The split is a shift and a mask. */
+template <unsigned int FractionBits, unsigned int N>
+static LatticeCoord<N> lattice_coord_fixed(int32_v<N> value) {
+  static_assert(FractionBits >= 1 && FractionBits <= 24,
+                "1 to 24 fraction bits");
+  const int32_v<N> mask = int32_v<N>((1 << FractionBits) - 1);
+  LatticeCoord<N> result;
+  result.cell = value.template shift_right_arithmetic<FractionBits>();
+  result.fraction =
+      (value & mask).as_float() * (1.0f / (1 << FractionBits));
+  return result;
+}
+
+/* The same position at twice the frequency. Doubling the fraction
+ * and removing its integer part are exact in float, so the result is
+ * the same as doubling the unsplit coordinate. */
+template <unsigned int N>
+static LatticeCoord<N> lattice_coord_double(LatticeCoord<N> x) {
+  float_v<N> fraction = x.fraction * 2.0f;
+  float_v<N> whole = fraction.floor();
+  LatticeCoord<N> result;
+  result.cell = x.cell.template shift_left<1>() + whole.as_int32();
+  result.fraction = fraction - whole;
+  return result;
+}
+
+/* eval_noise for split coordinates. For coordinates that a float
+ * holds exactly, the result is bit-identical to eval_noise. */
+template <typename Hash = HashMix, unsigned int N, unsigned int Dims>
+static float_v<N> eval_noise(const LatticeCoord<N> (&position)[Dims],
+                             int32_v<N> seed = 0) {
+  float_v<N> factors[Dims];
+  int32_v<N> low_ids[Dims];
+  int32_v<N> high_ids[Dims];
+  for (unsigned int d = 0; d < Dims; d++) {
+    factors[d] = fade(position[d].fraction);
+    low_ids[d] = position[d].cell;
+    high_ids[d] = position[d].cell + int32_v<N>(1);
+  }
+  return eval_noise__cell<Hash>(low_ids, high_ids, factors, seed);
+}
+
+/* perlin_noise__octaves for split coordinates. The lacunarity is
+ * always 2, so the next octave follows from lattice_coord_double
+ * without a multiplication of the cell. For coordinates that a float
+ * holds exactly, the result is bit-identical to
+ * perlin_noise__octaves, and for integral octave counts to fbm. */
+template <unsigned int N, unsigned int Dims>
+static float_v<N> fbm_lattice(const LatticeCoord<N> (&position)[Dims],
+                              float octaves, int32_v<N> seed = 0) {
+  LatticeCoord<N> octave_position[Dims];
+  std::copy(position, position + Dims, octave_position);
+
+  float_v<N> result = 0.0f;
+  float amplitude = 1.0f;
+  while (octaves > 0.0f) {
+    float weight = amplitude * std::min(octaves, 1.0f);
+    float_v<N> values = eval_noise(octave_position, seed);
+    result = result + values * weight;
+
+    for (unsigned int d = 0; d < Dims; d++) {
+      octave_position[d] = lattice_coord_double(octave_position[d]);
+    }
+    amplitude *= FbmParams::gain;
+    octaves -= 1.0f;
+  }
+  return result;
+}
+
+/* Split a double, which holds the fraction to about 2^-20 even at
+ * a distance of 2^32. The split is done in double, because the
+ * vector types have no doubles; |x| has to be below 2^63. */
+static inline void lattice_coord_split_double(double x,
+                                              int32_t *r_cell,
+                                              float *r_fraction) {
+  double low = std::floor(x);
+  *r_cell = (int32_t)(uint32_t)(uint64_t)(int64_t)low;
+  *r_fraction = (float)(x - low);
+}
+
+/* Apply fbm_lattice to `count` positions that are filled in by
+ * `load(i, lanes, position)`, each with its own seed from `seeds`
+ * (seed 0 when null). Only the first `lanes` lanes of the last vector
+ * are used. */
+template <unsigned int N, typename Load>
+static void fbm_lattice_batch__apply(const int32_t *seeds, float *out,
+                                     size_t count, float octaves,
+                                     Load load) {
+  size_t i = 0;
+  for (; i + N <= count; i += N) {
+    LatticeCoord<N> position[3];
+    load(i, N, position);
+    int32_v<N> seed =
+        seeds ? int32_v<N>::loadu(seeds + i) : int32_v<N>(0);
+    fbm_lattice(position, octaves, seed).storeu(out + i);
+  }
+
+  unsigned int remaining = (unsigned int)(count - i);
+  if (remaining > 0) {
+    LatticeCoord<N> position[3];
+    load(i, remaining, position);
+    int32_v<N> seed =
+        seeds ? int32_v<N>::load_partial(seeds + i, remaining)
+              : int32_v<N>(0);
+    fbm_lattice(position, octaves, seed)
+        .store_partial(out + i, remaining);
+  }
+}
+
+/* See NoiseKernels::perlin_noise_batch_split. */
+template <unsigned int N = SIMD_NATIVE_WIDTH>
+static void perlin_noise_batch_split(const SplitPositions &positions,
+                                     const int32_t *seeds, float *out,
+                                     size_t count, float octaves) {
+  fbm_lattice_batch__apply<N>(
+      seeds, out, count, octaves,
+      [&positions](size_t i, unsigned int lanes,
+                   LatticeCoord<N>(&position)[3]) {
+        for (unsigned int d = 0; d < 3; d++) {
+          const int32_t *cells = positions.cells[d] + i;
+          const float *fractions = positions.fractions[d] + i;
+          if (lanes == N) {
+            position[d] = lattice_coord(int32_v<N>::loadu(cells),
+                                        float_v<N>::loadu(fractions));
+          } else {
+            position[d] = lattice_coord(
+                int32_v<N>::load_partial(cells, lanes),
+                float_v<N>::load_partial(fractions, lanes));
+          }
+        }
+      });
+}
+
+/* See NoiseKernels::perlin_noise_batch_double. */
+template <unsigned int N = SIMD_NATIVE_WIDTH>
+static void perlin_noise_batch_double(const double *xs,
+                                      const double *ys,
+                                      const double *zs,
+                                      const int32_t *seeds,
+                                      float *out, size_t count,
+                                      float octaves) {
+  const double *coordinates[3] = {xs, ys, zs};
+  fbm_lattice_batch__apply<N>(
+      seeds, out, count, octaves,
+      [&coordinates](size_t i, unsigned int lanes,
+                     LatticeCoord<N>(&position)[3]) {
+        for (unsigned int d = 0; d < 3; d++) {
+          int32_t cells[N] = {};
+          float fractions[N] = {};
+          for (unsigned int lane = 0; lane < lanes; lane++) {
+            lattice_coord_split_double(coordinates[d][i + lane],
+                                       &cells[lane],
+                                       &fractions[lane]);
+          }
+          position[d] = lattice_coord__carry(
+              int32_v<N>::loadu(cells), float_v<N>::loadu(fractions));
+        }
+      });
+}
+
+SIMD_NAMESPACE_END
@@ -1,72 +1,178 @@
-#include <smmintrin.h>
+#include <fcntl.h>
 #include <stdio.h>
-#include <xmmintrin.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
-#include <sstream>
 #include <string>
 #include <vector>
 
-#include "perlin_noise.hpp"
+#include "chunk_service.hpp"
+#include "noise_kernels.hpp"
+#include "noise_pyramid.hpp"
+#include "noise_texture.hpp"
+#include "texture_io.hpp"
+#include "tile_cache.hpp"
 #include "timeit.hpp"
 
 #define PRINT_EXPR(expression)                                       \
   std::cout << #expression << "\t " << (expression) << "\n"
 
 std::vector<float> noise_texture(unsigned int width,
-                                 unsigned int height, float scale) {
-  std::vector<float> pixels;
-  pixels.reserve(width * height);
+                                 unsigned int height, float scale,
+                                 unsigned int thread_count) {
+  std::vector<float> pixels(width * height);
+  ThreadPool pool(thread_count);
   {
-    SCOPED_TIMER("generate texture");
-    for (unsigned int y = 0; y < height; y++) {
-      for (unsigned int x = 0; x < width; x++) {
-        float value = perlin_noise(x * scale, y * scale, 0.0f, 5);
-        pixels.push_back(value);
-      }
-    }
+    PROFILE_ZONE("generate texture");
+    noise_texture_tiled(pixels.data(), width, height, scale, 5, pool);
   }
   return pixels;
 }
 
-std::string texture_as_json(std::vector<float> pixels,
-                            unsigned int width, unsigned int height) {
-  assert(pixels.size() == width * height);
-  std::stringstream ss;
-  ss << "{\"width\":" << width << ", \"height\":" << height
-     << ", \"pixels\":[";
-  for (unsigned int i = 0; i < pixels.size(); i++) {
-    ss << pixels[i];
-    if (i < pixels.size() - 1) {
-      ss << ",";
-    }
+/* Write the texture file `path` with `write`, which gets the file
+ * descriptor and returns whether it succeeded. Failures are reported
+ * on stderr. */
+template <typename Write>
+static bool write_texture_file(const char *path, Write write) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    std::cerr << "Cannot open " << path << ": " << strerror(errno)
+              << "\n";
+    return false;
+  }
+  bool written = write(fd);
+  int write_errno = errno;
+  if (close(fd) != 0 && written) {
+    written = false;
+    write_errno = errno;
   }
-  ss << "]}\n";
-  return ss.str();
+  if (!written) {
+    std::cerr << "Cannot write " << path << ": "
+              << strerror(write_errno) << "\n";
+  }
+  return written;
 }
 
 int main(int argc, char const *argv[]) {
-  float_v<4> a{3, 4, 5, 2};
-  float_v<4> b{7.4f, 8.0f, 2.23f, 3.5f};
-  float_v<8> c{a, b};
-  int32_v<4> d{5, 6, 7, 8};
+  std::cout << "Using " << noise_kernels().name << " kernels\n";
+
+  /* The number of threads can be passed as first argument. By
+   * default all hardware threads are used. */
+  unsigned int thread_count = argc > 1 ? atoi(argv[1]) : 0;
+
+#ifdef SIMD_PROFILE
+  /* Hardware counters cost a system call per zone boundary, so they
+   * are only read on request. */
+  if (getenv("SIMD_PROFILE_COUNTERS") != nullptr &&
+      !profile_enable_counters()) {
+    std::cout << "Hardware counters are not available\n";
+  }
+#endif
 
   unsigned int width = 1000;
   unsigned int height = 1000;
-  auto pixels = noise_texture(width, height, 0.01f);
-  auto texture_json = texture_as_json(pixels, width, height);
+  auto pixels = noise_texture(width, height, 0.01f, thread_count);
+  int status = 0;
+
+  {
+    PROFILE_ZONE("write pfm");
+    if (!write_texture_file("test.pfm", [&](int fd) {
+          TextureWriter writer(fd, TextureFormat::PFM, width, height);
+          return writer.write_rows(0, height, pixels.data());
+        })) {
+      status = 1;
+    }
+  }
+
+  {
+    /* Generated straight into half precision, without a float copy
+     * of the image. */
+    PROFILE_ZONE("stream float16");
+    ThreadPool pool(thread_count);
+    if (!write_texture_file("test_f16.ntex", [&](int fd) {
+          TextureWriter writer(fd, TextureFormat::RawFloat16, width,
+                               height);
+          return noise_texture_stream(writer, width, height, 0.01f, 5,
+                                      pool);
+        })) {
+      status = 1;
+    }
+  }
 
-  std::ofstream myfile{"test.json"};
-  myfile << texture_json;
-  myfile.close();
+  {
+    PROFILE_ZONE("write json");
+    std::ofstream myfile{"test.json"};
+    write_texture_json(myfile, pixels.data(), width, height);
+  }
+
+  {
+    ThreadPool pool(thread_count);
+    NoisePyramid pyramid;
+    {
+      PROFILE_ZONE("generate pyramid");
+      pyramid = noise_pyramid(width, height, 0.01f, 5, pool);
+    }
+    for (size_t i = 0; i < pyramid.levels.size(); i++) {
+      const NoisePyramidLevel &level = pyramid.levels[i];
+      std::cout << "Level " << i << ": " << level.width << "x"
+                << level.height << ", " << level.octaves
+                << " octaves\n";
+    }
+  }
+
+  {
+    /* Stream the chunks around the origin twice, the second pass is
+     * served from the cache. */
+    TileCacheSettings disk_settings;
+    disk_settings.max_bytes = 16 << 20;
+    TileCache disk_cache("noise_tiles.cache", disk_settings);
+    ChunkServiceSettings settings;
+    settings.thread_count = thread_count;
+    settings.disk_cache = &disk_cache;
+    ChunkService service(settings);
+    for (int pass = 0; pass < 2; pass++) {
+      PROFILE_ZONE("stream chunks");
+      std::vector<std::future<ChunkHandle>> chunks;
+      for (int y = -4; y < 4; y++) {
+        for (int x = -4; x < 4; x++) {
+          chunks.push_back(service.request(x, y, 0));
+        }
+      }
+      for (auto &chunk : chunks) {
+        chunk.wait();
+      }
+    }
+    ChunkServiceStats stats = service.stats();
+    std::cout << "Chunks: " << stats.hits << " hits, " << stats.misses
+              << " misses, " << stats.cached_chunks << "/"
+              << stats.capacity_chunks << " cached\n";
+    /* Hits of a later run are read from the cache file. */
+    TileCacheStats disk_stats = disk_cache.stats();
+    std::cout << "Tile cache: " << disk_stats.hits << " hits, "
+              << disk_stats.misses << " misses, "
+              << disk_stats.cached_tiles << "/"
+              << disk_stats.capacity_tiles << " cached\n";
+  }
+
+#ifdef SIMD_PROFILE
+  profile_write_summary(std::cout);
+  {
+    std::ofstream trace{"profile.json"};
+    profile_write_chrome_trace(trace);
+  }
+#endif
 
   float step = 0.1f;
   for (float y = 0.0f; y <= 3.0f; y += step) {
     for (float x = 0.0f; x <= 1.0f; x += step) {
-      float result = eval_noise<4>(x, y, 0.0f).get<0>();
+      float result = noise_kernels().perlin_noise(x, y, 0.0f, 1);
       std::cout << std::fixed << std::setw(8) << std::setprecision(3)
                 << result << " ";
     }
@@ -74,5 +180,5 @@ int main(int argc, char const *argv[]) {
   }
 
   std::getchar();
-  return 0;
+  return status;
 }
@@ -2,18 +2,16 @@
 
 #include "simd_core.hpp"
 
-template <unsigned int N>
-static float_v<N> hash_position(int32_v<N> x, int32_v<N> y,
-                                int32_v<N> z) {
+SIMD_NAMESPACE_BEGIN
+
 #define xor_rot(a, b, k)                                             \
   a = a ^ b;                                                         \
-  a = a - b.rotate<k>();
-
-  int32_v<N> magic = int32_v<N>(0xdeadbeef);
-  int32_v<N> a = x * magic;
-  int32_v<N> b = y * magic;
-  int32_v<N> c = z * magic;
+  a = a - b.template rotate<k>();
 
+/* Mix the three multiplied lattice coordinates into one hash. */
+template <unsigned int N>
+static int32_v<N> hash_position__mix(int32_v<N> a, int32_v<N> b,
+                                     int32_v<N> c) {
   xor_rot(c, b, 14);
   xor_rot(a, c, 11);
   xor_rot(b, a, 25);
@@ -21,21 +19,251 @@ static float_v<N> hash_position(int32_v<N> x, int32_v<N> y,
   xor_rot(a, c, 4);
   xor_rot(b, a, 14);
   xor_rot(c, b, 24);
+  return c;
+}
+
+#undef xor_rot
+
+/* Hash policies for hash_position_bits. Each one maps the Dims
+ * coordinates of a lattice point and a seed to 32 hash bits. Missing
+ * coordinates count as zero, so lower dimensional noise is a slice
+ * of the higher dimensional one and shares its hash values. The
+ * gradient kernels select their gradients from the low bits. Every
+ * lane has its own seed, and seed 0 gives the unseeded hash. */
 
-  float_v<N> result = c.as_float();
+/* The default: all coordinates are multiplied and then mixed by 7
+ * xor/rotate/subtract rounds. Costs 3 multiplications (4 in 4D) and
+ * has no visible patterns. The fourth coordinate is folded into the
+ * third before mixing. The seed is xored into the first coordinate
+ * after the multiplication. Unlike an added offset, this is not a
+ * translation of the lattice, so seeds give unrelated fields. */
+struct HashMix {
+  template <unsigned int N, unsigned int Dims>
+  static int32_v<N> bits(const int32_v<N> (&ids)[Dims],
+                         int32_v<N> seed) {
+    /* Clamped so that the unused branches stay in bounds. */
+    const unsigned int y = Dims > 1 ? 1 : 0;
+    const unsigned int z = Dims > 2 ? 2 : 0;
+    const unsigned int w = Dims > 3 ? 3 : 0;
+
+    int32_v<N> magic = int32_v<N>(0xdeadbeef);
+    int32_v<N> a = (ids[0] * magic) ^ seed;
+    int32_v<N> b = Dims > 1 ? ids[y] * magic : int32_v<N>(0);
+    int32_v<N> c = Dims > 2 ? ids[z] * magic : int32_v<N>(0);
+    if (Dims > 3) {
+      c = c ^ (ids[w] * magic).template rotate<16>();
+    }
+    return hash_position__mix(a, b, c);
+  }
+};
+
+/* Cheaper: the coordinates are combined with rotations only and
+ * then go through a xorshift-multiply finalizer (Chris Wellons'
+ * lowbias32), which costs 2 multiplications (3 in 4D). Lattice
+ * points whose coordinates differ by multiples of 2^11 in a
+ * correlated way can share hash values, e.g. (x, y) and
+ * (x ^ 2048, y ^ 1), which is only visible over very large areas.
+ * The seed is multiplied by another constant and xored in like the
+ * fourth coordinate. */
+struct HashXorshift {
+  template <unsigned int N, unsigned int Dims>
+  static int32_v<N> bits(const int32_v<N> (&ids)[Dims],
+                         int32_v<N> seed) {
+    const unsigned int y = Dims > 1 ? 1 : 0;
+    const unsigned int z = Dims > 2 ? 2 : 0;
+    const unsigned int w = Dims > 3 ? 3 : 0;
+
+    int32_v<N> h = ids[0];
+    if (Dims > 1) {
+      h = h ^ ids[y].template rotate<11>();
+    }
+    if (Dims > 2) {
+      h = h ^ ids[z].template rotate<22>();
+    }
+    if (Dims > 3) {
+      h = h ^ ids[w] * int32_v<N>(0x9e3779b9);
+    }
+    h = h ^ seed * int32_v<N>(0x85ebca6b);
+    h = h ^ h.template shift_right<16>();
+    h = h * int32_v<N>(0x7feb352d);
+    h = h ^ h.template shift_right<15>();
+    h = h * int32_v<N>(0x846ca68b);
+    return h ^ h.template shift_right<16>();
+  }
+};
+
+/* Lookup table of HashPermutation. The low 8 bits of every entry
+ * are Ken Perlin's reference permutation, the upper 24 bits are
+ * random. */
+struct HashPermutationTable {
+  int32_t values[256];
+
+  constexpr HashPermutationTable() : values() {
+    const uint8_t permutation[256] = {
+      151, 160, 137, 91, 90, 15, 131, 13, 201, 95, 96, 53, 194, 233,
+      7, 225, 140, 36, 103, 30, 69, 142, 8, 99, 37, 240, 21, 10, 23,
+      190, 6, 148, 247, 120, 234, 75, 0, 26, 197, 62, 94, 252, 219,
+      203, 117, 35, 11, 32, 57, 177, 33, 88, 237, 149, 56, 87, 174,
+      20, 125, 136, 171, 168, 68, 175, 74, 165, 71, 134, 139, 48, 27,
+      166, 77, 146, 158, 231, 83, 111, 229, 122, 60, 211, 133, 230,
+      220, 105, 92, 41, 55, 46, 245, 40, 244, 102, 143, 54, 65, 25,
+      63, 161, 1, 216, 80, 73, 209, 76, 132, 187, 208, 89, 18, 169,
+      200, 196, 135, 130, 116, 188, 159, 86, 164, 100, 109, 198, 173,
+      186, 3, 64, 52, 217, 226, 250, 124, 123, 5, 202, 38, 147, 118,
+      126, 255, 82, 85, 212, 207, 206, 59, 227, 47, 16, 58, 17, 182,
+      189, 28, 42, 223, 183, 170, 213, 119, 248, 152, 2, 44, 154, 163,
+      70, 221, 153, 101, 155, 167, 43, 172, 9, 129, 22, 39, 253, 19,
+      98, 108, 110, 79, 113, 224, 232, 178, 185, 112, 104, 218, 246,
+      97, 228, 251, 34, 242, 193, 238, 210, 144, 12, 191, 179, 162,
+      241, 81, 51, 145, 235, 249, 14, 239, 107, 49, 192, 214, 31, 181,
+      199, 106, 157, 184, 84, 204, 176, 115, 121, 50, 45, 127, 4, 150,
+      254, 138, 236, 205, 93, 222, 114, 67, 29, 24, 72, 243, 141, 128,
+      195, 78, 66, 215, 61, 156, 180,
+    };
+    for (unsigned int i = 0; i < 256; i++) {
+      /* lowbias32 of the index for the upper bits. */
+      uint32_t h = i + 1;
+      h ^= h >> 16;
+      h *= 0x7feb352du;
+      h ^= h >> 15;
+      h *= 0x846ca68bu;
+      h ^= h >> 16;
+      values[i] = (int32_t)((h << 8) | permutation[i]);
+    }
+  }
+};
+
+/* Ken Perlin's permutation table: perm[perm[perm[x] + y] + z], with
+ * one gather per coordinate and no multiplications. The random upper
+ * bits of the table entries let the result be used as a value. The
+ * noise repeats every 256 cells and there are only 256 distinct hash
+ * values. A fourth coordinate offsets the first lookup, so that
+ * w = 0 matches 3D. Missing coordinates still cost their lookup.
+ * The seed is xored into the result of the first lookup, which
+ * gives every seed its own permutation of x. Only its low 8 bits
+ * matter, so there are 256 different fields. */
+struct HashPermutation {
+  static constexpr HashPermutationTable table{};
+
+  template <unsigned int N, unsigned int Dims>
+  static int32_v<N> bits(const int32_v<N> (&ids)[Dims],
+                         int32_v<N> seed) {
+    const unsigned int y = Dims > 1 ? 1 : 0;
+    const unsigned int z = Dims > 2 ? 2 : 0;
+    const unsigned int w = Dims > 3 ? 3 : 0;
+    const int32_v<N> mask = int32_v<N>(255);
+    const int32_t *values = table.values;
+
+    int32_v<N> h = ids[0];
+    if (Dims > 3) {
+      int32_v<N> offset = int32_v<N>::gather(values, ids[w] & mask);
+      h = h + offset - int32_v<N>(values[0]);
+    }
+    h = int32_v<N>::gather(values, h & mask) ^ seed;
+    int32_v<N> y_id = Dims > 1 ? ids[y] : int32_v<N>(0);
+    h = int32_v<N>::gather(values, (h + y_id) & mask);
+    int32_v<N> z_id = Dims > 2 ? ids[z] : int32_v<N>(0);
+    return int32_v<N>::gather(values, (h + z_id) & mask);
+  }
+};
+
+/* Hash bits of a lattice point with Dims coordinates. */
+template <typename Hash = HashMix, unsigned int N, unsigned int Dims>
+static int32_v<N> hash_position_bits(const int32_v<N> (&ids)[Dims],
+                                     int32_v<N> seed = 0) {
+  static_assert(Dims >= 1 && Dims <= 4, "1 to 4 dimensions");
+  return Hash::bits(ids, seed);
+}
+
+template <typename Hash = HashMix, unsigned int N>
+static int32_v<N> hash_position_bits(int32_v<N> x, int32_v<N> y,
+                                     int32_v<N> z) {
+  const int32_v<N> ids[3] = {x, y, z};
+  return hash_position_bits<Hash>(ids);
+}
+
+template <typename Hash = HashMix, unsigned int N>
+static int32_v<N> hash_position_bits(int32_v<N> x, int32_v<N> y,
+                                     int32_v<N> z, int32_v<N> w) {
+  const int32_v<N> ids[4] = {x, y, z, w};
+  return hash_position_bits<Hash>(ids);
+}
+
+/* Hash of a lattice point as a value in [-1, 1). */
+template <typename Hash = HashMix, unsigned int N, unsigned int Dims>
+static float_v<N> hash_position(const int32_v<N> (&ids)[Dims],
+                                int32_v<N> seed = 0) {
+  float_v<N> result = hash_position_bits<Hash>(ids, seed).as_float();
   return result * (1.0f / (1 << 31));
+}
 
-#undef xor_rot
+template <typename Hash = HashMix, unsigned int N>
+static float_v<N> hash_position(int32_v<N> x, int32_v<N> y,
+                                int32_v<N> z) {
+  const int32_v<N> ids[3] = {x, y, z};
+  return hash_position<Hash>(ids);
+}
+
+/* Dot product of the offset (x, y, z) with one of the 12 gradients
+ * pointing to the edge centers of a cube, selected by the low 4 bits
+ * of the hash. Four of the 16 cases repeat a gradient, as in Ken
+ * Perlin's improved noise. */
+template <unsigned int N>
+static float_v<N> gradient_dot(int32_v<N> hash, float_v<N> x,
+                               float_v<N> y, float_v<N> z) {
+  int32_v<N> h = hash & int32_v<N>(15);
+  mask_v<N> u_is_x = h < int32_v<N>(8);
+  mask_v<N> v_is_y = h < int32_v<N>(4);
+  mask_v<N> v_is_x =
+      (h == int32_v<N>(12)) | (h == int32_v<N>(14));
+  float_v<N> u = select(u_is_x, x, y);
+  float_v<N> v = select(v_is_y, y, select(v_is_x, x, z));
+  mask_v<N> u_negative = (h & int32_v<N>(1)) != int32_v<N>(0);
+  mask_v<N> v_negative = (h & int32_v<N>(2)) != int32_v<N>(0);
+  u = select(u_negative, float_v<N>(0.0f) - u, u);
+  v = select(v_negative, float_v<N>(0.0f) - v, v);
+  return u + v;
+}
+
+/* 4D variant with the 32 gradients pointing to the edge centers of a
+ * tesseract, selected by the low 5 bits of the hash. */
+template <unsigned int N>
+static float_v<N> gradient_dot(int32_v<N> hash, float_v<N> x,
+                               float_v<N> y, float_v<N> z,
+                               float_v<N> w) {
+  int32_v<N> h = hash & int32_v<N>(31);
+  float_v<N> u = select(h < int32_v<N>(24), x, y);
+  float_v<N> v = select(h < int32_v<N>(16), y, z);
+  float_v<N> t = select(h < int32_v<N>(8), z, w);
+  mask_v<N> u_negative = (h & int32_v<N>(1)) != int32_v<N>(0);
+  mask_v<N> v_negative = (h & int32_v<N>(2)) != int32_v<N>(0);
+  mask_v<N> t_negative = (h & int32_v<N>(4)) != int32_v<N>(0);
+  u = select(u_negative, float_v<N>(0.0f) - u, u);
+  v = select(v_negative, float_v<N>(0.0f) - v, v);
+  t = select(t_negative, float_v<N>(0.0f) - t, t);
+  return u + v + t;
 }
 
 template <unsigned int N> static float_v<N> fade(float_v<N> t) {
-  return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+  return t * t * t * fmadd(t, fmsub(t, 6.0f, 15.0f), 10.0f);
 }
 
+/* Derivative of fade: 30 t^2 (t - 1)^2. */
+template <unsigned int N>
+static float_v<N> fade_derivative(float_v<N> t) {
+  return t * t * fmadd(t, fmsub(t, 30.0f, 60.0f), 30.0f);
+}
+
+/* Computed as v_0 + t * (v_1 - v_0), which is a single fused
+ * multiply-add on the critical path when FMA is available. This is
+ * not bit-identical to (1 - t) * v_0 + t * v_1, and tiers with and
+ * without FMA round differently. For perlin_noise with up to 8
+ * octaves, the absolute difference between any two of these stays
+ * below 1e-5. */
 template <unsigned int N>
 static float_v<N> interpolate_linear(float_v<N> t, float_v<N> v_0,
                                      float_v<N> v_1) {
-  return (1 - t) * v_0 + t * v_1;
+  return fmadd(t, v_1 - v_0, v_0);
 }
 
 template <unsigned int N>
@@ -64,3 +292,5 @@ interpolate_trilinear(float_v<N> t1, float_v<N> t2, float_v<N> t3,
       interpolate_linear(t3, v_t1_t2_0, v_t1_t2_1);
   return v_t1_t2_t3;
 }
+
+SIMD_NAMESPACE_END
@@ -0,0 +1,492 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+
+#include "cellular_noise.hpp"
+#include "gradient_noise.hpp"
+#include "perlin_noise.hpp"
+#include "simplex_noise.hpp"
+#include "thread_pool.hpp"
+
+SIMD_NAMESPACE_BEGIN
+
+/* Noise graphs are built from nodes at compile time. Every node is a
+ * small value type with an
+ *
+ *   template <unsigned int N>
+ *   float_v<N> eval(float_v<N> x, float_v<N> y, float_v<N> z) const;
+ *
+ * member, and composite nodes hold their inputs by value. Evaluating
+ * the root therefore inlines the whole graph into a single kernel, so
+ * intermediate values stay in registers instead of going through
+ * image-sized buffers.
+ *
+ * Like all kernels, a graph is compiled for the instruction set of
+ * the translation unit it is evaluated in. To get the runtime
+ * dispatch, evaluate it from a file that is compiled once per tier
+ * (see noise_kernels_impl.cpp).
+ *
+ *   auto warp_x = node_fbm<4>(0.5f);
+ *   auto warp_y = node_translate(node_fbm<4>(0.5f), 5.2f, 1.3f, 0);
+ *   auto graph = node_clamp(
+ *       node_remap(node_warp(node_fbm<5>(), 0.8f, warp_x, warp_y),
+ *                  -1.0f, 1.0f, 0.0f, 1.0f) *
+ *           node_cellular(1.0f, CellularOutput::F1),
+ *       0.0f, 1.0f);
+ *   noise_graph_texture(graph, pixels, width, height, scale, pool);
+ */
+
+/* Base of all nodes, only used to restrict the operators below to
+ * node types. */
+template <typename Derived> struct NoiseNode {
+  const Derived &derived() const {
+    return static_cast<const Derived &>(*this);
+  }
+};
+
+/* Sources. */
+
+struct ConstantNode : NoiseNode<ConstantNode> {
+  float value;
+
+  explicit ConstantNode(float value) : value(value) {}
+
+  template <unsigned int N>
+  float_v<N> eval(float_v<N> /*x*/, float_v<N> /*y*/,
+                  float_v<N> /*z*/) const {
+    return value;
+  }
+};
+
+/* The x (0), y (1) or z (2) coordinate of the sample position. */
+template <unsigned int Axis>
+struct CoordinateNode : NoiseNode<CoordinateNode<Axis>> {
+  static_assert(Axis < 3, "x, y or z");
+
+  template <unsigned int N>
+  float_v<N> eval(float_v<N> x, float_v<N> y, float_v<N> z) const {
+    return Axis == 0 ? x : Axis == 1 ? y : z;
+  }
+};
+
+struct ValueNoiseNode : NoiseNode<ValueNoiseNode> {
+  float frequency;
+
+  explicit ValueNoiseNode(float frequency) : frequency(frequency) {}
+
+  template <unsigned int N>
+  float_v<N> eval(float_v<N> x, float_v<N> y, float_v<N> z) const {
+    return eval_noise(x * frequency, y * frequency, z * frequency);
+  }
+};
+
+template <unsigned int Octaves, typename Params>
+struct FbmNode : NoiseNode<FbmNode<Octaves, Params>> {
+  float frequency;
+
+  explicit FbmNode(float frequency) : frequency(frequency) {}
+
+  template <unsigned int N>
+  float_v<N> eval(float_v<N> x, float_v<N> y, float_v<N> z) const {
+    return fbm<Octaves, Params>(x * frequency, y * frequency,
+                                z * frequency);
+  }
+};
+
+struct GradientNoiseNode : NoiseNode<GradientNoiseNode> {
+  float frequency;
+
+  explicit GradientNoiseNode(float frequency)
+      : frequency(frequency) {}
+
+  template <unsigned int N>
+  float_v<N> eval(float_v<N> x, float_v<N> y, float_v<N> z) const {
+    return eval_gradient_noise(x * frequency, y * frequency,
+                               z * frequency);
+  }
+};
+
+struct SimplexNoiseNode : NoiseNode<SimplexNoiseNode> {
+  float frequency;
+
+  explicit SimplexNoiseNode(float frequency) : frequency(frequency) {}
+
+  template <unsigned int N>
+  float_v<N> eval(float_v<N> x, float_v<N> y, float_v<N> z) const {
+    return eval_simplex_noise(x * frequency, y * frequency,
+                              z * frequency);
+  }
+};
+
+template <CellularDistance Distance>
+struct CellularNode : NoiseNode<CellularNode<Distance>> {
+  float frequency;
+  CellularOutput output;
+
+  CellularNode(float frequency, CellularOutput output)
+      : frequency(frequency), output(output) {}
+
+  template <unsigned int N>
+  float_v<N> eval(float_v<N> x, float_v<N> y, float_v<N> z) const {
+    return cellular_noise_output<Distance>(
+        x * frequency, y * frequency, z * frequency, output);
+  }
+};
+
+/* Arithmetic. */
+
+struct AddOp {
+  template <unsigned int N>
+  static float_v<N> apply(float_v<N> a, float_v<N> b) {
+    return a + b;
+  }
+};
+
+struct SubOp {
+  template <unsigned int N>
+  static float_v<N> apply(float_v<N> a, float_v<N> b) {
+    return a - b;
+  }
+};
+
+struct MulOp {
+  template <unsigned int N>
+  static float_v<N> apply(float_v<N> a, float_v<N> b) {
+    return a * b;
+  }
+};
+
+struct MinOp {
+  template <unsigned int N>
+  static float_v<N> apply(float_v<N> a, float_v<N> b) {
+    return min(a, b);
+  }
+};
+
+struct MaxOp {
+  template <unsigned int N>
+  static float_v<N> apply(float_v<N> a, float_v<N> b) {
+    return max(a, b);
+  }
+};
+
+template <typename Op, typename A, typename B>
+struct BinaryNode : NoiseNode<BinaryNode<Op, A, B>> {
+  A a;
+  B b;
+
+  BinaryNode(const A &a, const B &b) : a(a), b(b) {}
+
+  template <unsigned int N>
+  float_v<N> eval(float_v<N> x, float_v<N> y, float_v<N> z) const {
+    return Op::apply(a.eval(x, y, z), b.eval(x, y, z));
+  }
+};
+
+/* Coordinate transforms. */
+
+/* Evaluates `source` at a shifted position. */
+template <typename Source>
+struct TranslateNode : NoiseNode<TranslateNode<Source>> {
+  Source source;
+  float dx, dy, dz;
+
+  TranslateNode(const Source &source, float dx, float dy, float dz)
+      : source(source), dx(dx), dy(dy), dz(dz) {}
+
+  template <unsigned int N>
+  float_v<N> eval(float_v<N> x, float_v<N> y, float_v<N> z) const {
+    return source.eval(x + dx, y + dy, z + dz);
+  }
+};
+
+/* Placeholder for an axis that is not warped. */
+struct NoWarpNode : NoiseNode<NoWarpNode> {};
+
+template <typename Warp, unsigned int N>
+static float_v<N> warp_coordinate(const Warp &warp, float strength,
+                                  float_v<N> coordinate, float_v<N> x,
+                                  float_v<N> y, float_v<N> z) {
+  return fmadd(warp.eval(x, y, z), strength, coordinate);
+}
+
+template <unsigned int N>
+static float_v<N> warp_coordinate(const NoWarpNode & /*warp*/,
+                                  float /*strength*/,
+                                  float_v<N> coordinate,
+                                  float_v<N> /*x*/, float_v<N> /*y*/,
+                                  float_v<N> /*z*/) {
+  return coordinate;
+}
+
+/* Domain warping: `source` is evaluated at the position offset by
+ * `strength` times the values of the warp nodes. */
+template <typename Source, typename WarpX, typename WarpY,
+          typename WarpZ>
+struct WarpNode : NoiseNode<WarpNode<Source, WarpX, WarpY, WarpZ>> {
+  Source source;
+  WarpX warp_x;
+  WarpY warp_y;
+  WarpZ warp_z;
+  float strength;
+
+  WarpNode(const Source &source, float strength, const WarpX &warp_x,
+           const WarpY &warp_y, const WarpZ &warp_z)
+      : source(source), warp_x(warp_x), warp_y(warp_y),
+        warp_z(warp_z), strength(strength) {}
+
+  template <unsigned int N>
+  float_v<N> eval(float_v<N> x, float_v<N> y, float_v<N> z) const {
+    return source.eval(
+        warp_coordinate(warp_x, strength, x, x, y, z),
+        warp_coordinate(warp_y, strength, y, x, y, z),
+        warp_coordinate(warp_z, strength, z, x, y, z));
+  }
+};
+
+/* Value transforms. */
+
+/* Linear map of the input value, used for remapping ranges. */
+template <typename Source>
+struct RemapNode : NoiseNode<RemapNode<Source>> {
+  Source source;
+  float scale;
+  float offset;
+
+  RemapNode(const Source &source, float scale, float offset)
+      : source(source), scale(scale), offset(offset) {}
+
+  template <unsigned int N>
+  float_v<N> eval(float_v<N> x, float_v<N> y, float_v<N> z) const {
+    return fmadd(source.eval(x, y, z), scale, offset);
+  }
+};
+
+template <typename Source>
+struct ClampNode : NoiseNode<ClampNode<Source>> {
+  Source source;
+  float low;
+  float high;
+
+  ClampNode(const Source &source, float low, float high)
+      : source(source), low(low), high(high) {}
+
+  template <unsigned int N>
+  float_v<N> eval(float_v<N> x, float_v<N> y, float_v<N> z) const {
+    return min(max(source.eval(x, y, z), low), high);
+  }
+};
+
+/* Factory functions. */
+
+static inline ConstantNode node_constant(float value) {
+  return ConstantNode(value);
+}
+
+static inline CoordinateNode<0> node_x() { return {}; }
+static inline CoordinateNode<1> node_y() { return {}; }
+static inline CoordinateNode<2> node_z() { return {}; }
+
+static inline ValueNoiseNode
+node_value_noise(float frequency = 1.0f) {
+  return ValueNoiseNode(frequency);
+}
+
+template <unsigned int Octaves, typename Params = FbmParams>
+static FbmNode<Octaves, Params> node_fbm(float frequency = 1.0f) {
+  return FbmNode<Octaves, Params>(frequency);
+}
+
+static inline GradientNoiseNode
+node_gradient_noise(float frequency = 1.0f) {
+  return GradientNoiseNode(frequency);
+}
+
+static inline SimplexNoiseNode
+node_simplex_noise(float frequency = 1.0f) {
+  return SimplexNoiseNode(frequency);
+}
+
+template <CellularDistance Distance = CellularDistance::Euclidean>
+static CellularNode<Distance>
+node_cellular(float frequency = 1.0f,
+              CellularOutput output = CellularOutput::F1) {
+  return CellularNode<Distance>(frequency, output);
+}
+
+template <typename A, typename B>
+static BinaryNode<AddOp, A, B> operator+(const NoiseNode<A> &a,
+                                         const NoiseNode<B> &b) {
+  return {a.derived(), b.derived()};
+}
+
+template <typename A, typename B>
+static BinaryNode<SubOp, A, B> operator-(const NoiseNode<A> &a,
+                                         const NoiseNode<B> &b) {
+  return {a.derived(), b.derived()};
+}
+
+template <typename A, typename B>
+static BinaryNode<MulOp, A, B> operator*(const NoiseNode<A> &a,
+                                         const NoiseNode<B> &b) {
+  return {a.derived(), b.derived()};
+}
+
+template <typename A>
+static BinaryNode<AddOp, A, ConstantNode>
+operator+(const NoiseNode<A> &a, float b) {
+  return {a.derived(), ConstantNode(b)};
+}
+
+template <typename A>
+static BinaryNode<SubOp, A, ConstantNode>
+operator-(const NoiseNode<A> &a, float b) {
+  return {a.derived(), ConstantNode(b)};
+}
+
+template <typename A>
+static BinaryNode<MulOp, A, ConstantNode>
+operator*(const NoiseNode<A> &a, float b) {
+  return {a.derived(), ConstantNode(b)};
+}
+
+template <typename B>
+static BinaryNode<MulOp, ConstantNode, B>
+operator*(float a, const NoiseNode<B> &b) {
+  return {ConstantNode(a), b.derived()};
+}
+
+template <typename A, typename B>
+static BinaryNode<MinOp, A, B> node_min(const NoiseNode<A> &a,
+                                        const NoiseNode<B> &b) {
+  return {a.derived(), b.derived()};
+}
+
+template <typename A, typename B>
+static BinaryNode<MaxOp, A, B> node_max(const NoiseNode<A> &a,
+                                        const NoiseNode<B> &b) {
+  return {a.derived(), b.derived()};
+}
+
+template <typename Source>
+static TranslateNode<Source>
+node_translate(const NoiseNode<Source> &source, float dx, float dy,
+               float dz) {
+  return {source.derived(), dx, dy, dz};
+}
+
+/* Warp x and y, e.g. for 2D textures. */
+template <typename Source, typename WarpX, typename WarpY>
+static WarpNode<Source, WarpX, WarpY, NoWarpNode>
+node_warp(const NoiseNode<Source> &source, float strength,
+          const NoiseNode<WarpX> &warp_x,
+          const NoiseNode<WarpY> &warp_y) {
+  return {source.derived(), strength, warp_x.derived(),
+          warp_y.derived(), NoWarpNode()};
+}
+
+template <typename Source, typename WarpX, typename WarpY,
+          typename WarpZ>
+static WarpNode<Source, WarpX, WarpY, WarpZ>
+node_warp(const NoiseNode<Source> &source, float strength,
+          const NoiseNode<WarpX> &warp_x,
+          const NoiseNode<WarpY> &warp_y,
+          const NoiseNode<WarpZ> &warp_z) {
+  return {source.derived(), strength, warp_x.derived(),
+          warp_y.derived(), warp_z.derived()};
+}
+
+/* Map [in_min, in_max] linearly to [out_min, out_max]. */
+template <typename Source>
+static RemapNode<Source> node_remap(const NoiseNode<Source> &source,
+                                    float in_min, float in_max,
+                                    float out_min, float out_max) {
+  float scale = (out_max - out_min) / (in_max - in_min);
+  return {source.derived(), scale, out_min - in_min * scale};
+}
+
+template <typename Source>
+static ClampNode<Source> node_clamp(const NoiseNode<Source> &source,
+                                    float low, float high) {
+  return {source.derived(), low, high};
+}
+
+/* Evaluation. */
+
+/* Evaluate `graph` for `count` positions given as separate coordinate
+ * arrays, like perlin_noise_batch. */
+template <unsigned int N = SIMD_NATIVE_WIDTH, typename Graph>
+static void noise_graph_batch(const NoiseNode<Graph> &graph,
+                              const float *xs, const float *ys,
+                              const float *zs, float *out,
+                              size_t count) {
+  const Graph &root = graph.derived();
+  perlin_noise_batch__apply<N>(
+      xs, ys, zs, out, count,
+      [&root](float_v<N> x, float_v<N> y, float_v<N> z) {
+        return root.eval(x, y, z);
+      });
+}
+
+/* Evaluate `graph` on the grid positions (x * scale, y * scale, z) of
+ * the pixels [x_begin, x_end) x [y_begin, y_end). Row y of the tile
+ * is written to `pixels + (y - y_begin) * stride`. The positions are
+ * generated in registers, nothing but the output is stored. */
+template <unsigned int N = SIMD_NATIVE_WIDTH, typename Graph>
+static void noise_graph_tile(const NoiseNode<Graph> &graph,
+                             float *pixels, size_t stride,
+                             unsigned int x_begin, unsigned int x_end,
+                             unsigned int y_begin, unsigned int y_end,
+                             float scale, float z = 0.0f) {
+  const Graph &root = graph.derived();
+  float lane_offsets[N];
+  for (unsigned int i = 0; i < N; i++) {
+    lane_offsets[i] = (float)i;
+  }
+  float_v<N> lanes = float_v<N>::loadu(lane_offsets);
+  float_v<N> z_v = z;
+
+  for (unsigned int y = y_begin; y < y_end; y++) {
+    float *row = pixels + (size_t)(y - y_begin) * stride;
+    float_v<N> y_v = (float)y * scale;
+    unsigned int x = x_begin;
+    for (; x + N <= x_end; x += N) {
+      float_v<N> x_v = (float_v<N>((float)x) + lanes) * scale;
+      root.eval(x_v, y_v, z_v).storeu(row + (x - x_begin));
+    }
+    unsigned int remaining = x_end - x;
+    if (remaining > 0) {
+      float_v<N> x_v = (float_v<N>((float)x) + lanes) * scale;
+      root.eval(x_v, y_v, z_v)
+          .store_partial(row + (x - x_begin), remaining);
+    }
+  }
+}
+
+/* Fill a `width` x `height` image with `graph`, tile by tile on the
+ * threads of `pool`, like noise_texture_tiled. */
+template <unsigned int N = SIMD_NATIVE_WIDTH, typename Graph>
+static void noise_graph_texture(const NoiseNode<Graph> &graph,
+                                float *pixels, unsigned int width,
+                                unsigned int height, float scale,
+                                ThreadPool &pool,
+                                unsigned int tile_size = 64) {
+  unsigned int tiles_x = (width + tile_size - 1) / tile_size;
+  unsigned int tiles_y = (height + tile_size - 1) / tile_size;
+  pool.parallel_for(
+      (size_t)tiles_x * tiles_y,
+      [&](size_t tile_index, unsigned int /*thread_index*/) {
+        unsigned int x_begin =
+            (unsigned int)(tile_index % tiles_x) * tile_size;
+        unsigned int y_begin =
+            (unsigned int)(tile_index / tiles_x) * tile_size;
+        unsigned int x_end = std::min(x_begin + tile_size, width);
+        unsigned int y_end = std::min(y_begin + tile_size, height);
+        float *tile = pixels + (size_t)y_begin * width + x_begin;
+        noise_graph_tile<N>(graph, tile, width, x_begin, x_end,
+                            y_begin, y_end, scale);
+      });
+}
+
+SIMD_NAMESPACE_END
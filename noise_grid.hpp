@@ -0,0 +1,259 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "perlin_noise.hpp"
+
+SIMD_NAMESPACE_BEGIN
+
+/* Hashed values of the lattice points along a row of cells. The row
+ * is defined by the x range and the two neighboring y and z lattice
+ * coordinates of all samples in it. Every lattice point is hashed
+ * once and then reused by all samples in the adjacent cells. For 2D
+ * rows there is no z coordinate and only the z_is_high = 0 rows are
+ * built. */
+class LatticeRowCache {
+ private:
+  int32_t m_x_begin = 0;
+  std::vector<int32_t> m_x_ids;
+  /* Indexed by y_is_high * 2 + z_is_high. */
+  std::vector<float> m_values[4];
+
+  template <unsigned int N, unsigned int Dims>
+  void build_rows(int32_t x_begin, int32_t x_end, int32_t y_low,
+                  int32_t y_high, int32_t z_low, int32_t z_high) {
+    /* Round up to full vectors, the padding is never read. */
+    size_t size = x_end - x_begin + 1;
+    size_t padded_size = (size + N - 1) / N * N;
+
+    m_x_begin = x_begin;
+    m_x_ids.resize(padded_size);
+    for (size_t i = 0; i < padded_size; i++) {
+      m_x_ids[i] = x_begin + (int32_t)i;
+    }
+    for (std::vector<float> &values : m_values) {
+      values.resize(padded_size);
+    }
+
+    const int z_count = Dims > 2 ? 2 : 1;
+    int32_v<N> y_ids[2] = {y_low, y_high};
+    int32_v<N> z_ids[2] = {z_low, z_high};
+    for (size_t i = 0; i < padded_size; i += N) {
+      int32_v<N> ids[Dims];
+      ids[0] = int32_v<N>(m_x_ids.data() + i);
+      for (int y = 0; y < 2; y++) {
+        ids[1] = y_ids[y];
+        for (int z = 0; z < z_count; z++) {
+          if (Dims > 2) {
+            ids[Dims - 1] = z_ids[z];
+          }
+          float_v<N> values = hash_position(ids);
+          values.storeu(m_values[y * 2 + z].data() + i);
+        }
+      }
+    }
+  }
+
+ public:
+  template <unsigned int N>
+  void build(int32_t x_begin, int32_t x_end, int32_t y_low,
+             int32_t y_high, int32_t z_low, int32_t z_high) {
+    build_rows<N, 3>(x_begin, x_end, y_low, y_high, z_low, z_high);
+  }
+
+  template <unsigned int N>
+  void build(int32_t x_begin, int32_t x_end, int32_t y_low,
+             int32_t y_high) {
+    build_rows<N, 2>(x_begin, x_end, y_low, y_high, 0, 0);
+  }
+
+  int32_t x_begin() const { return m_x_begin; }
+
+  const float *row(int y_is_high, int z_is_high) const {
+    return m_values[y_is_high * 2 + z_is_high].data();
+  }
+};
+
+/* Same as eval_noise, but the corner values are looked up in the
+ * cache instead of being hashed again. The result is
+ * bit-identical. The y and z interpolation factors are the same for
+ * the entire row. */
+template <unsigned int N>
+static float_v<N> eval_noise_cached(const LatticeRowCache &cache,
+                                    float_v<N> x, float_v<N> y_fac,
+                                    float_v<N> z_fac) {
+  float_v<N> x_low = x.floor();
+  float_v<N> x_high = x.ceil();
+  float_v<N> x_frac = x - x_low;
+  float_v<N> x_fac = fade(x_frac);
+
+  int32_v<N> x_begin = cache.x_begin();
+  int32_v<N> low = x_low.as_int32() - x_begin;
+  int32_v<N> high = x_high.as_int32() - x_begin;
+
+  const float *row_ll = cache.row(0, 0);
+  const float *row_lh = cache.row(0, 1);
+  const float *row_hl = cache.row(1, 0);
+  const float *row_hh = cache.row(1, 1);
+
+  float_v<N> corner_lll = float_v<N>::gather(row_ll, low);
+  float_v<N> corner_llh = float_v<N>::gather(row_lh, low);
+  float_v<N> corner_lhl = float_v<N>::gather(row_hl, low);
+  float_v<N> corner_lhh = float_v<N>::gather(row_hh, low);
+  float_v<N> corner_hll = float_v<N>::gather(row_ll, high);
+  float_v<N> corner_hlh = float_v<N>::gather(row_lh, high);
+  float_v<N> corner_hhl = float_v<N>::gather(row_hl, high);
+  float_v<N> corner_hhh = float_v<N>::gather(row_hh, high);
+
+  return interpolate_trilinear(
+      x_fac, y_fac, z_fac, corner_lll, corner_llh, corner_lhl,
+      corner_lhh, corner_hll, corner_hlh, corner_hhl, corner_hhh);
+}
+
+/* 2D variant of eval_noise_cached with 4 corners per sample. */
+template <unsigned int N>
+static float_v<N> eval_noise_cached(const LatticeRowCache &cache,
+                                    float_v<N> x, float_v<N> y_fac) {
+  float_v<N> x_low = x.floor();
+  float_v<N> x_high = x.ceil();
+  float_v<N> x_frac = x - x_low;
+  float_v<N> x_fac = fade(x_frac);
+
+  int32_v<N> x_begin = cache.x_begin();
+  int32_v<N> low = x_low.as_int32() - x_begin;
+  int32_v<N> high = x_high.as_int32() - x_begin;
+
+  const float *row_l = cache.row(0, 0);
+  const float *row_h = cache.row(1, 0);
+
+  float_v<N> corner_ll = float_v<N>::gather(row_l, low);
+  float_v<N> corner_lh = float_v<N>::gather(row_h, low);
+  float_v<N> corner_hl = float_v<N>::gather(row_l, high);
+  float_v<N> corner_hh = float_v<N>::gather(row_h, high);
+
+  return interpolate_bilinear(x_fac, y_fac, corner_ll, corner_lh,
+                              corner_hl, corner_hh);
+}
+
+/* Shared by the 2D and 3D row kernels. For Dims = 2, z is ignored. */
+template <unsigned int N, unsigned int Dims>
+static void perlin_noise_row__dims(const float *xs, float y, float z,
+                                   float *out, size_t count,
+                                   float octaves) {
+  if (count == 0) {
+    return;
+  }
+
+  /* Fall back to the per point evaluation when the positions do not
+   * form a row. 2D noise equals 3D noise at z = 0. */
+  if (!std::is_sorted(xs, xs + count)) {
+    std::vector<float> ys(count, y);
+    std::vector<float> zs(count, Dims > 2 ? z : 0.0f);
+    perlin_noise_batch<N>(xs, ys.data(), zs.data(), out, count,
+                          octaves);
+    return;
+  }
+
+  static thread_local LatticeRowCache cache;
+  std::fill(out, out + count, 0.0f);
+
+  float frequency = 1.0f;
+  float amplitude = 1.0f;
+  while (octaves > 0.0f) {
+    float weight = amplitude * std::min(octaves, 1.0f);
+
+    float_v<1> x_first = float_v<1>(xs[0]) * frequency;
+    float_v<1> x_last = float_v<1>(xs[count - 1]) * frequency;
+    float_v<1> y_pos = float_v<1>(y) * frequency;
+    float_v<1> z_pos = float_v<1>(Dims > 2 ? z : 0.0f) * frequency;
+
+    /* The cache only helps when there are fewer lattice points than
+     * samples. The lattice coordinates also have to fit into the
+     * integer range. */
+    const float max_coordinate = (float)(1 << 24);
+    bool use_cache =
+        x_last.value() - x_first.value() <= (float)(count * 2) &&
+        std::abs(x_first.value()) <= max_coordinate &&
+        std::abs(x_last.value()) <= max_coordinate &&
+        std::abs(y_pos.value()) <= max_coordinate &&
+        std::abs(z_pos.value()) <= max_coordinate;
+    if (use_cache && Dims > 2) {
+      cache.build<N>(x_first.floor().as_int32().value(),
+                     x_last.ceil().as_int32().value(),
+                     y_pos.floor().as_int32().value(),
+                     y_pos.ceil().as_int32().value(),
+                     z_pos.floor().as_int32().value(),
+                     z_pos.ceil().as_int32().value());
+    } else if (use_cache) {
+      cache.build<N>(x_first.floor().as_int32().value(),
+                     x_last.ceil().as_int32().value(),
+                     y_pos.floor().as_int32().value(),
+                     y_pos.ceil().as_int32().value());
+    }
+
+    float_v<N> y_v = float_v<N>(y_pos.value());
+    float_v<N> z_v = float_v<N>(z_pos.value());
+    float_v<N> y_fac = fade(y_v - y_v.floor());
+    float_v<N> z_fac = fade(z_v - z_v.floor());
+
+    auto eval_octave = [&](float_v<N> x) {
+      if (Dims > 2) {
+        return use_cache ? eval_noise_cached(cache, x, y_fac, z_fac)
+                         : eval_noise(x, y_v, z_v);
+      }
+      return use_cache ? eval_noise_cached(cache, x, y_fac)
+                       : eval_noise(x, y_v);
+    };
+
+    size_t i = 0;
+    for (; i + N <= count; i += N) {
+      float_v<N> x = float_v<N>::loadu(xs + i) * frequency;
+      float_v<N> result =
+          float_v<N>::loadu(out + i) + eval_octave(x) * weight;
+      result.storeu(out + i);
+    }
+
+    /* The unused lanes of the remaining samples get the last
+     * position, which is known to be inside the cached range. */
+    unsigned int remaining = (unsigned int)(count - i);
+    if (remaining > 0) {
+      float x_tail[N];
+      std::fill(x_tail, x_tail + N, xs[count - 1]);
+      std::copy(xs + i, xs + count, x_tail);
+      float_v<N> x = float_v<N>::loadu(x_tail) * frequency;
+      float_v<N> result =
+          float_v<N>::load_partial(out + i, remaining) +
+          eval_octave(x) * weight;
+      result.store_partial(out + i, remaining);
+    }
+
+    frequency *= 2.0f;
+    amplitude *= 0.5f;
+    octaves -= 1.0f;
+  }
+}
+
+/* Evaluate perlin_noise for a row of samples that share the same y
+ * and z coordinate and have non-decreasing x coordinates. This is the
+ * case for every row of a regular grid. The lattice points are hashed
+ * once per octave instead of eight times per sample. The result is
+ * bit-identical to perlin_noise_batch. */
+template <unsigned int N = SIMD_NATIVE_WIDTH>
+static void perlin_noise_row(const float *xs, float y, float z,
+                             float *out, size_t count,
+                             float octaves) {
+  perlin_noise_row__dims<N, 3>(xs, y, z, out, count, octaves);
+}
+
+/* 2D variant of perlin_noise_row. Only the 4 corners of a square are
+ * interpolated per sample. The result is bit-identical to the 3D
+ * version at z = 0. */
+template <unsigned int N = SIMD_NATIVE_WIDTH>
+static void perlin_noise_row(const float *xs, float y, float *out,
+                             size_t count, float octaves) {
+  perlin_noise_row__dims<N, 2>(xs, y, 0.0f, out, count, octaves);
+}
+
+SIMD_NAMESPACE_END
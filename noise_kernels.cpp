@@ -0,0 +1,158 @@
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <cpuid.h>
+
+#include "noise_kernels.hpp"
+#include "simd_tiers.hpp"
+
+/* Defined in the per instruction set builds of
+ * noise_kernels_impl.cpp. */
+SIMD_DECLARE_PER_TIER(NoiseKernels, kernels)
+
+static void cpuid(unsigned int leaf, unsigned int subleaf,
+                  unsigned int regs[4]) {
+  __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+}
+
+static unsigned long long xgetbv(unsigned int index) {
+  unsigned int eax, edx;
+  __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(index));
+  return ((unsigned long long)edx << 32) | eax;
+}
+
+SimdTier detect_simd_tier() {
+  unsigned int regs[4];
+  cpuid(0, 0, regs);
+  unsigned int max_leaf = regs[0];
+
+  cpuid(1, 0, regs);
+  bool has_sse41 = regs[2] & (1u << 19);
+  bool has_fma = regs[2] & (1u << 12);
+  bool has_f16c = regs[2] & (1u << 29);
+  bool has_osxsave = regs[2] & (1u << 27);
+  if (!has_sse41) {
+    return SimdTier::Scalar;
+  }
+  if (!has_osxsave || max_leaf < 7) {
+    return SimdTier::SSE41;
+  }
+
+  /* The operating system has to save the wider registers on context
+   * switches, otherwise the instructions can not be used. */
+  unsigned long long xcr0 = xgetbv(0);
+  bool os_avx = (xcr0 & 0x6) == 0x6;
+  bool os_avx512 = (xcr0 & 0xe6) == 0xe6;
+
+  cpuid(7, 0, regs);
+  bool has_avx2 = regs[1] & (1u << 5);
+  bool has_avx512f = regs[1] & (1u << 16);
+  bool has_avx512dq = regs[1] & (1u << 17);
+
+  if (os_avx512 && has_avx2 && has_fma && has_f16c && has_avx512f &&
+      has_avx512dq) {
+    return SimdTier::AVX512;
+  }
+  if (os_avx && has_avx2 && has_fma && has_f16c) {
+    return SimdTier::AVX2;
+  }
+  return SimdTier::SSE41;
+}
+
+const NoiseKernels *noise_kernels_for_tier(SimdTier tier) {
+  SIMD_SELECT_PER_TIER(tier, kernels);
+}
+
+const char *simd_tier_name(SimdTier tier) {
+  switch (tier) {
+  case SimdTier::Scalar:
+    return "scalar";
+  case SimdTier::SSE41:
+    return "sse41";
+  case SimdTier::AVX2:
+    return "avx2";
+  case SimdTier::AVX512:
+    return "avx512";
+  }
+  return "unknown";
+}
+
+bool parse_simd_tier(const char *name, SimdTier *r_tier) {
+  const SimdTier tiers[] = {SimdTier::Scalar, SimdTier::SSE41,
+                            SimdTier::AVX2, SimdTier::AVX512};
+  for (SimdTier tier : tiers) {
+    if (strcmp(name, simd_tier_name(tier)) == 0) {
+      *r_tier = tier;
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Pick the best tier that is supported by the CPU and was compiled
+ * into the binary, but not better than the requested one. */
+static const NoiseKernels *select_kernels(SimdTier max_tier) {
+  int tier = (int)max_tier;
+  for (; tier > 0; tier--) {
+    const NoiseKernels *kernels =
+        noise_kernels_for_tier((SimdTier)tier);
+    if (kernels != nullptr) {
+      return kernels;
+    }
+  }
+  return &simd_scalar::kernels;
+}
+
+/* An override that can not be used is reported, since otherwise a
+ * typo would silently measure the detected tier. */
+static const NoiseKernels *initial_kernels() {
+  SimdTier detected = detect_simd_tier();
+  const char *override_name = getenv("SIMD_TIER");
+  if (override_name == nullptr) {
+    return select_kernels(detected);
+  }
+  SimdTier requested;
+  if (!parse_simd_tier(override_name, &requested)) {
+    fprintf(stderr,
+            "SIMD_TIER=%s is not one of scalar, sse41, avx2, avx512; "
+            "using %s\n",
+            override_name, simd_tier_name(detected));
+    return select_kernels(detected);
+  }
+  if (requested > detected) {
+    fprintf(stderr,
+            "SIMD_TIER=%s is not supported by this CPU; using %s\n",
+            override_name, simd_tier_name(detected));
+    return select_kernels(detected);
+  }
+  return select_kernels(requested);
+}
+
+static std::atomic<const NoiseKernels *> active_kernels{nullptr};
+
+const NoiseKernels &noise_kernels() {
+  const NoiseKernels *kernels = active_kernels.load();
+  if (kernels == nullptr) {
+    /* The static runs the selection and its warnings once. A tier
+     * that set_simd_tier stored in the meantime is kept. */
+    static const NoiseKernels *const initial = initial_kernels();
+    if (active_kernels.compare_exchange_strong(kernels, initial)) {
+      kernels = initial;
+    }
+  }
+  return *kernels;
+}
+
+bool set_simd_tier(SimdTier tier) {
+  if (tier > detect_simd_tier()) {
+    return false;
+  }
+  const NoiseKernels *kernels = noise_kernels_for_tier(tier);
+  if (kernels == nullptr) {
+    return false;
+  }
+  active_kernels = kernels;
+  return true;
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/* The noise kernels are compiled once for every supported
+ * instruction set (see noise_kernels_impl.cpp). The best version for
+ * the current CPU is selected at startup. This header does not depend
+ * on the vector types, so it can be used from code that is compiled
+ * for the baseline instruction set. */
+
+enum class SimdTier {
+  Scalar = 0,
+  SSE41 = 1,
+  AVX2 = 2,
+  AVX512 = 3,
+};
+
+/* Distance metric of the cellular noise. */
+enum class CellularDistance {
+  Euclidean = 0,
+  Manhattan = 1,
+  Chebyshev = 2,
+};
+
+/* Value produced by the cellular noise: the distance to the closest
+ * and second closest feature point, their difference, or a hash of
+ * the closest cell in [-1, 1). */
+enum class CellularOutput {
+  F1 = 0,
+  F2 = 1,
+  F2MinusF1 = 2,
+  CellId = 3,
+};
+
+/* Reduced precision pixel encodings of pack_pixels. */
+enum class PixelFormat {
+  /* IEEE half precision. */
+  Float16 = 0,
+  /* The upper half of a float. */
+  BFloat16 = 1,
+  /* Normalized unsigned integers. */
+  UNorm8 = 2,
+  UNorm16 = 3,
+  /* UNorm16 with big endian byte order, as PGM stores it. */
+  UNorm16BigEndian = 4,
+};
+
+/* Coordinates far from the origin, split into an integer lattice
+ * cell and a fraction per axis (see lattice_coord.hpp). The position
+ * is cell + fraction; fractions outside of [0, 1) are allowed. */
+struct SplitPositions {
+  const int32_t *cells[3];
+  const float *fractions[3];
+};
+
+struct NoiseKernels {
+  SimdTier tier;
+  const char *name;
+
+  /* Evaluate the noise function at `count` separate positions. */
+  void (*eval_noise_batch)(const float *xs, const float *ys,
+                           const float *zs, float *out,
+                           size_t count);
+
+  float (*perlin_noise)(float x, float y, float z, float octaves);
+
+  void (*perlin_noise_batch)(const float *xs, const float *ys,
+                             const float *zs, float *out,
+                             size_t count, float octaves);
+
+  /* perlin_noise_batch with a seed for every position. Seed 0 gives
+   * the unseeded noise, other seeds give unrelated noise fields, so
+   * one call can evaluate several layers or variants. */
+  void (*perlin_noise_batch_seeded)(const float *xs, const float *ys,
+                                    const float *zs,
+                                    const int32_t *seeds, float *out,
+                                    size_t count, float octaves);
+
+  /* perlin_noise_batch_seeded for split coordinates, which keeps
+   * the full precision within a cell at any distance from the
+   * origin. `seeds` may be null for seed 0. The result is
+   * bit-identical to perlin_noise_batch_seeded for coordinates that a
+   * float holds exactly. */
+  void (*perlin_noise_batch_split)(const SplitPositions &positions,
+                                   const int32_t *seeds, float *out,
+                                   size_t count, float octaves);
+
+  /* perlin_noise_batch_split for double coordinates, which are split
+   * into cell and fraction on the way in. */
+  void (*perlin_noise_batch_double)(const double *xs,
+                                    const double *ys,
+                                    const double *zs,
+                                    const int32_t *seeds, float *out,
+                                    size_t count, float octaves);
+
+  /* Same as perlin_noise_batch for samples that share y and z and
+   * have non-decreasing x coordinates. Lattice hashes are shared
+   * between neighboring samples. The result is bit-identical. */
+  void (*perlin_noise_row)(const float *xs, float y, float z,
+                           float *out, size_t count, float octaves);
+
+  /* 2D version of perlin_noise_row. It only interpolates 4 corners
+   * per sample and is bit-identical to the 3D version at z = 0. */
+  void (*perlin_noise_row_2d)(const float *xs, float y, float *out,
+                              size_t count, float octaves);
+
+  /* Worley noise at `count` separate positions. */
+  void (*cellular_noise_batch)(const float *xs, const float *ys,
+                               const float *zs, float *out,
+                               size_t count,
+                               CellularDistance distance,
+                               CellularOutput output);
+
+  /* Convert `count` values into a packed pixel format. The float
+   * formats round to nearest even. The normalized integer formats
+   * map [min_value, max_value] to the full integer range, clamp
+   * values outside of it and round half up. NaN becomes 0. */
+  void (*pack_pixels)(const float *src, size_t count,
+                      PixelFormat format, float min_value,
+                      float max_value, void *dst);
+};
+
+/* Kernels of the currently selected tier. On first use, the best tier
+ * supported by the CPU is selected. This can be overridden with the
+ * SIMD_TIER environment variable (scalar, sse41, avx2 or avx512). */
+const NoiseKernels &noise_kernels();
+
+/* Kernels for a specific tier. Returns null when the tier was not
+ * compiled into the binary. */
+const NoiseKernels *noise_kernels_for_tier(SimdTier tier);
+
+/* Highest tier that is supported by the CPU this runs on. */
+SimdTier detect_simd_tier();
+
+/* Force the use of a specific tier, e.g. for A/B benchmarks. Returns
+ * false when the tier is not supported on this machine. */
+bool set_simd_tier(SimdTier tier);
+
+const char *simd_tier_name(SimdTier tier);
+bool parse_simd_tier(const char *name, SimdTier *r_tier);
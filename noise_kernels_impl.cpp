@@ -0,0 +1,126 @@
+/* This file is compiled once per instruction set. The vector types
+ * and kernels end up in a namespace named after the instruction set,
+ * so the different versions do not collide. */
+
+#include "noise_kernels.hpp"
+#include "cellular_noise.hpp"
+#include "lattice_coord.hpp"
+#include "noise_grid.hpp"
+#include "pixel_pack.hpp"
+
+SIMD_NAMESPACE_BEGIN
+
+static void eval_noise_batch(const float *xs, const float *ys,
+                             const float *zs, float *out,
+                             size_t count) {
+  const unsigned int N = SIMD_NATIVE_WIDTH;
+
+  size_t i = 0;
+  for (; i + N <= count; i += N) {
+    float_v<N> values = eval_noise(float_v<N>::loadu(xs + i),
+                                   float_v<N>::loadu(ys + i),
+                                   float_v<N>::loadu(zs + i));
+    values.storeu(out + i);
+  }
+
+  unsigned int remaining = (unsigned int)(count - i);
+  if (remaining > 0) {
+    float_v<N> values =
+        eval_noise(float_v<N>::load_partial(xs + i, remaining),
+                   float_v<N>::load_partial(ys + i, remaining),
+                   float_v<N>::load_partial(zs + i, remaining));
+    values.store_partial(out + i, remaining);
+  }
+}
+
+static float perlin_noise_single(float x, float y, float z,
+                                 float octaves) {
+  return perlin_noise(x, y, z, octaves);
+}
+
+static void perlin_noise_batch_native(const float *xs,
+                                      const float *ys,
+                                      const float *zs, float *out,
+                                      size_t count, float octaves) {
+  perlin_noise_batch(xs, ys, zs, out, count, octaves);
+}
+
+static void perlin_noise_batch_seeded_native(const float *xs,
+                                             const float *ys,
+                                             const float *zs,
+                                             const int32_t *seeds,
+                                             float *out, size_t count,
+                                             float octaves) {
+  perlin_noise_batch(xs, ys, zs, seeds, out, count, octaves);
+}
+
+static void
+perlin_noise_batch_split_native(const SplitPositions &positions,
+                                const int32_t *seeds, float *out,
+                                size_t count, float octaves) {
+  perlin_noise_batch_split(positions, seeds, out, count, octaves);
+}
+
+static void perlin_noise_batch_double_native(const double *xs,
+                                             const double *ys,
+                                             const double *zs,
+                                             const int32_t *seeds,
+                                             float *out, size_t count,
+                                             float octaves) {
+  perlin_noise_batch_double(xs, ys, zs, seeds, out, count, octaves);
+}
+
+static void perlin_noise_row_native(const float *xs, float y,
+                                    float z, float *out, size_t count,
+                                    float octaves) {
+  perlin_noise_row(xs, y, z, out, count, octaves);
+}
+
+static void perlin_noise_row_2d_native(const float *xs, float y,
+                                       float *out, size_t count,
+                                       float octaves) {
+  perlin_noise_row(xs, y, out, count, octaves);
+}
+
+static void cellular_noise_batch_native(const float *xs,
+                                        const float *ys,
+                                        const float *zs, float *out,
+                                        size_t count,
+                                        CellularDistance distance,
+                                        CellularOutput output) {
+  cellular_noise_batch(xs, ys, zs, out, count, distance, output);
+}
+
+static void pack_pixels_native(const float *src, size_t count,
+                               PixelFormat format, float min_value,
+                               float max_value, void *dst) {
+  pack_pixels(src, count, format, min_value, max_value, dst);
+}
+
+#define SIMD_STRINGIFY_(x) #x
+#define SIMD_STRINGIFY(x) SIMD_STRINGIFY_(x)
+
+extern const NoiseKernels kernels = {
+#if defined(__AVX512F__)
+    SimdTier::AVX512,
+#elif defined(__AVX2__)
+    SimdTier::AVX2,
+#elif defined(__SSE4_1__)
+    SimdTier::SSE41,
+#else
+    SimdTier::Scalar,
+#endif
+    SIMD_STRINGIFY(SIMD_ISA),
+    eval_noise_batch,
+    perlin_noise_single,
+    perlin_noise_batch_native,
+    perlin_noise_batch_seeded_native,
+    perlin_noise_batch_split_native,
+    perlin_noise_batch_double_native,
+    perlin_noise_row_native,
+    perlin_noise_row_2d_native,
+    cellular_noise_batch_native,
+    pack_pixels_native,
+};
+
+SIMD_NAMESPACE_END
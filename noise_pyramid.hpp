@@ -0,0 +1,208 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "noise_kernels.hpp"
+#include "thread_pool.hpp"
+
+/* One level of a NoisePyramid. Its pixels start at `offset` in the
+ * shared allocation and are stored row by row. */
+struct NoisePyramidLevel {
+  unsigned int width;
+  unsigned int height;
+  size_t offset;
+  /* Octaves that were evaluated for this level. */
+  float octaves;
+};
+
+/* A full mip chain of a noise texture in a single allocation. Level 0
+ * has the full resolution, every following level half the width and
+ * height (rounded down, at least 1) down to 1 x 1. */
+struct NoisePyramid {
+  std::vector<NoisePyramidLevel> levels;
+  std::vector<float> pixels;
+
+  float *level_pixels(size_t level) {
+    return pixels.data() + levels[level].offset;
+  }
+  const float *level_pixels(size_t level) const {
+    return pixels.data() + levels[level].offset;
+  }
+};
+
+/* Number of octaves that are still resolved when samples are
+ * `spacing` apart in noise space. Octave i has lattice frequency 2^i
+ * and is only represented without aliasing while 2^i <= 1 / (2 *
+ * spacing). Octaves above that would average out to roughly zero in
+ * a filtered mip level, so they are dropped instead of computed. The
+ * result is fractional, so that the last octave fades out smoothly
+ * from level to level. */
+static float noise_pyramid_octaves(float spacing, float octaves) {
+  float nyquist_octaves = 1.0f + std::log2(0.5f / spacing);
+  return std::min(octaves, std::max(nyquist_octaves, 0.0f));
+}
+
+/* Evaluate the texels [x_begin, x_end) x [y_begin, y_end) of mip
+ * `level` of the texture that noise_texture_tiled produces for
+ * `scale`. Texel i of level L covers the level 0 pixels
+ * [i * 2^L, (i + 1) * 2^L) and is sampled at its center
+ * (i + 0.5) * 2^L - 0.5, so level 0 matches noise_texture_tiled.
+ * Negative coordinates continue the texture to the left and top.
+ * The texel coordinates are 64 bit, so that the tiles of a whole
+ * int32 grid of chunks can be addressed; `level` has to be below 32.
+ * `pixels` points to the first texel, rows are `stride` apart.
+ * `xs` is scratch space for x_end - x_begin positions. */
+static void noise_level_tile(float *pixels, size_t stride,
+                             unsigned int level, int64_t x_begin,
+                             int64_t x_end, int64_t y_begin,
+                             int64_t y_end, float scale,
+                             float octaves, float *xs) {
+  const NoiseKernels &kernels = noise_kernels();
+  float step = (float)(1u << level);
+  auto position = [&](int64_t i) {
+    return ((i + 0.5f) * step - 0.5f) * scale;
+  };
+
+  size_t count = (size_t)(x_end - x_begin);
+  for (int64_t x = x_begin; x < x_end; x++) {
+    xs[x - x_begin] = position(x);
+  }
+  for (int64_t y = y_begin; y < y_end; y++) {
+    float *row = pixels + (size_t)(y - y_begin) * stride;
+    kernels.perlin_noise_row_2d(xs, position(y), row, count, octaves);
+  }
+}
+
+static void noise_level_tile(float *pixels, size_t stride,
+                             unsigned int level, int64_t x_begin,
+                             int64_t x_end, int64_t y_begin,
+                             int64_t y_end, float scale,
+                             float octaves) {
+  std::vector<float> xs((size_t)(x_end - x_begin));
+  noise_level_tile(pixels, stride, level, x_begin, x_end, y_begin,
+                   y_end, scale, octaves, xs.data());
+}
+
+/* Scratch space of noise_level_tile_double. The vectors grow to the
+ * tile width on first use and keep their capacity afterwards. */
+struct NoiseLevelScratch {
+  std::vector<double> xs;
+  std::vector<double> ys;
+  std::vector<double> zs;
+  std::vector<int32_t> seeds;
+};
+
+/* noise_level_tile with the positions computed in double from the
+ * 64 bit texel index and evaluated by perlin_noise_batch_double. A
+ * float position only keeps a few bits of the fraction far from the
+ * origin, so that neighboring texels collapse to the same value; the
+ * double position keeps about 2^-20 of it up to 2^32. The result
+ * differs from noise_level_tile in the last bits. `seed` selects
+ * the noise field like in perlin_noise_batch_seeded.
+ *
+ * Tiles without a resolved octave are 0 without evaluation. All
+ * other tiles have a texel spacing below 1 in noise space (see
+ * noise_pyramid_octaves), which keeps the positions within the range
+ * of lattice_coord_split_double. */
+static void noise_level_tile_double(float *pixels, size_t stride,
+                                    unsigned int level,
+                                    int64_t x_begin, int64_t x_end,
+                                    int64_t y_begin, int64_t y_end,
+                                    float scale, float octaves,
+                                    int32_t seed,
+                                    NoiseLevelScratch &scratch) {
+  const NoiseKernels &kernels = noise_kernels();
+  size_t count = (size_t)(x_end - x_begin);
+  if (octaves <= 0.0f) {
+    for (int64_t y = y_begin; y < y_end; y++) {
+      float *row = pixels + (size_t)(y - y_begin) * stride;
+      std::fill(row, row + count, 0.0f);
+    }
+    return;
+  }
+
+  double step = std::ldexp(1.0, (int)level);
+  auto position = [&](int64_t i) {
+    return (((double)i + 0.5) * step - 0.5) * (double)scale;
+  };
+
+  scratch.xs.resize(count);
+  scratch.zs.assign(count, 0.0);
+  scratch.seeds.assign(count, seed);
+  for (int64_t x = x_begin; x < x_end; x++) {
+    scratch.xs[x - x_begin] = position(x);
+  }
+  for (int64_t y = y_begin; y < y_end; y++) {
+    float *row = pixels + (size_t)(y - y_begin) * stride;
+    scratch.ys.assign(count, position(y));
+    kernels.perlin_noise_batch_double(scratch.xs.data(),
+                                      scratch.ys.data(),
+                                      scratch.zs.data(),
+                                      scratch.seeds.data(), row,
+                                      count, octaves);
+  }
+}
+
+/* Generate all mip levels of the `width` x `height` texture that
+ * noise_texture_tiled produces for `scale`. Every level is evaluated
+ * directly with the octave count from noise_pyramid_octaves, instead
+ * of filtering the level above. All tiles of all levels are
+ * distributed over the threads of `pool`. */
+static NoisePyramid noise_pyramid(unsigned int width,
+                                  unsigned int height, float scale,
+                                  float octaves, ThreadPool &pool,
+                                  unsigned int tile_size = 64) {
+  NoisePyramid pyramid;
+  size_t pixel_count = 0;
+  unsigned int level_width = width;
+  unsigned int level_height = height;
+  while (true) {
+    size_t level = pyramid.levels.size();
+    float spacing = scale * (float)(1u << level);
+    float level_octaves = noise_pyramid_octaves(spacing, octaves);
+    pyramid.levels.push_back(
+        {level_width, level_height, pixel_count, level_octaves});
+    pixel_count += (size_t)level_width * level_height;
+    if (level_width == 1 && level_height == 1) {
+      break;
+    }
+    level_width = std::max(level_width / 2, 1u);
+    level_height = std::max(level_height / 2, 1u);
+  }
+  pyramid.pixels.resize(pixel_count);
+
+  struct Tile {
+    unsigned int level;
+    unsigned int x_begin, x_end;
+    unsigned int y_begin, y_end;
+  };
+  std::vector<Tile> tiles;
+  for (unsigned int level = 0; level < pyramid.levels.size();
+       level++) {
+    const NoisePyramidLevel &info = pyramid.levels[level];
+    for (unsigned int y = 0; y < info.height; y += tile_size) {
+      for (unsigned int x = 0; x < info.width; x += tile_size) {
+        unsigned int x_end = std::min(x + tile_size, info.width);
+        unsigned int y_end = std::min(y + tile_size, info.height);
+        tiles.push_back({level, x, x_end, y, y_end});
+      }
+    }
+  }
+
+  pool.parallel_for(
+      tiles.size(), [&](size_t tile_index, unsigned int /*thread*/) {
+        const Tile &tile = tiles[tile_index];
+        const NoisePyramidLevel &info = pyramid.levels[tile.level];
+        float *pixels = pyramid.level_pixels(tile.level) +
+                        (size_t)tile.y_begin * info.width +
+                        tile.x_begin;
+        noise_level_tile(pixels, info.width, tile.level,
+                         (int)tile.x_begin, (int)tile.x_end,
+                         (int)tile.y_begin, (int)tile.y_end, scale,
+                         info.octaves);
+      });
+  return pyramid;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "noise_kernels.hpp"
+#include "texture_io.hpp"
+#include "thread_pool.hpp"
+
+/* Fill rows [y_begin, y_end) of a `width` pixels wide image with
+ * perlin noise, stored in the pixel encoding of `format` (see
+ * encode_texture_pixels). `pixels` points to the first of these
+ * rows. The rows are split into tiles of `tile_size` x `tile_size`
+ * pixels that are small enough to stay in the cache while they are
+ * computed. The tiles are distributed over the threads of `pool`.
+ * Float formats are written straight into their part of `pixels`,
+ * other formats are packed row by row as the output stage of the
+ * tile, so there is no separate conversion pass over the image. When
+ * `timer_name` is given, every thread reports its time. */
+static void noise_texture_rows_encoded(
+    void *pixels, TextureFormat format, float min_value,
+    float max_value, unsigned int width, unsigned int y_begin,
+    unsigned int y_end, float scale, float octaves, ThreadPool &pool,
+    unsigned int tile_size = 64, const char *timer_name = nullptr) {
+  unsigned int row_count = y_end - y_begin;
+  unsigned int tiles_x = (width + tile_size - 1) / tile_size;
+  unsigned int tiles_y = (row_count + tile_size - 1) / tile_size;
+  const NoiseKernels &kernels = noise_kernels();
+  size_t bytes_per_pixel = texture_bytes_per_pixel(format);
+  bool packed = bytes_per_pixel != sizeof(float);
+
+  /* Per thread scratch for the x positions and the row values of a
+   * tile, so that the tiles do not allocate. */
+  std::vector<float> scratch((size_t)pool.thread_count() * 2 *
+                             tile_size);
+
+  pool.parallel_for(
+      (size_t)tiles_x * tiles_y,
+      [&](size_t tile_index, unsigned int thread_index) {
+        unsigned int tile_x = (unsigned int)(tile_index % tiles_x);
+        unsigned int tile_y = (unsigned int)(tile_index / tiles_x);
+        unsigned int tile_x_begin = tile_x * tile_size;
+        unsigned int tile_y_begin = y_begin + tile_y * tile_size;
+        unsigned int tile_x_end =
+            std::min(tile_x_begin + tile_size, width);
+        unsigned int tile_y_end =
+            std::min(tile_y_begin + tile_size, y_end);
+        unsigned int tile_width = tile_x_end - tile_x_begin;
+
+        float *xs =
+            scratch.data() + (size_t)thread_index * 2 * tile_size;
+        float *row_values = xs + tile_size;
+        for (unsigned int x = 0; x < tile_width; x++) {
+          xs[x] = (tile_x_begin + x) * scale;
+        }
+        for (unsigned int y = tile_y_begin; y < tile_y_end; y++) {
+          size_t offset =
+              (size_t)(y - y_begin) * width + tile_x_begin;
+          char *row = (char *)pixels + offset * bytes_per_pixel;
+          float *values = packed ? row_values : (float *)row;
+          kernels.perlin_noise_row_2d(xs, y * scale, values,
+                                      tile_width, octaves);
+          if (packed) {
+            encode_texture_pixels(format, values, tile_width,
+                                  min_value, max_value, row);
+          }
+        }
+      },
+      timer_name);
+}
+
+/* noise_texture_rows_encoded for float pixels. */
+static void noise_texture_rows(float *pixels, unsigned int width,
+                               unsigned int y_begin,
+                               unsigned int y_end, float scale,
+                               float octaves, ThreadPool &pool,
+                               unsigned int tile_size = 64,
+                               const char *timer_name = nullptr) {
+  noise_texture_rows_encoded(pixels, TextureFormat::RawFloat32, 0.0f,
+                             1.0f, width, y_begin, y_end, scale,
+                             octaves, pool, tile_size, timer_name);
+}
+
+/* Fill a `width` x `height` image with perlin noise. */
+static void noise_texture_tiled(float *pixels, unsigned int width,
+                                unsigned int height, float scale,
+                                float octaves, ThreadPool &pool,
+                                unsigned int tile_size = 64) {
+  noise_texture_rows(pixels, width, 0, height, scale, octaves, pool,
+                     tile_size, "generate tiles");
+}
+
+/* Generate a `width` x `height` image and stream it to `writer`, one
+ * band of tiles at a time. Only a single band is kept in memory, and
+ * it is generated in the pixel encoding of the file. The bands are
+ * generated in file order, so that this also works for output that
+ * is not seekable. */
+static bool noise_texture_stream(TextureWriter &writer,
+                                 unsigned int width,
+                                 unsigned int height, float scale,
+                                 float octaves, ThreadPool &pool,
+                                 unsigned int tile_size = 64) {
+  TextureFormat format = writer.format();
+  std::vector<char> band((size_t)width * tile_size *
+                         texture_bytes_per_pixel(format));
+  unsigned int band_count = (height + tile_size - 1) / tile_size;
+  for (unsigned int i = 0; i < band_count; i++) {
+    unsigned int band_index =
+        writer.bottom_to_top() ? band_count - 1 - i : i;
+    unsigned int y = band_index * tile_size;
+    unsigned int y_end = std::min(y + tile_size, height);
+    noise_texture_rows_encoded(band.data(), format,
+                               writer.min_value(), writer.max_value(),
+                               width, y, y_end, scale, octaves, pool,
+                               tile_size);
+    if (!writer.write_encoded_rows(y, y_end - y, band.data())) {
+      return false;
+    }
+  }
+  return true;
+}
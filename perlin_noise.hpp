@@ -1,71 +1,97 @@
 #pragma once
 
 #include <algorithm>
+#include <cstddef>
 
 #include "noise_common.hpp"
 
-/* Evaluate the noise function at N separate positions. */
-template <unsigned int N>
+SIMD_NAMESPACE_BEGIN
+
+/* Hash the 2^Dims corners of the cells given by `low_ids` and
+ * `high_ids` and interpolate them one axis at a time, starting with
+ * the first. `factors` are the faded positions within the cells. */
+template <typename Hash, unsigned int N, unsigned int Dims>
+static float_v<N> eval_noise__cell(const int32_v<N> (&low_ids)[Dims],
+                                   const int32_v<N> (&high_ids)[Dims],
+                                   const float_v<N> (&factors)[Dims],
+                                   int32_v<N> seed) {
+  const unsigned int corner_count = 1u << Dims;
+
+  /* Bit d of the corner index selects the high side of axis d. */
+  float_v<N> corners[corner_count];
+  for (unsigned int corner = 0; corner < corner_count; corner++) {
+    int32_v<N> ids[Dims];
+    for (unsigned int d = 0; d < Dims; d++) {
+      ids[d] = (corner >> d) & 1 ? high_ids[d] : low_ids[d];
+    }
+    corners[corner] = hash_position<Hash>(ids, seed);
+  }
+
+  /* Every pass halves the corners by interpolating along one axis. */
+  for (unsigned int d = 0; d < Dims; d++) {
+    unsigned int count = corner_count >> (d + 1);
+    for (unsigned int i = 0; i < count; i++) {
+      corners[i] = interpolate_linear(factors[d], corners[2 * i],
+                                      corners[2 * i + 1]);
+    }
+  }
+  return corners[0];
+}
+
+/* Evaluate the noise function at N separate positions with Dims
+ * coordinates each. The 2^Dims cell corners are hashed and then
+ * interpolated one axis at a time, starting with the first. A
+ * missing coordinate behaves like a zero coordinate, so e.g. 2D noise
+ * is bit-identical to 3D noise at z = 0 but hashes only 4 corners.
+ * `Hash` is one of the hash policies from noise_common.hpp. Every
+ * lane is hashed with its own seed, so one call can evaluate N
+ * different noise fields. */
+template <typename Hash = HashMix, unsigned int N, unsigned int Dims>
+static float_v<N> eval_noise(const float_v<N> (&position)[Dims],
+                             int32_v<N> seed = 0) {
+  float_v<N> factors[Dims];
+  int32_v<N> low_ids[Dims];
+  int32_v<N> high_ids[Dims];
+  for (unsigned int d = 0; d < Dims; d++) {
+    float_v<N> low = position[d].floor();
+    float_v<N> high = position[d].ceil();
+    factors[d] = fade(position[d] - low);
+    low_ids[d] = low.as_int32();
+    high_ids[d] = high.as_int32();
+  }
+  return eval_noise__cell<Hash>(low_ids, high_ids, factors, seed);
+}
+
+template <typename Hash = HashMix, unsigned int N>
+static float_v<N> eval_noise(float_v<N> x, int32_v<N> seed = 0) {
+  const float_v<N> position[1] = {x};
+  return eval_noise<Hash>(position, seed);
+}
+
+template <typename Hash = HashMix, unsigned int N>
 static float_v<N> eval_noise(float_v<N> x, float_v<N> y,
-                             float_v<N> z) {
-
-  /* Compute grid cell boundaries for every point. */
-  float_v<N> x_low = x.floor();
-  float_v<N> y_low = y.floor();
-  float_v<N> z_low = z.floor();
-  float_v<N> x_high = x.ceil();
-  float_v<N> y_high = y.ceil();
-  float_v<N> z_high = z.ceil();
-
-  /* Compute fractional offset into a cell. */
-  float_v<N> x_frac = x - x_low;
-  float_v<N> y_frac = y - y_low;
-  float_v<N> z_frac = z - z_low;
-
-  /* Compute interpolation factors in cell. */
-  float_v<N> x_fac = fade(x_frac);
-  float_v<N> y_fac = fade(y_frac);
-  float_v<N> z_fac = fade(z_frac);
-
-  /* Get IDs of cell corners.
-   * TODO: Compare cast vs convert to int.
-   */
-  int32_v<N> x_low_id = x_low.as_int32();
-  int32_v<N> y_low_id = y_low.as_int32();
-  int32_v<N> z_low_id = z_low.as_int32();
-  int32_v<N> x_high_id = x_high.as_int32();
-  int32_v<N> y_high_id = y_high.as_int32();
-  int32_v<N> z_high_id = z_high.as_int32();
-
-  /* Compute cell corner values.
-   * There are 4 * 8 = 32 corners to compute.
-   */
-  float_v<N> corner_lll = hash_position(x_low_id, y_low_id, z_low_id);
-  float_v<N> corner_llh =
-      hash_position(x_low_id, y_low_id, z_high_id);
-  float_v<N> corner_lhl =
-      hash_position(x_low_id, y_high_id, z_low_id);
-  float_v<N> corner_lhh =
-      hash_position(x_low_id, y_high_id, z_high_id);
-  float_v<N> corner_hll =
-      hash_position(x_high_id, y_low_id, z_low_id);
-  float_v<N> corner_hlh =
-      hash_position(x_high_id, y_low_id, z_high_id);
-  float_v<N> corner_hhl =
-      hash_position(x_high_id, y_high_id, z_low_id);
-  float_v<N> corner_hhh =
-      hash_position(x_high_id, y_high_id, z_high_id);
-
-  /* Interpolate corner values for position in cell. */
-  float_v<N> result = interpolate_trilinear(
-      x_fac, y_fac, z_fac, corner_lll, corner_llh, corner_lhl,
-      corner_lhh, corner_hll, corner_hlh, corner_hhl, corner_hhh);
+                             int32_v<N> seed = 0) {
+  const float_v<N> position[2] = {x, y};
+  return eval_noise<Hash>(position, seed);
+}
 
-  return result;
+template <typename Hash = HashMix, unsigned int N>
+static float_v<N> eval_noise(float_v<N> x, float_v<N> y,
+                             float_v<N> z, int32_v<N> seed = 0) {
+  const float_v<N> position[3] = {x, y, z};
+  return eval_noise<Hash>(position, seed);
+}
+
+template <typename Hash = HashMix, unsigned int N>
+static float_v<N> eval_noise(float_v<N> x, float_v<N> y,
+                             float_v<N> z, float_v<N> w,
+                             int32_v<N> seed = 0) {
+  const float_v<N> position[4] = {x, y, z, w};
+  return eval_noise<Hash>(position, seed);
 }
 
 template <unsigned int N>
-float perlin_noise__multi_level(float x, float y, float z,
+static float perlin_noise__multi_level(float x, float y, float z,
                                 float_v<N> frequency_factors,
                                 float_v<N> amplitude_factors) {
   float_v<N> xs = x * frequency_factors;
@@ -75,77 +101,219 @@ float perlin_noise__multi_level(float x, float y, float z,
   float_v<N> raw_values = eval_noise(xs, ys, zs);
   float_v<N> values = raw_values * amplitude_factors;
 
-  float sum = values.get<0>() + values.get<1>() + values.get<2>() +
-              values.get<3>();
+  float sum = values.template get<0>() + values.template get<1>() +
+              values.template get<2>() + values.template get<3>();
   return sum;
 }
 
-float perlin_noise(float x, float y, float z, float octaves) {
+/* Evaluate the noise at a single position. The octaves are spread
+ * across the lanes of a 4-wide vector, so one call to eval_noise
+ * handles four octaves. Lanes past the octave count get a weight of
+ * zero and the lane of a fractional last octave a partial weight. */
+static float perlin_noise(float x, float y, float z,
+                          float octaves) {
+  const float_v<4> octave_offsets{0.0f, 1.0f, 2.0f, 3.0f};
+  const float_v<4> frequency_factors{1.0f, 2.0f, 4.0f, 8.0f};
+  const float_v<4> amplitude_factors{1.0f, 1.0f / 2, 1.0f / 4,
+                                     1.0f / 8};
+
   float frequency = 1.0f;
   float amplitude = 1.0f;
-  float_v<8> frequency_factors_8{1, 2, 4, 8, 16, 32, 64, 128};
-  float_v<8> amplitude_factors_8{1.0f,      1.0f / 2,  1.0f / 4,
-                                 1.0f / 8,  1.0f / 16, 1.0f / 32,
-                                 1.0f / 64, 1.0f / 128};
-  float_v<4> frequency_factors_4 = frequency_factors_8.low();
-  float_v<4> amplitude_factors_4 = amplitude_factors_8.low();
-
   float result = 0.0f;
 
-  while (octaves > 0.0f) {
-    float amplitudes[4];
-    memset(amplitudes, 0, sizeof(amplitudes));
-    if (octaves <= 1.0f) {
-      amplitudes[0] = octaves;
-    } else {
-      amplitudes[0] = 1.0f;
-      if (octaves <= 2.0f) {
-        amplitudes[1] = octaves - 1.0f;
-      } else {
-        amplitudes[1] = 1.0f;
-        if (octaves <= 3.0f) {
-          amplitudes[2] = octaves - 2.0f;
-        } else {
-          amplitudes[2] = 1.0f;
-          if (octaves <= 4.0f) {
-            amplitudes[3] = octaves - 3.0f;
-          } else {
-            amplitudes[3] = 1.0f;
-          }
-        }
-      }
-    }
-
-    float_v<4> amplitude_factors =
-        amplitude_factors_4 * float_v<4>(amplitudes);
+  for (float first = 0.0f; first < octaves; first += 4.0f) {
+    float_v<4> remaining =
+        float_v<4>(octaves - first) - octave_offsets;
+    float_v<4> weights = min(max(remaining, 0.0f), 1.0f);
 
-    result += perlin_noise__multi_level(x, y, z, frequency_factors_4,
-                                        amplitude_factors);
+    result += amplitude * perlin_noise__multi_level(
+                              x * frequency, y * frequency,
+                              z * frequency, frequency_factors,
+                              amplitude_factors * weights);
 
     frequency *= (1 << 4);
     amplitude *= 1.0f / (1 << 4);
-    octaves -= 4.0f;
   }
 
   return result;
 }
 
-float eval_perlin_1(float x, float y, float z) {
-  float v1 = eval_noise<1>(x, y, z).get<0>();
-  float v2 = eval_noise<1>(x * 2, y * 2, z * 2).get<0>();
-  float v3 = eval_noise<1>(x * 4, y * 4, z * 4).get<0>();
-  float v4 = eval_noise<1>(x * 8, y * 8, z * 8).get<0>();
-  return v1 + v2 * 0.5f + v3 * 0.25f + v4 * 0.125f;
-}
-float eval_perlin_2(float x, float y, float z) {
-  float_v<4> x_positions{x, x * 2, x * 4, x * 8};
-  float_v<4> y_positions{y, y * 2, y * 4, y * 8};
-  float_v<4> z_positions{z, z * 2, z * 4, z * 8};
-  float_v<4> values =
-      eval_noise(x_positions, y_positions, z_positions);
-  float v1 = values.get<0>();
-  float v2 = values.get<1>();
-  float v3 = values.get<2>();
-  float v4 = values.get<3>();
-  return v1 + v2 * 0.5f + v3 * 0.25f + v4 * 0.125f;
+/* Default fBm parameters: every octave doubles the frequency and
+ * halves the amplitude. Other parameter sets are structs with the
+ * same two constexpr members. */
+struct FbmParams {
+  static constexpr float lacunarity = 2.0f;
+  static constexpr float gain = 0.5f;
+};
+
+constexpr float fbm_power(float base, unsigned int exponent) {
+  return exponent == 0 ? 1.0f : base * fbm_power(base, exponent - 1);
+}
+
+/* Adds octaves Octave..Octaves-1 to `result`. The recursion is
+ * resolved at compile time, so the octave loop is fully unrolled and
+ * frequency and amplitude are constants. */
+template <unsigned int Octave, unsigned int Octaves, typename Params>
+struct FbmOctaves {
+  template <unsigned int N>
+  static float_v<N> eval(float_v<N> result, float_v<N> x,
+                         float_v<N> y, float_v<N> z,
+                         int32_v<N> seed) {
+    constexpr float frequency = fbm_power(Params::lacunarity, Octave);
+    constexpr float amplitude = fbm_power(Params::gain, Octave);
+    float_v<N> values = eval_noise(x * frequency, y * frequency,
+                                   z * frequency, seed);
+    result = result + values * amplitude;
+    return FbmOctaves<Octave + 1, Octaves, Params>::eval(result, x,
+                                                         y, z, seed);
+  }
+};
+
+template <unsigned int Octaves, typename Params>
+struct FbmOctaves<Octaves, Octaves, Params> {
+  template <unsigned int N>
+  static float_v<N> eval(float_v<N> result, float_v<N> /*x*/,
+                         float_v<N> /*y*/, float_v<N> /*z*/,
+                         int32_v<N> /*seed*/) {
+    return result;
+  }
+};
+
+/* Evaluate a fixed number of octaves for N separate positions. For
+ * integral octave counts and the default parameters the result is
+ * bit-identical to perlin_noise__octaves. All octaves of a lane use
+ * the seed of that lane. */
+template <unsigned int Octaves, typename Params = FbmParams,
+          unsigned int N>
+static float_v<N> fbm(float_v<N> x, float_v<N> y, float_v<N> z,
+                      int32_v<N> seed = 0) {
+  return FbmOctaves<0, Octaves, Params>::eval(float_v<N>(0.0f), x, y,
+                                              z, seed);
+}
+
+/* Evaluate all octaves for N separate positions. Every lane belongs
+ * to a different position, so no horizontal reduction is necessary.
+ * This is the fallback for octave counts that are only known at
+ * runtime; a fractional count fades in the last octave. */
+template <unsigned int N>
+static float_v<N> fbm_runtime(float_v<N> x, float_v<N> y,
+                              float_v<N> z, float octaves,
+                              float lacunarity, float gain,
+                              int32_v<N> seed = 0) {
+  float_v<N> result = 0.0f;
+  float frequency = 1.0f;
+  float amplitude = 1.0f;
+  while (octaves > 0.0f) {
+    float weight = amplitude * std::min(octaves, 1.0f);
+    float_v<N> values = eval_noise(x * frequency, y * frequency,
+                                   z * frequency, seed);
+    result = result + values * weight;
+
+    frequency *= lacunarity;
+    amplitude *= gain;
+    octaves -= 1.0f;
+  }
+  return result;
+}
+
+/* fbm_runtime with the default parameters. The octave weights match
+ * the ones used by perlin_noise. */
+template <unsigned int N>
+static float_v<N> perlin_noise__octaves(float_v<N> x, float_v<N> y,
+                                        float_v<N> z, float octaves,
+                                        int32_v<N> seed = 0) {
+  return fbm_runtime(x, y, z, octaves, FbmParams::lacunarity,
+                     FbmParams::gain, seed);
+}
+
+/* Apply `eval(x, y, z, seed)` to `count` positions given as
+ * separate coordinate arrays and write the results to `out`. Without
+ * `seeds`, every position has seed 0. */
+template <unsigned int N, typename Eval>
+static void perlin_noise_batch__apply(const float *xs,
+                                      const float *ys,
+                                      const float *zs,
+                                      const int32_t *seeds,
+                                      float *out, size_t count,
+                                      Eval eval) {
+  size_t i = 0;
+  for (; i + N <= count; i += N) {
+    int32_v<N> seed =
+        seeds ? int32_v<N>::loadu(seeds + i) : int32_v<N>(0);
+    float_v<N> values =
+        eval(float_v<N>::loadu(xs + i), float_v<N>::loadu(ys + i),
+             float_v<N>::loadu(zs + i), seed);
+    values.storeu(out + i);
+  }
+
+  /* Handle the remaining positions with partial loads and stores.
+   * The unused lanes are zero. */
+  unsigned int remaining = (unsigned int)(count - i);
+  if (remaining > 0) {
+    int32_v<N> seed =
+        seeds ? int32_v<N>::load_partial(seeds + i, remaining)
+              : int32_v<N>(0);
+    float_v<N> values =
+        eval(float_v<N>::load_partial(xs + i, remaining),
+             float_v<N>::load_partial(ys + i, remaining),
+             float_v<N>::load_partial(zs + i, remaining), seed);
+    values.store_partial(out + i, remaining);
+  }
+}
+
+/* perlin_noise_batch__apply for an `eval(x, y, z)` without a seed. */
+template <unsigned int N, typename Eval>
+static void perlin_noise_batch__apply(const float *xs,
+                                      const float *ys,
+                                      const float *zs, float *out,
+                                      size_t count, Eval eval) {
+  perlin_noise_batch__apply<N>(
+      xs, ys, zs, nullptr, out, count,
+      [&eval](float_v<N> x, float_v<N> y, float_v<N> z,
+              int32_v<N> /*seed*/) { return eval(x, y, z); });
+}
+
+/* Evaluate perlin_noise for `count` positions given as separate
+ * coordinate arrays, each with its own seed from `seeds`. The results
+ * are written to `out`. By default the native vector width of the
+ * instruction set is used. The common octave counts use the unrolled
+ * fbm kernels, everything else goes through the runtime loop. */
+template <unsigned int N = SIMD_NATIVE_WIDTH>
+static void perlin_noise_batch(const float *xs, const float *ys,
+                               const float *zs, const int32_t *seeds,
+                               float *out, size_t count,
+                               float octaves) {
+  if (octaves == 4.0f) {
+    perlin_noise_batch__apply<N>(
+        xs, ys, zs, seeds, out, count,
+        [](float_v<N> x, float_v<N> y, float_v<N> z,
+           int32_v<N> seed) { return fbm<4>(x, y, z, seed); });
+  } else if (octaves == 5.0f) {
+    perlin_noise_batch__apply<N>(
+        xs, ys, zs, seeds, out, count,
+        [](float_v<N> x, float_v<N> y, float_v<N> z,
+           int32_v<N> seed) { return fbm<5>(x, y, z, seed); });
+  } else if (octaves == 8.0f) {
+    perlin_noise_batch__apply<N>(
+        xs, ys, zs, seeds, out, count,
+        [](float_v<N> x, float_v<N> y, float_v<N> z,
+           int32_v<N> seed) { return fbm<8>(x, y, z, seed); });
+  } else {
+    perlin_noise_batch__apply<N>(
+        xs, ys, zs, seeds, out, count,
+        [octaves](float_v<N> x, float_v<N> y, float_v<N> z,
+                  int32_v<N> seed) {
+          return perlin_noise__octaves(x, y, z, octaves, seed);
+        });
+  }
 }
+
+/* perlin_noise_batch with seed 0 for every position. */
+template <unsigned int N = SIMD_NATIVE_WIDTH>
+static void perlin_noise_batch(const float *xs, const float *ys,
+                               const float *zs, float *out,
+                               size_t count, float octaves) {
+  perlin_noise_batch<N>(xs, ys, zs, nullptr, out, count, octaves);
+}
+
+SIMD_NAMESPACE_END
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+
+#include "noise_kernels.hpp"
+#include "simd_core.hpp"
+
+SIMD_NAMESPACE_BEGIN
+
+/* Map [min_value, min_value + max_int / factor] to [0, max_int],
+ * clamp and round half up. NaN gives 0, because min and max return
+ * their second operand for it. */
+template <unsigned int N>
+static int32_v<N> unorm_bits(float_v<N> value, float min_value,
+                             float factor, float max_int) {
+  float_v<N> scaled = (value - min_value) * factor;
+  scaled = min(max(scaled, float_v<N>(0.0f)), float_v<N>(max_int));
+  return (scaled + 0.5f).floor().as_int32();
+}
+
+/* Convert `count` values with `store(value, dst)`, which writes N
+ * elements of type T. The last partial vector goes through a buffer,
+ * so that nothing is written after the end of `dst`. */
+template <unsigned int N, typename T, typename Store>
+static void pack_pixels__apply(const float *src, size_t count, T *dst,
+                               Store store) {
+  size_t i = 0;
+  for (; i + N <= count; i += N) {
+    store(float_v<N>::loadu(src + i), dst + i);
+  }
+
+  unsigned int remaining = (unsigned int)(count - i);
+  if (remaining > 0) {
+    T values[N];
+    store(float_v<N>::load_partial(src + i, remaining), values);
+    memcpy(dst + i, values, remaining * sizeof(T));
+  }
+}
+
+/* See NoiseKernels::pack_pixels. */
+template <unsigned int N = SIMD_NATIVE_WIDTH>
+static void pack_pixels(const float *src, size_t count,
+                        PixelFormat format, float min_value,
+                        float max_value, void *dst) {
+  switch (format) {
+  case PixelFormat::Float16:
+    pack_pixels__apply<N>(src, count, (uint16_t *)dst,
+                          [](float_v<N> value, uint16_t *dst) {
+                            value.store_float16(dst);
+                          });
+    break;
+  case PixelFormat::BFloat16:
+    pack_pixels__apply<N>(src, count, (uint16_t *)dst,
+                          [](float_v<N> value, uint16_t *dst) {
+                            bfloat16_bits(value).store_uint16(dst);
+                          });
+    break;
+  case PixelFormat::UNorm8: {
+    float factor = 255.0f / (max_value - min_value);
+    pack_pixels__apply<N>(
+        src, count, (uint8_t *)dst,
+        [min_value, factor](float_v<N> value, uint8_t *dst) {
+          unorm_bits(value, min_value, factor, 255.0f)
+              .store_uint8(dst);
+        });
+    break;
+  }
+  case PixelFormat::UNorm16:
+  case PixelFormat::UNorm16BigEndian: {
+    float factor = 65535.0f / (max_value - min_value);
+    bool big_endian = format == PixelFormat::UNorm16BigEndian;
+    pack_pixels__apply<N>(
+        src, count, (uint16_t *)dst,
+        [min_value, factor, big_endian](float_v<N> value,
+                                        uint16_t *dst) {
+          int32_v<N> bits =
+              unorm_bits(value, min_value, factor, 65535.0f);
+          if (big_endian) {
+            int32_v<N> low = bits & int32_v<N>(0xff);
+            bits = low.template shift_left<8>() |
+                   bits.template shift_right<8>();
+          }
+          bits.store_uint16(dst);
+        });
+    break;
+  }
+  }
+}
+
+SIMD_NAMESPACE_END
@@ -6,10 +6,235 @@
 #include <stdio.h>
 #include <xmmintrin.h>
 
+#include <cmath>
+#include <cstring>
 #include <iostream>
 
+/* The instruction set that a translation unit is compiled for
+ * decides which specializations below are available. Everything is
+ * placed in a namespace that is named after that instruction set, so
+ * that the same kernels can be compiled multiple times into a single
+ * binary (see noise_kernels.hpp). Wider vectors than the native width
+ * fall back to the generic recursive implementation. */
+#if defined(__AVX512F__)
+#define SIMD_ISA simd_avx512
+#define SIMD_NATIVE_WIDTH 16
+#elif defined(__AVX2__)
+#define SIMD_ISA simd_avx2
+#define SIMD_NATIVE_WIDTH 8
+#elif defined(__SSE4_1__)
+#define SIMD_ISA simd_sse41
+#define SIMD_NATIVE_WIDTH 4
+#else
+#define SIMD_ISA simd_scalar
+#define SIMD_NATIVE_WIDTH 1
+#endif
+
+#if defined(__SSE4_1__)
+#define SIMD_HAS_SSE41 1
+#endif
+#if defined(__AVX2__)
+#define SIMD_HAS_AVX2 1
+#endif
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+#define SIMD_HAS_AVX512 1
+#endif
+#if defined(__FMA__)
+#define SIMD_HAS_FMA 1
+#endif
+#if defined(__F16C__)
+#define SIMD_HAS_F16C 1
+#endif
+
+#define SIMD_NAMESPACE_BEGIN inline namespace SIMD_ISA {
+#define SIMD_NAMESPACE_END }
+
+SIMD_NAMESPACE_BEGIN
+
 template <unsigned int N> class float_v;
 template <unsigned int N> class int32_v;
+template <unsigned int N> class mask_v;
+
+/* Result of a lane-wise comparison. It can be combined with other
+ * masks and is used to select between two vectors without branching.
+ * The same mask type is used for float and integer vectors. */
+template <unsigned int N> class mask_v {
+  static const int N_Half = N / 2;
+  static_assert(N_Half * 2 == N, "N is not a power of two");
+
+ private:
+  mask_v<N_Half> m_low;
+  mask_v<N_Half> m_high;
+
+ public:
+  mask_v() = default;
+  mask_v(bool value) : m_low(value), m_high(value) {}
+  mask_v(mask_v<N_Half> low, mask_v<N_Half> high)
+      : m_low(low), m_high(high) {}
+
+  mask_v<N_Half> low() const { return m_low; }
+  mask_v<N_Half> high() const { return m_high; }
+
+  friend mask_v operator&(mask_v a, mask_v b) {
+    return mask_v(a.low() & b.low(), a.high() & b.high());
+  }
+
+  friend mask_v operator|(mask_v a, mask_v b) {
+    return mask_v(a.low() | b.low(), a.high() | b.high());
+  }
+
+  friend mask_v operator^(mask_v a, mask_v b) {
+    return mask_v(a.low() ^ b.low(), a.high() ^ b.high());
+  }
+
+  friend mask_v operator!(mask_v a) {
+    return mask_v(!a.low(), !a.high());
+  }
+
+  /* One bit per lane, the first lane is the lowest bit. */
+  uint64_t bits() const {
+    return m_low.bits() | (m_high.bits() << N_Half);
+  }
+
+  bool any() const { return m_low.any() || m_high.any(); }
+  bool all() const { return m_low.all() && m_high.all(); }
+};
+
+template <> class mask_v<1> {
+ private:
+  bool m_value;
+
+ public:
+  mask_v() = default;
+  mask_v(bool value) : m_value(value) {}
+
+  bool value() const { return m_value; }
+
+  friend mask_v operator&(mask_v a, mask_v b) {
+    return a.value() && b.value();
+  }
+
+  friend mask_v operator|(mask_v a, mask_v b) {
+    return a.value() || b.value();
+  }
+
+  friend mask_v operator^(mask_v a, mask_v b) {
+    return a.value() != b.value();
+  }
+
+  friend mask_v operator!(mask_v a) { return !a.value(); }
+
+  uint64_t bits() const { return m_value ? 1 : 0; }
+  bool any() const { return m_value; }
+  bool all() const { return m_value; }
+};
+
+#ifdef SIMD_HAS_SSE41
+/* Every lane has either all or no bits set. */
+template <> class mask_v<4> {
+ private:
+  __m128 m_value;
+
+ public:
+  mask_v() = default;
+  mask_v(__m128 v) : m_value(v) {}
+  mask_v(__m128i v) : m_value(_mm_castsi128_ps(v)) {}
+  mask_v(bool value)
+      : m_value(_mm_castsi128_ps(_mm_set1_epi32(value ? -1 : 0))) {}
+
+  __m128 m128() const { return m_value; }
+  __m128i m128i() const { return _mm_castps_si128(m_value); }
+
+  friend mask_v operator&(mask_v a, mask_v b) {
+    return _mm_and_ps(a.m128(), b.m128());
+  }
+
+  friend mask_v operator|(mask_v a, mask_v b) {
+    return _mm_or_ps(a.m128(), b.m128());
+  }
+
+  friend mask_v operator^(mask_v a, mask_v b) {
+    return _mm_xor_ps(a.m128(), b.m128());
+  }
+
+  friend mask_v operator!(mask_v a) { return a ^ mask_v(true); }
+
+  uint64_t bits() const { return _mm_movemask_ps(m_value); }
+  bool any() const { return this->bits() != 0; }
+  bool all() const { return this->bits() == 0xf; }
+};
+#endif /* SIMD_HAS_SSE41 */
+
+#ifdef SIMD_HAS_AVX2
+template <> class mask_v<8> {
+ private:
+  __m256 m_value;
+
+ public:
+  mask_v() = default;
+  mask_v(__m256 v) : m_value(v) {}
+  mask_v(__m256i v) : m_value(_mm256_castsi256_ps(v)) {}
+  mask_v(bool value)
+      : m_value(
+            _mm256_castsi256_ps(_mm256_set1_epi32(value ? -1 : 0))) {}
+
+  __m256 m256() const { return m_value; }
+  __m256i m256i() const { return _mm256_castps_si256(m_value); }
+
+  friend mask_v operator&(mask_v a, mask_v b) {
+    return _mm256_and_ps(a.m256(), b.m256());
+  }
+
+  friend mask_v operator|(mask_v a, mask_v b) {
+    return _mm256_or_ps(a.m256(), b.m256());
+  }
+
+  friend mask_v operator^(mask_v a, mask_v b) {
+    return _mm256_xor_ps(a.m256(), b.m256());
+  }
+
+  friend mask_v operator!(mask_v a) { return a ^ mask_v(true); }
+
+  uint64_t bits() const { return _mm256_movemask_ps(m_value); }
+  bool any() const { return this->bits() != 0; }
+  bool all() const { return this->bits() == 0xff; }
+};
+#endif /* SIMD_HAS_AVX2 */
+
+#ifdef SIMD_HAS_AVX512
+/* Uses the native mask registers, one bit per lane. */
+template <> class mask_v<16> {
+ private:
+  __mmask16 m_value;
+
+ public:
+  mask_v() = default;
+  mask_v(__mmask16 v) : m_value(v) {}
+  mask_v(bool value) : m_value(value ? 0xffff : 0) {}
+
+  __mmask16 mmask16() const { return m_value; }
+
+  friend mask_v operator&(mask_v a, mask_v b) {
+    return _kand_mask16(a.mmask16(), b.mmask16());
+  }
+
+  friend mask_v operator|(mask_v a, mask_v b) {
+    return _kor_mask16(a.mmask16(), b.mmask16());
+  }
+
+  friend mask_v operator^(mask_v a, mask_v b) {
+    return _kxor_mask16(a.mmask16(), b.mmask16());
+  }
+
+  friend mask_v operator!(mask_v a) {
+    return _knot_mask16(a.mmask16());
+  }
+
+  uint64_t bits() const { return m_value; }
+  bool any() const { return m_value != 0; }
+  bool all() const { return m_value == 0xffff; }
+};
+#endif /* SIMD_HAS_AVX512 */
 
 template <unsigned int N> class float_v {
   static const int N_Half = N / 2;
@@ -24,11 +249,71 @@ template <unsigned int N> class float_v {
   float_v(float value) : m_low(value), m_high(value) {}
   float_v(float_v<N_Half> low, float_v<N_Half> high)
       : m_low(low), m_high(high) {}
-  float_v(float *values) : m_low(values), m_high(values + N_Half) {}
+  float_v(float v0, float v1) : m_low(v0), m_high(v1) {}
+  float_v(float v0, float v1, float v2, float v3)
+      : m_low(v0, v1), m_high(v2, v3) {}
+  float_v(float v0, float v1, float v2, float v3, float v4, float v5,
+          float v6, float v7)
+      : m_low(v0, v1, v2, v3), m_high(v4, v5, v6, v7) {}
+  float_v(const float *values)
+      : m_low(values), m_high(values + N_Half) {}
 
   float_v<N_Half> low() const { return m_low; }
   float_v<N_Half> high() const { return m_high; }
 
+  static float_v load(const float *src) {
+    return float_v(float_v<N_Half>::load(src),
+                float_v<N_Half>::load(src + N_Half));
+  }
+
+  static float_v loadu(const float *src) {
+    return float_v(float_v<N_Half>::loadu(src),
+                float_v<N_Half>::loadu(src + N_Half));
+  }
+
+  /* Load the first `count` lanes, the remaining lanes are zero. */
+  static float_v load_partial(const float *src, unsigned int count) {
+    if (count <= N_Half) {
+      return float_v(float_v<N_Half>::load_partial(src, count),
+                  float_v<N_Half>(0.0f));
+    }
+    return float_v(float_v<N_Half>::loadu(src),
+                float_v<N_Half>::load_partial(src + N_Half,
+                                           count - N_Half));
+  }
+
+  static float_v gather(const float *base, int32_v<N> indices) {
+    return float_v(float_v<N_Half>::gather(base, indices.low()),
+                float_v<N_Half>::gather(base, indices.high()));
+  }
+
+  void store(float *dst) const {
+    m_low.store(dst);
+    m_high.store(dst + N_Half);
+  }
+
+  void storeu(float *dst) const {
+    m_low.storeu(dst);
+    m_high.storeu(dst + N_Half);
+  }
+
+  /* Store only the first `count` lanes. */
+  void store_partial(float *dst, unsigned int count) const {
+    if (count <= N_Half) {
+      m_low.store_partial(dst, count);
+    } else {
+      m_low.storeu(dst);
+      m_high.store_partial(dst + N_Half, count - N_Half);
+    }
+  }
+
+  /* Store the lanes as IEEE half precision values, rounded to
+   * nearest even. */
+  void store_float16(uint16_t *dst) const {
+    m_low.store_float16(dst);
+    m_high.store_float16(dst + N_Half);
+  }
+
   friend float_v operator+(float_v a, float_v b) {
     return float_v(a.low() + b.low(), a.high() + b.high());
   }
@@ -41,6 +326,83 @@ template <unsigned int N> class float_v {
     return float_v(a.low() * b.low(), a.high() * b.high());
   }
 
+  /* a * b + c */
+  friend float_v fmadd(float_v a, float_v b, float_v c) {
+    return float_v(fmadd(a.low(), b.low(), c.low()),
+                   fmadd(a.high(), b.high(), c.high()));
+  }
+
+  /* a * b - c */
+  friend float_v fmsub(float_v a, float_v b, float_v c) {
+    return float_v(fmsub(a.low(), b.low(), c.low()),
+                   fmsub(a.high(), b.high(), c.high()));
+  }
+
+  /* c - a * b */
+  friend float_v fnmadd(float_v a, float_v b, float_v c) {
+    return float_v(fnmadd(a.low(), b.low(), c.low()),
+                   fnmadd(a.high(), b.high(), c.high()));
+  }
+
+  friend mask_v<N> operator<(float_v a, float_v b) {
+    return mask_v<N>(a.low() < b.low(), a.high() < b.high());
+  }
+
+  friend mask_v<N> operator<=(float_v a, float_v b) {
+    return mask_v<N>(a.low() <= b.low(), a.high() <= b.high());
+  }
+
+  friend mask_v<N> operator>(float_v a, float_v b) {
+    return mask_v<N>(a.low() > b.low(), a.high() > b.high());
+  }
+
+  friend mask_v<N> operator>=(float_v a, float_v b) {
+    return mask_v<N>(a.low() >= b.low(), a.high() >= b.high());
+  }
+
+  friend mask_v<N> operator==(float_v a, float_v b) {
+    return mask_v<N>(a.low() == b.low(), a.high() == b.high());
+  }
+
+  friend mask_v<N> operator!=(float_v a, float_v b) {
+    return mask_v<N>(a.low() != b.low(), a.high() != b.high());
+  }
+
+  friend float_v operator&(float_v a, float_v b) {
+    return float_v(a.low() & b.low(), a.high() & b.high());
+  }
+
+  friend float_v operator|(float_v a, float_v b) {
+    return float_v(a.low() | b.low(), a.high() | b.high());
+  }
+
+  friend float_v andnot(float_v a, float_v b) {
+    return float_v(andnot(a.low(), b.low()),
+                   andnot(a.high(), b.high()));
+  }
+
+  friend float_v min(float_v a, float_v b) {
+    return float_v(min(a.low(), b.low()), min(a.high(), b.high()));
+  }
+
+  friend float_v max(float_v a, float_v b) {
+    return float_v(max(a.low(), b.low()), max(a.high(), b.high()));
+  }
+
+  /* Lanes of `a` where the mask is set, lanes of `b` otherwise. */
+  friend float_v select(mask_v<N> mask, float_v a, float_v b) {
+    return float_v(select(mask.low(), a.low(), b.low()),
+                   select(mask.high(), a.high(), b.high()));
+  }
+
+  friend float_v abs(float_v a) {
+    return float_v(abs(a.low()), abs(a.high()));
+  }
+
+  friend float_v sqrt(float_v a) {
+    return float_v(sqrt(a.low()), sqrt(a.high()));
+  }
+
   float_v floor() const {
     return float_v(m_low.floor(), m_high.floor());
   }
@@ -60,11 +422,14 @@ template <unsigned int N> class float_v {
 
   template <int Index> float get() const {
     static_assert(Index < N, "invalid index");
+    /* Both branches are instantiated, so the index is clamped to a
+     * valid value in the branch that is not taken. */
+    const int LowIndex = Index < N_Half ? Index : 0;
+    const int HighIndex = Index < N_Half ? 0 : Index - N_Half;
     if (Index < N_Half) {
-      return m_low.get<Index>();
+      return m_low.template get<LowIndex>();
     } else {
-      return m_high.get < Index - N_Half < 0 ? 0
-                                             : Index - N_Half > ();
+      return m_high.template get<HighIndex>();
     }
   }
 };
@@ -73,13 +438,45 @@ template <> class float_v<1> {
  private:
   float m_value;
 
+  static uint32_t to_bits(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+  }
+
+  static float from_bits(uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
  public:
   float_v() = default;
   float_v(float value) : m_value(value) {}
-  float_v(float *values) : m_value(values[0]) {}
+  float_v(const float *values) : m_value(values[0]) {}
 
   float value() const { return m_value; }
 
+  static float_v load(const float *src) { return src[0]; }
+  static float_v loadu(const float *src) { return src[0]; }
+
+  static float_v load_partial(const float *src, unsigned int count) {
+    return count > 0 ? src[0] : 0.0f;
+  }
+
+  static float_v gather(const float *base, int32_v<1> indices);
+
+  void store(float *dst) const { dst[0] = m_value; }
+  void storeu(float *dst) const { dst[0] = m_value; }
+
+  void store_partial(float *dst, unsigned int count) const {
+    if (count > 0) {
+      dst[0] = m_value;
+    }
+  }
+
+  void store_float16(uint16_t *dst) const;
+
   friend float_v operator+(float_v a, float_v b) {
     return a.value() + b.value();
   }
@@ -90,8 +487,75 @@ template <> class float_v<1> {
     return a.value() - b.value();
   }
 
-  float_v floor() const { return std::floorf(m_value); }
-  float_v ceil() const { return std::ceilf(m_value); }
+  /* Without hardware support, std::fma is much slower than a separate
+   * multiply and add, so those are used instead. */
+  friend float_v fmadd(float_v a, float_v b, float_v c) {
+    return a.value() * b.value() + c.value();
+  }
+
+  friend float_v fmsub(float_v a, float_v b, float_v c) {
+    return a.value() * b.value() - c.value();
+  }
+
+  friend float_v fnmadd(float_v a, float_v b, float_v c) {
+    return c.value() - a.value() * b.value();
+  }
+
+  friend mask_v<1> operator<(float_v a, float_v b) {
+    return a.value() < b.value();
+  }
+
+  friend mask_v<1> operator<=(float_v a, float_v b) {
+    return a.value() <= b.value();
+  }
+
+  friend mask_v<1> operator>(float_v a, float_v b) {
+    return a.value() > b.value();
+  }
+
+  friend mask_v<1> operator>=(float_v a, float_v b) {
+    return a.value() >= b.value();
+  }
+
+  friend mask_v<1> operator==(float_v a, float_v b) {
+    return a.value() == b.value();
+  }
+
+  friend mask_v<1> operator!=(float_v a, float_v b) {
+    return a.value() != b.value();
+  }
+
+  friend float_v operator&(float_v a, float_v b) {
+    return from_bits(to_bits(a.value()) & to_bits(b.value()));
+  }
+
+  friend float_v operator|(float_v a, float_v b) {
+    return from_bits(to_bits(a.value()) | to_bits(b.value()));
+  }
+
+  /* Bits of `a` that are not set in `b`. */
+  friend float_v andnot(float_v a, float_v b) {
+    return from_bits(to_bits(a.value()) & ~to_bits(b.value()));
+  }
+
+  friend float_v min(float_v a, float_v b) {
+    return a.value() < b.value() ? a.value() : b.value();
+  }
+
+  friend float_v max(float_v a, float_v b) {
+    return a.value() > b.value() ? a.value() : b.value();
+  }
+
+  friend float_v abs(float_v a) { return std::abs(a.value()); }
+
+  friend float_v sqrt(float_v a) { return std::sqrt(a.value()); }
+
+  friend float_v select(mask_v<1> mask, float_v a, float_v b) {
+    return mask.value() ? a : b;
+  }
+
+  float_v floor() const { return std::floor(m_value); }
+  float_v ceil() const { return std::ceil(m_value); }
 
   int32_v<1> as_int32() const;
   int32_v<1> cast_to_int32() const;
@@ -102,12 +566,13 @@ template <> class float_v<1> {
     return stream;
   }
 
-  template <int Index> float get() {
+  template <int Index> float get() const {
     static_assert(Index == 0, "invalid index");
     return m_value;
   }
 };
 
+#ifdef SIMD_HAS_SSE41
 template <> class float_v<4> {
  private:
   __m128 m_value;
@@ -118,11 +583,38 @@ template <> class float_v<4> {
   float_v(float v) : m_value(_mm_set_ps1(v)) {}
   float_v(float v0, float v1, float v2, float v3)
       : m_value(_mm_set_ps(v3, v2, v1, v0)) {}
-  float_v(float *values)
-      : float_v(values[0], values[1], values[2], values[3]) {}
+  float_v(const float *values) : m_value(_mm_loadu_ps(values)) {}
 
   __m128 m128() const { return m_value; }
 
+  static float_v load(const float *src) { return _mm_load_ps(src); }
+  static float_v loadu(const float *src) { return _mm_loadu_ps(src); }
+
+  /* SSE has no masked loads and stores, so the tails go through a
+   * temporary buffer. */
+  static float_v load_partial(const float *src, unsigned int count) {
+    float values[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    for (unsigned int i = 0; i < count && i < 4; i++) {
+      values[i] = src[i];
+    }
+    return _mm_loadu_ps(values);
+  }
+
+  static float_v gather(const float *base, int32_v<4> indices);
+
+  void store(float *dst) const { _mm_store_ps(dst, m_value); }
+  void storeu(float *dst) const { _mm_storeu_ps(dst, m_value); }
+
+  void store_partial(float *dst, unsigned int count) const {
+    float values[4];
+    _mm_storeu_ps(values, m_value);
+    for (unsigned int i = 0; i < count && i < 4; i++) {
+      dst[i] = values[i];
+    }
+  }
+
+  void store_float16(uint16_t *dst) const;
+
   friend float_v operator+(float_v a, float_v b) {
     return _mm_add_ps(a.m128(), b.m128());
   }
@@ -135,6 +627,85 @@ template <> class float_v<4> {
     return _mm_sub_ps(a.m128(), b.m128());
   }
 
+#ifdef SIMD_HAS_FMA
+  friend float_v fmadd(float_v a, float_v b, float_v c) {
+    return _mm_fmadd_ps(a.m128(), b.m128(), c.m128());
+  }
+
+  friend float_v fmsub(float_v a, float_v b, float_v c) {
+    return _mm_fmsub_ps(a.m128(), b.m128(), c.m128());
+  }
+
+  friend float_v fnmadd(float_v a, float_v b, float_v c) {
+    return _mm_fnmadd_ps(a.m128(), b.m128(), c.m128());
+  }
+#else
+  friend float_v fmadd(float_v a, float_v b, float_v c) {
+    return a * b + c;
+  }
+
+  friend float_v fmsub(float_v a, float_v b, float_v c) {
+    return a * b - c;
+  }
+
+  friend float_v fnmadd(float_v a, float_v b, float_v c) {
+    return c - a * b;
+  }
+#endif
+
+  friend mask_v<4> operator<(float_v a, float_v b) {
+    return _mm_cmplt_ps(a.m128(), b.m128());
+  }
+
+  friend mask_v<4> operator<=(float_v a, float_v b) {
+    return _mm_cmple_ps(a.m128(), b.m128());
+  }
+
+  friend mask_v<4> operator>(float_v a, float_v b) {
+    return _mm_cmpgt_ps(a.m128(), b.m128());
+  }
+
+  friend mask_v<4> operator>=(float_v a, float_v b) {
+    return _mm_cmpge_ps(a.m128(), b.m128());
+  }
+
+  friend mask_v<4> operator==(float_v a, float_v b) {
+    return _mm_cmpeq_ps(a.m128(), b.m128());
+  }
+
+  friend mask_v<4> operator!=(float_v a, float_v b) {
+    return _mm_cmpneq_ps(a.m128(), b.m128());
+  }
+
+  friend float_v operator&(float_v a, float_v b) {
+    return _mm_and_ps(a.m128(), b.m128());
+  }
+
+  friend float_v operator|(float_v a, float_v b) {
+    return _mm_or_ps(a.m128(), b.m128());
+  }
+
+  /* Bits of `a` that are not set in `b`. */
+  friend float_v andnot(float_v a, float_v b) {
+    return _mm_andnot_ps(b.m128(), a.m128());
+  }
+
+  friend float_v min(float_v a, float_v b) {
+    return _mm_min_ps(a.m128(), b.m128());
+  }
+
+  friend float_v max(float_v a, float_v b) {
+    return _mm_max_ps(a.m128(), b.m128());
+  }
+
+  friend float_v abs(float_v a) { return andnot(a, float_v(-0.0f)); }
+
+  friend float_v sqrt(float_v a) { return _mm_sqrt_ps(a.m128()); }
+
+  friend float_v select(mask_v<4> mask, float_v a, float_v b) {
+    return _mm_blendv_ps(b.m128(), a.m128(), mask.m128());
+  }
+
   float_v floor() const { return _mm_floor_ps(m_value); }
   float_v ceil() const { return _mm_ceil_ps(m_value); }
 
@@ -156,6 +727,9 @@ template <> class float_v<4> {
   }
 };
 
+#endif /* SIMD_HAS_SSE41 */
+
+#ifdef SIMD_HAS_AVX2
 template <> class float_v<8> {
  private:
   __m256 m_value;
@@ -169,12 +743,39 @@ template <> class float_v<8> {
   float_v(float v0, float v1, float v2, float v3, float v4, float v5,
           float v6, float v7)
       : m_value(_mm256_set_ps(v7, v6, v5, v4, v3, v2, v1, v0)) {}
-  float_v(float *values)
-      : float_v(values[0], values[1], values[2], values[3], values[4],
-                values[5], values[6], values[7]) {}
+  float_v(const float *values) : m_value(_mm256_loadu_ps(values)) {}
 
   __m256 m256() const { return m_value; }
 
+  /* Lanes below `count` have all bits set. */
+  static __m256i first_lanes(unsigned int count) {
+    __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    return _mm256_cmpgt_epi32(_mm256_set1_epi32((int)count), lanes);
+  }
+
+  static float_v load(const float *src) {
+    return _mm256_load_ps(src);
+  }
+
+  static float_v loadu(const float *src) {
+    return _mm256_loadu_ps(src);
+  }
+
+  static float_v load_partial(const float *src, unsigned int count) {
+    return _mm256_maskload_ps(src, first_lanes(count));
+  }
+
+  static float_v gather(const float *base, int32_v<8> indices);
+
+  void store(float *dst) const { _mm256_store_ps(dst, m_value); }
+  void storeu(float *dst) const { _mm256_storeu_ps(dst, m_value); }
+
+  void store_partial(float *dst, unsigned int count) const {
+    _mm256_maskstore_ps(dst, first_lanes(count), m_value);
+  }
+
+  void store_float16(uint16_t *dst) const;
+
   friend float_v operator+(float_v a, float_v b) {
     return _mm256_add_ps(a.m256(), b.m256());
   }
@@ -187,6 +788,85 @@ template <> class float_v<8> {
     return _mm256_sub_ps(a.m256(), b.m256());
   }
 
+#ifdef SIMD_HAS_FMA
+  friend float_v fmadd(float_v a, float_v b, float_v c) {
+    return _mm256_fmadd_ps(a.m256(), b.m256(), c.m256());
+  }
+
+  friend float_v fmsub(float_v a, float_v b, float_v c) {
+    return _mm256_fmsub_ps(a.m256(), b.m256(), c.m256());
+  }
+
+  friend float_v fnmadd(float_v a, float_v b, float_v c) {
+    return _mm256_fnmadd_ps(a.m256(), b.m256(), c.m256());
+  }
+#else
+  friend float_v fmadd(float_v a, float_v b, float_v c) {
+    return a * b + c;
+  }
+
+  friend float_v fmsub(float_v a, float_v b, float_v c) {
+    return a * b - c;
+  }
+
+  friend float_v fnmadd(float_v a, float_v b, float_v c) {
+    return c - a * b;
+  }
+#endif
+
+  friend mask_v<8> operator<(float_v a, float_v b) {
+    return _mm256_cmp_ps(a.m256(), b.m256(), _CMP_LT_OQ);
+  }
+
+  friend mask_v<8> operator<=(float_v a, float_v b) {
+    return _mm256_cmp_ps(a.m256(), b.m256(), _CMP_LE_OQ);
+  }
+
+  friend mask_v<8> operator>(float_v a, float_v b) {
+    return _mm256_cmp_ps(a.m256(), b.m256(), _CMP_GT_OQ);
+  }
+
+  friend mask_v<8> operator>=(float_v a, float_v b) {
+    return _mm256_cmp_ps(a.m256(), b.m256(), _CMP_GE_OQ);
+  }
+
+  friend mask_v<8> operator==(float_v a, float_v b) {
+    return _mm256_cmp_ps(a.m256(), b.m256(), _CMP_EQ_OQ);
+  }
+
+  friend mask_v<8> operator!=(float_v a, float_v b) {
+    return _mm256_cmp_ps(a.m256(), b.m256(), _CMP_NEQ_UQ);
+  }
+
+  friend float_v operator&(float_v a, float_v b) {
+    return _mm256_and_ps(a.m256(), b.m256());
+  }
+
+  friend float_v operator|(float_v a, float_v b) {
+    return _mm256_or_ps(a.m256(), b.m256());
+  }
+
+  /* Bits of `a` that are not set in `b`. */
+  friend float_v andnot(float_v a, float_v b) {
+    return _mm256_andnot_ps(b.m256(), a.m256());
+  }
+
+  friend float_v min(float_v a, float_v b) {
+    return _mm256_min_ps(a.m256(), b.m256());
+  }
+
+  friend float_v max(float_v a, float_v b) {
+    return _mm256_max_ps(a.m256(), b.m256());
+  }
+
+  friend float_v abs(float_v a) { return andnot(a, float_v(-0.0f)); }
+
+  friend float_v sqrt(float_v a) { return _mm256_sqrt_ps(a.m256()); }
+
+  friend float_v select(mask_v<8> mask, float_v a, float_v b) {
+    return _mm256_blendv_ps(b.m256(), a.m256(), mask.m256());
+  }
+
   float_v<4> low() const { return _mm256_extractf128_ps(m_value, 0); }
 
   float_v<4> high() const {
@@ -211,12 +891,170 @@ template <> class float_v<8> {
 
   template <int Index> float get() const {
     static_assert(Index < 8, "invalid index");
-    float array[8];
-    _mm256_store_ps(array, m_value);
-    return array[Index];
+    float_v<4> half = _mm256_extractf128_ps(m_value, Index / 4);
+    return half.template get<Index % 4>();
   }
 };
 
+#endif /* SIMD_HAS_AVX2 */
+
+#ifdef SIMD_HAS_AVX512
+template <> class float_v<16> {
+ private:
+  __m512 m_value;
+
+ public:
+  float_v() = default;
+  float_v(__m512 v) : m_value(v) {}
+  float_v(float_v<8> low, float_v<8> high)
+      : m_value(_mm512_insertf32x8(
+            _mm512_castps256_ps512(low.m256()), high.m256(), 1)) {}
+  float_v(float v) : m_value(_mm512_set1_ps(v)) {}
+  float_v(const float *values) : m_value(_mm512_loadu_ps(values)) {}
+
+  __m512 m512() const { return m_value; }
+
+  static __mmask16 first_lanes(unsigned int count) {
+    return count >= 16 ? 0xffff : (__mmask16)((1u << count) - 1);
+  }
+
+  static float_v load(const float *src) {
+    return _mm512_load_ps(src);
+  }
+
+  static float_v loadu(const float *src) {
+    return _mm512_loadu_ps(src);
+  }
+
+  static float_v load_partial(const float *src, unsigned int count) {
+    return _mm512_maskz_loadu_ps(first_lanes(count), src);
+  }
+
+  static float_v gather(const float *base, int32_v<16> indices);
+
+  void store(float *dst) const { _mm512_store_ps(dst, m_value); }
+  void storeu(float *dst) const { _mm512_storeu_ps(dst, m_value); }
+
+  void store_partial(float *dst, unsigned int count) const {
+    _mm512_mask_storeu_ps(dst, first_lanes(count), m_value);
+  }
+
+  void store_float16(uint16_t *dst) const;
+
+  friend float_v operator+(float_v a, float_v b) {
+    return _mm512_add_ps(a.m512(), b.m512());
+  }
+
+  friend float_v operator*(float_v a, float_v b) {
+    return _mm512_mul_ps(a.m512(), b.m512());
+  }
+
+  friend float_v operator-(float_v a, float_v b) {
+    return _mm512_sub_ps(a.m512(), b.m512());
+  }
+
+  friend float_v fmadd(float_v a, float_v b, float_v c) {
+    return _mm512_fmadd_ps(a.m512(), b.m512(), c.m512());
+  }
+
+  friend float_v fmsub(float_v a, float_v b, float_v c) {
+    return _mm512_fmsub_ps(a.m512(), b.m512(), c.m512());
+  }
+
+  friend float_v fnmadd(float_v a, float_v b, float_v c) {
+    return _mm512_fnmadd_ps(a.m512(), b.m512(), c.m512());
+  }
+
+  friend mask_v<16> operator<(float_v a, float_v b) {
+    return _mm512_cmp_ps_mask(a.m512(), b.m512(), _CMP_LT_OQ);
+  }
+
+  friend mask_v<16> operator<=(float_v a, float_v b) {
+    return _mm512_cmp_ps_mask(a.m512(), b.m512(), _CMP_LE_OQ);
+  }
+
+  friend mask_v<16> operator>(float_v a, float_v b) {
+    return _mm512_cmp_ps_mask(a.m512(), b.m512(), _CMP_GT_OQ);
+  }
+
+  friend mask_v<16> operator>=(float_v a, float_v b) {
+    return _mm512_cmp_ps_mask(a.m512(), b.m512(), _CMP_GE_OQ);
+  }
+
+  friend mask_v<16> operator==(float_v a, float_v b) {
+    return _mm512_cmp_ps_mask(a.m512(), b.m512(), _CMP_EQ_OQ);
+  }
+
+  friend mask_v<16> operator!=(float_v a, float_v b) {
+    return _mm512_cmp_ps_mask(a.m512(), b.m512(), _CMP_NEQ_UQ);
+  }
+
+  friend float_v operator&(float_v a, float_v b) {
+    return _mm512_and_ps(a.m512(), b.m512());
+  }
+
+  friend float_v operator|(float_v a, float_v b) {
+    return _mm512_or_ps(a.m512(), b.m512());
+  }
+
+  /* Bits of `a` that are not set in `b`. */
+  friend float_v andnot(float_v a, float_v b) {
+    return _mm512_andnot_ps(b.m512(), a.m512());
+  }
+
+  friend float_v min(float_v a, float_v b) {
+    return _mm512_min_ps(a.m512(), b.m512());
+  }
+
+  friend float_v max(float_v a, float_v b) {
+    return _mm512_max_ps(a.m512(), b.m512());
+  }
+
+  friend float_v abs(float_v a) { return _mm512_abs_ps(a.m512()); }
+
+  friend float_v sqrt(float_v a) { return _mm512_sqrt_ps(a.m512()); }
+
+  friend float_v select(mask_v<16> mask, float_v a, float_v b) {
+    return _mm512_mask_blend_ps(mask.mmask16(), b.m512(), a.m512());
+  }
+
+  float_v<8> low() const { return _mm512_castps512_ps256(m_value); }
+
+  float_v<8> high() const {
+    return _mm512_extractf32x8_ps(m_value, 1);
+  }
+
+  float_v floor() const {
+    return _mm512_roundscale_ps(
+        m_value, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+  }
+
+  float_v ceil() const {
+    return _mm512_roundscale_ps(
+        m_value, _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC);
+  }
+
+  int32_v<16> as_int32() const;
+  int32_v<16> cast_to_int32() const;
+
+  friend std::ostream &operator<<(std::ostream &stream, float_v v) {
+    stream << "(" << v.low() << ", " << v.high() << ")";
+    return stream;
+  }
+
+  template <int Index> float get() const {
+    static_assert(Index < 16, "invalid index");
+    const int LowIndex = Index < 8 ? Index : 0;
+    const int HighIndex = Index < 8 ? 0 : Index - 8;
+    if (Index < 8) {
+      return low().template get<LowIndex>();
+    } else {
+      return high().template get<HighIndex>();
+    }
+  }
+};
+#endif /* SIMD_HAS_AVX512 */
+
 template <unsigned int N> class int32_v {
  private:
   static const int N_Half = N / 2;
@@ -228,76 +1066,315 @@ template <unsigned int N> class int32_v {
  public:
   int32_v() = default;
   int32_v(int32_t v) : m_low(v), m_high(v) {}
+  int32_v(int32_t v0, int32_t v1) : m_low(v0), m_high(v1) {}
+  int32_v(int32_t v0, int32_t v1, int32_t v2, int32_t v3)
+      : m_low(v0, v1), m_high(v2, v3) {}
+  int32_v(int32_t v0, int32_t v1, int32_t v2, int32_t v3, int32_t v4,
+          int32_t v5, int32_t v6, int32_t v7)
+      : m_low(v0, v1, v2, v3), m_high(v4, v5, v6, v7) {}
   int32_v(int32_v<N_Half> low, int32_v<N_Half> high)
       : m_low(low), m_high(high) {}
+  int32_v(const int32_t *values)
+      : m_low(values), m_high(values + N_Half) {}
 
   int32_v<N_Half> low() const { return m_low; }
   int32_v<N_Half> high() const { return m_high; }
 
+  static int32_v load(const int32_t *src) {
+    return int32_v(int32_v<N_Half>::load(src),
+                int32_v<N_Half>::load(src + N_Half));
+  }
+
+  static int32_v loadu(const int32_t *src) {
+    return int32_v(int32_v<N_Half>::loadu(src),
+                int32_v<N_Half>::loadu(src + N_Half));
+  }
+
+  /* Load the first `count` lanes, the remaining lanes are zero. */
+  static int32_v load_partial(const int32_t *src,
+                               unsigned int count) {
+    if (count <= N_Half) {
+      return int32_v(int32_v<N_Half>::load_partial(src, count),
+                  int32_v<N_Half>(0));
+    }
+    return int32_v(int32_v<N_Half>::loadu(src),
+                int32_v<N_Half>::load_partial(src + N_Half,
+                                           count - N_Half));
+  }
+
+  static int32_v gather(const int32_t *base, int32_v<N> indices) {
+    return int32_v(int32_v<N_Half>::gather(base, indices.low()),
+                int32_v<N_Half>::gather(base, indices.high()));
+  }
+
+  void store(int32_t *dst) const {
+    m_low.store(dst);
+    m_high.store(dst + N_Half);
+  }
+
+  void storeu(int32_t *dst) const {
+    m_low.storeu(dst);
+    m_high.storeu(dst + N_Half);
+  }
+
+  /* Store only the first `count` lanes. */
+  void store_partial(int32_t *dst, unsigned int count) const {
+    if (count <= N_Half) {
+      m_low.store_partial(dst, count);
+    } else {
+      m_low.storeu(dst);
+      m_high.store_partial(dst + N_Half, count - N_Half);
+    }
+  }
+
+  /* Store the lanes as 16 or 8 bit unsigned integers. The lanes have
+   * to be within the range of the smaller type. */
+  void store_uint16(uint16_t *dst) const {
+    m_low.store_uint16(dst);
+    m_high.store_uint16(dst + N_Half);
+  }
+
+  void store_uint8(uint8_t *dst) const {
+    m_low.store_uint8(dst);
+    m_high.store_uint8(dst + N_Half);
+  }
+
   friend int32_v operator+(int32_v a, int32_v b) {
     return int32_v(a.low() + b.low(), a.high() + b.high());
   }
 
-  friend int32_v operator-(int32_v a, int32_v b) {
-    return int32_v(a.low() - b.low(), a.high() - b.high());
+  friend int32_v operator-(int32_v a, int32_v b) {
+    return int32_v(a.low() - b.low(), a.high() - b.high());
+  }
+
+  friend int32_v operator*(int32_v a, int32_v b) {
+    return int32_v(a.low() * b.low(), a.high() * b.high());
+  }
+
+  friend int32_v operator^(int32_v a, int32_v b) {
+    return int32_v(a.low() ^ b.low(), a.high() ^ b.high());
+  }
+
+  friend mask_v<N> operator<(int32_v a, int32_v b) {
+    return mask_v<N>(a.low() < b.low(), a.high() < b.high());
+  }
+
+  friend mask_v<N> operator<=(int32_v a, int32_v b) {
+    return mask_v<N>(a.low() <= b.low(), a.high() <= b.high());
+  }
+
+  friend mask_v<N> operator>(int32_v a, int32_v b) {
+    return mask_v<N>(a.low() > b.low(), a.high() > b.high());
+  }
+
+  friend mask_v<N> operator>=(int32_v a, int32_v b) {
+    return mask_v<N>(a.low() >= b.low(), a.high() >= b.high());
+  }
+
+  friend mask_v<N> operator==(int32_v a, int32_v b) {
+    return mask_v<N>(a.low() == b.low(), a.high() == b.high());
+  }
+
+  friend mask_v<N> operator!=(int32_v a, int32_v b) {
+    return mask_v<N>(a.low() != b.low(), a.high() != b.high());
+  }
+
+  friend int32_v operator&(int32_v a, int32_v b) {
+    return int32_v(a.low() & b.low(), a.high() & b.high());
+  }
+
+  friend int32_v operator|(int32_v a, int32_v b) {
+    return int32_v(a.low() | b.low(), a.high() | b.high());
+  }
+
+  friend int32_v andnot(int32_v a, int32_v b) {
+    return int32_v(andnot(a.low(), b.low()),
+                   andnot(a.high(), b.high()));
+  }
+
+  friend int32_v min(int32_v a, int32_v b) {
+    return int32_v(min(a.low(), b.low()), min(a.high(), b.high()));
+  }
+
+  friend int32_v max(int32_v a, int32_v b) {
+    return int32_v(max(a.low(), b.low()), max(a.high(), b.high()));
+  }
+
+  /* Lanes of `a` where the mask is set, lanes of `b` otherwise. */
+  friend int32_v select(mask_v<N> mask, int32_v a, int32_v b) {
+    return int32_v(select(mask.low(), a.low(), b.low()),
+                   select(mask.high(), a.high(), b.high()));
+  }
+
+  friend int32_v abs(int32_v a) {
+    return int32_v(abs(a.low()), abs(a.high()));
+  }
+
+  template <unsigned int Count> int32_v shift_left() const {
+    return int32_v(m_low.template shift_left<Count>(),
+                   m_high.template shift_left<Count>());
+  }
+
+  template <unsigned int Count> int32_v shift_right() const {
+    return int32_v(m_low.template shift_right<Count>(),
+                   m_high.template shift_right<Count>());
+  }
+
+  template <unsigned int Count>
+  int32_v shift_right_arithmetic() const {
+    return int32_v(m_low.template shift_right_arithmetic<Count>(),
+                   m_high.template shift_right_arithmetic<Count>());
+  }
+
+  template <unsigned int Count> int32_v rotate() const {
+    return int32_v(m_low.template rotate<Count>(),
+                   m_high.template rotate<Count>());
+  }
+
+  float_v<N> as_float() const {
+    return float_v<N>(m_low.as_float(), m_high.as_float());
+  }
+
+  friend std::ostream &operator<<(std::ostream &stream, int32_v v) {
+    stream << "(" << v.low() << ", " << v.high() << ")";
+    return stream;
+  }
+
+  template <int Index> int32_t get() const {
+    static_assert(Index < N, "invalid index");
+    /* Both branches are instantiated, so the index is clamped to a
+     * valid value in the branch that is not taken. */
+    const int LowIndex = Index < N_Half ? Index : 0;
+    const int HighIndex = Index < N_Half ? 0 : Index - N_Half;
+    if (Index < N_Half) {
+      return m_low.template get<LowIndex>();
+    } else {
+      return m_high.template get<HighIndex>();
+    }
+  }
+};
+
+template <> class int32_v<1> {
+ private:
+  int32_t m_value;
+
+ public:
+  int32_v() = default;
+  int32_v(int32_t v) : m_value(v) {}
+  int32_v(const int32_t *values) : m_value(values[0]) {}
+
+  int32_t value() const { return m_value; }
+
+  static int32_v load(const int32_t *src) { return src[0]; }
+  static int32_v loadu(const int32_t *src) { return src[0]; }
+
+  static int32_v load_partial(const int32_t *src,
+                               unsigned int count) {
+    return count > 0 ? src[0] : 0;
+  }
+
+  static int32_v gather(const int32_t *base, int32_v<1> indices) {
+    return base[indices.value()];
+  }
+
+  void store(int32_t *dst) const { dst[0] = m_value; }
+  void storeu(int32_t *dst) const { dst[0] = m_value; }
+
+  void store_partial(int32_t *dst, unsigned int count) const {
+    if (count > 0) {
+      dst[0] = m_value;
+    }
+  }
+
+  void store_uint16(uint16_t *dst) const {
+    dst[0] = (uint16_t)m_value;
+  }
+
+  void store_uint8(uint8_t *dst) const { dst[0] = (uint8_t)m_value; }
+
+  /* Wraps around like the vector instructions. */
+  friend int32_v operator+(int32_v a, int32_v b) {
+    return (int32_t)((uint32_t)a.value() + (uint32_t)b.value());
+  }
+
+  friend int32_v operator-(int32_v a, int32_v b) {
+    return (int32_t)((uint32_t)a.value() - (uint32_t)b.value());
+  }
+
+  friend int32_v operator*(int32_v a, int32_v b) {
+    return (int32_t)((uint32_t)a.value() * (uint32_t)b.value());
+  }
+
+  friend int32_v operator^(int32_v a, int32_v b) {
+    return a.value() ^ b.value();
+  }
+
+  friend mask_v<1> operator<(int32_v a, int32_v b) {
+    return a.value() < b.value();
+  }
+
+  friend mask_v<1> operator<=(int32_v a, int32_v b) {
+    return a.value() <= b.value();
+  }
+
+  friend mask_v<1> operator>(int32_v a, int32_v b) {
+    return a.value() > b.value();
   }
 
-  friend int32_v operator*(int32_v a, int32_v b) {
-    return int32_v(a.low() * b.low(), a.high() * b.high());
+  friend mask_v<1> operator>=(int32_v a, int32_v b) {
+    return a.value() >= b.value();
   }
 
-  friend int32_v operator^(int32_v a, int32_v b) {
-    return int32_v(a.low() ^ b.low(), a.high() ^ b.high());
+  friend mask_v<1> operator==(int32_v a, int32_v b) {
+    return a.value() == b.value();
   }
 
-  template <unsigned int Count> int32_v rotate() const {
-    return int32_v(m_low.rotate<Count>(), m_high.rotate<Count>());
+  friend mask_v<1> operator!=(int32_v a, int32_v b) {
+    return a.value() != b.value();
   }
 
-  float_v<N> as_float() const {
-    return float_v<N>(m_low.as_float(), m_high.as_float());
+  friend int32_v operator&(int32_v a, int32_v b) {
+    return a.value() & b.value();
   }
 
-  friend std::ostream &operator<<(std::ostream &stream, int32_v v) {
-    stream << "(" << v.low() << ", " << v.high() << ")";
-    return stream;
+  friend int32_v operator|(int32_v a, int32_v b) {
+    return a.value() | b.value();
   }
 
-  template <int Index> int32_t get() const {
-    static_assert(Index < N, "invalid index");
-    if (Index < N_Half) {
-      return m_low.get<Index>();
-    } else {
-      return m_high.get < Index - N_Half < 0 ? 0
-                                             : Index - N_Half > ();
-    }
+  /* Bits of `a` that are not set in `b`. */
+  friend int32_v andnot(int32_v a, int32_v b) {
+    return a.value() & ~b.value();
   }
-};
 
-template <> class int32_v<1> {
- private:
-  int32_t m_value;
+  friend int32_v min(int32_v a, int32_v b) {
+    return a.value() < b.value() ? a.value() : b.value();
+  }
 
- public:
-  int32_v() = default;
-  int32_v(int32_t v) : m_value(v) {}
+  friend int32_v max(int32_v a, int32_v b) {
+    return a.value() > b.value() ? a.value() : b.value();
+  }
 
-  int32_t value() const { return m_value; }
+  /* Like the vector instructions, the minimum value stays as is. */
+  friend int32_v abs(int32_v a) {
+    return a.value() < 0 ? (int32_t)(0u - (uint32_t)a.value())
+                         : a.value();
+  }
 
-  friend int32_v operator+(int32_v a, int32_v b) {
-    return a.value() + b.value();
+  friend int32_v select(mask_v<1> mask, int32_v a, int32_v b) {
+    return mask.value() ? a : b;
   }
 
-  friend int32_v operator-(int32_v a, int32_v b) {
-    return a.value() - b.value();
+  template <unsigned int Count> int32_v shift_left() const {
+    return (int32_t)((uint32_t)m_value << Count);
   }
 
-  friend int32_v operator*(int32_v a, int32_v b) {
-    return a.value() * b.value();
+  template <unsigned int Count> int32_v shift_right() const {
+    return (int32_t)((uint32_t)m_value >> Count);
   }
 
-  friend int32_v operator^(int32_v a, int32_v b) {
-    return a.value() ^ b.value();
+  template <unsigned int Count>
+  int32_v shift_right_arithmetic() const {
+    return m_value >> Count;
   }
 
   template <unsigned int Count> int32_v rotate() const {
@@ -318,6 +1395,7 @@ template <> class int32_v<1> {
   }
 };
 
+#ifdef SIMD_HAS_SSE41
 template <> class int32_v<4> {
  private:
   __m128i m_value;
@@ -328,9 +1406,60 @@ template <> class int32_v<4> {
   int32_v(int32_t v) : m_value(_mm_set1_epi32(v)) {}
   int32_v(int32_t v0, int32_t v1, int32_t v2, int32_t v3)
       : m_value(_mm_set_epi32(v3, v2, v1, v0)) {}
+  int32_v(const int32_t *values)
+      : m_value(_mm_loadu_si128((const __m128i *)values)) {}
 
   __m128i m128i() const { return m_value; }
 
+  static int32_v load(const int32_t *src) {
+    return _mm_load_si128((const __m128i *)src);
+  }
+
+  static int32_v loadu(const int32_t *src) {
+    return _mm_loadu_si128((const __m128i *)src);
+  }
+
+  static int32_v load_partial(const int32_t *src,
+                               unsigned int count) {
+    int32_t values[4] = {0, 0, 0, 0};
+    for (unsigned int i = 0; i < count && i < 4; i++) {
+      values[i] = src[i];
+    }
+    return loadu(values);
+  }
+
+  static int32_v gather(const int32_t *base, int32_v indices) {
+    return int32_v(base[indices.get<0>()], base[indices.get<1>()],
+                   base[indices.get<2>()], base[indices.get<3>()]);
+  }
+
+  void store(int32_t *dst) const {
+    _mm_store_si128((__m128i *)dst, m_value);
+  }
+
+  void storeu(int32_t *dst) const {
+    _mm_storeu_si128((__m128i *)dst, m_value);
+  }
+
+  void store_partial(int32_t *dst, unsigned int count) const {
+    int32_t values[4];
+    this->storeu(values);
+    for (unsigned int i = 0; i < count && i < 4; i++) {
+      dst[i] = values[i];
+    }
+  }
+
+  void store_uint16(uint16_t *dst) const {
+    __m128i words = _mm_packus_epi32(m_value, m_value);
+    _mm_storel_epi64((__m128i *)dst, words);
+  }
+
+  void store_uint8(uint8_t *dst) const {
+    __m128i words = _mm_packus_epi32(m_value, m_value);
+    int32_t bytes = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+    memcpy(dst, &bytes, sizeof(bytes));
+  }
+
   friend int32_v operator+(int32_v a, int32_v b) {
     return _mm_add_epi32(a.m128i(), b.m128i());
   }
@@ -347,6 +1476,70 @@ template <> class int32_v<4> {
     return _mm_xor_si128(a.m128i(), b.m128i());
   }
 
+  friend mask_v<4> operator<(int32_v a, int32_v b) {
+    return _mm_cmplt_epi32(a.m128i(), b.m128i());
+  }
+
+  friend mask_v<4> operator<=(int32_v a, int32_v b) {
+    return !(a > b);
+  }
+
+  friend mask_v<4> operator>(int32_v a, int32_v b) {
+    return _mm_cmpgt_epi32(a.m128i(), b.m128i());
+  }
+
+  friend mask_v<4> operator>=(int32_v a, int32_v b) {
+    return !(a < b);
+  }
+
+  friend mask_v<4> operator==(int32_v a, int32_v b) {
+    return _mm_cmpeq_epi32(a.m128i(), b.m128i());
+  }
+
+  friend mask_v<4> operator!=(int32_v a, int32_v b) {
+    return !(a == b);
+  }
+
+  friend int32_v operator&(int32_v a, int32_v b) {
+    return _mm_and_si128(a.m128i(), b.m128i());
+  }
+
+  friend int32_v operator|(int32_v a, int32_v b) {
+    return _mm_or_si128(a.m128i(), b.m128i());
+  }
+
+  /* Bits of `a` that are not set in `b`. */
+  friend int32_v andnot(int32_v a, int32_v b) {
+    return _mm_andnot_si128(b.m128i(), a.m128i());
+  }
+
+  friend int32_v min(int32_v a, int32_v b) {
+    return _mm_min_epi32(a.m128i(), b.m128i());
+  }
+
+  friend int32_v max(int32_v a, int32_v b) {
+    return _mm_max_epi32(a.m128i(), b.m128i());
+  }
+
+  friend int32_v abs(int32_v a) { return _mm_abs_epi32(a.m128i()); }
+
+  friend int32_v select(mask_v<4> mask, int32_v a, int32_v b) {
+    return _mm_blendv_epi8(b.m128i(), a.m128i(), mask.m128i());
+  }
+
+  template <unsigned int Count> int32_v shift_left() const {
+    return _mm_slli_epi32(m_value, Count);
+  }
+
+  template <unsigned int Count> int32_v shift_right() const {
+    return _mm_srli_epi32(m_value, Count);
+  }
+
+  template <unsigned int Count>
+  int32_v shift_right_arithmetic() const {
+    return _mm_srai_epi32(m_value, Count);
+  }
+
   template <unsigned int Count> int32_v rotate() const {
     __m128i left = _mm_slli_epi32(m_value, Count);
     __m128i right = _mm_srli_epi32(m_value, 32 - Count);
@@ -369,10 +1562,20 @@ template <> class int32_v<4> {
   }
 };
 
+#endif /* SIMD_HAS_SSE41 */
+
+#ifdef SIMD_HAS_AVX2
 template <> class int32_v<8> {
  private:
   __m256i m_value;
 
+  /* Both 128 bit halves packed into 8 words with unsigned
+   * saturation. */
+  __m128i pack_uint16() const {
+    return _mm_packus_epi32(_mm256_castsi256_si128(m_value),
+                            _mm256_extracti128_si256(m_value, 1));
+  }
+
  public:
   int32_v() = default;
   int32_v(__m256i v) : m_value(v) {}
@@ -380,9 +1583,50 @@ template <> class int32_v<8> {
   int32_v(int32_t v0, int32_t v1, int32_t v2, int32_t v3, int32_t v4,
           int32_t v5, int32_t v6, int32_t v7)
       : m_value(_mm256_set_epi32(v7, v6, v5, v4, v3, v2, v1, v0)) {}
+  int32_v(const int32_t *values)
+      : m_value(_mm256_loadu_si256((const __m256i *)values)) {}
 
   __m256i m256i() const { return m_value; }
 
+  static int32_v load(const int32_t *src) {
+    return _mm256_load_si256((const __m256i *)src);
+  }
+
+  static int32_v loadu(const int32_t *src) {
+    return _mm256_loadu_si256((const __m256i *)src);
+  }
+
+  static int32_v load_partial(const int32_t *src,
+                               unsigned int count) {
+    return _mm256_maskload_epi32(src, float_v<8>::first_lanes(count));
+  }
+
+  static int32_v gather(const int32_t *base, int32_v indices) {
+    return _mm256_i32gather_epi32(base, indices.m256i(), 4);
+  }
+
+  void store(int32_t *dst) const {
+    _mm256_store_si256((__m256i *)dst, m_value);
+  }
+
+  void storeu(int32_t *dst) const {
+    _mm256_storeu_si256((__m256i *)dst, m_value);
+  }
+
+  void store_partial(int32_t *dst, unsigned int count) const {
+    _mm256_maskstore_epi32(dst, float_v<8>::first_lanes(count),
+                           m_value);
+  }
+
+  void store_uint16(uint16_t *dst) const {
+    _mm_storeu_si128((__m128i *)dst, this->pack_uint16());
+  }
+
+  void store_uint8(uint8_t *dst) const {
+    __m128i words = this->pack_uint16();
+    _mm_storel_epi64((__m128i *)dst, _mm_packus_epi16(words, words));
+  }
+
   friend int32_v operator+(int32_v a, int32_v b) {
     return _mm256_add_epi32(a.m256i(), b.m256i());
   }
@@ -399,6 +1643,72 @@ template <> class int32_v<8> {
     return _mm256_xor_si256(a.m256i(), b.m256i());
   }
 
+  friend mask_v<8> operator<(int32_v a, int32_v b) {
+    return _mm256_cmpgt_epi32(b.m256i(), a.m256i());
+  }
+
+  friend mask_v<8> operator<=(int32_v a, int32_v b) {
+    return !(a > b);
+  }
+
+  friend mask_v<8> operator>(int32_v a, int32_v b) {
+    return _mm256_cmpgt_epi32(a.m256i(), b.m256i());
+  }
+
+  friend mask_v<8> operator>=(int32_v a, int32_v b) {
+    return !(a < b);
+  }
+
+  friend mask_v<8> operator==(int32_v a, int32_v b) {
+    return _mm256_cmpeq_epi32(a.m256i(), b.m256i());
+  }
+
+  friend mask_v<8> operator!=(int32_v a, int32_v b) {
+    return !(a == b);
+  }
+
+  friend int32_v operator&(int32_v a, int32_v b) {
+    return _mm256_and_si256(a.m256i(), b.m256i());
+  }
+
+  friend int32_v operator|(int32_v a, int32_v b) {
+    return _mm256_or_si256(a.m256i(), b.m256i());
+  }
+
+  /* Bits of `a` that are not set in `b`. */
+  friend int32_v andnot(int32_v a, int32_v b) {
+    return _mm256_andnot_si256(b.m256i(), a.m256i());
+  }
+
+  friend int32_v min(int32_v a, int32_v b) {
+    return _mm256_min_epi32(a.m256i(), b.m256i());
+  }
+
+  friend int32_v max(int32_v a, int32_v b) {
+    return _mm256_max_epi32(a.m256i(), b.m256i());
+  }
+
+  friend int32_v abs(int32_v a) {
+    return _mm256_abs_epi32(a.m256i());
+  }
+
+  friend int32_v select(mask_v<8> mask, int32_v a, int32_v b) {
+    return _mm256_blendv_epi8(b.m256i(), a.m256i(), mask.m256i());
+  }
+
+  template <unsigned int Count> int32_v shift_left() const {
+    return _mm256_slli_epi32(m_value, Count);
+  }
+
+  template <unsigned int Count> int32_v shift_right() const {
+    return _mm256_srli_epi32(m_value, Count);
+  }
+
+  template <unsigned int Count>
+  int32_v shift_right_arithmetic() const {
+    return _mm256_srai_epi32(m_value, Count);
+  }
+
   template <unsigned int Count> int32_v rotate() const {
     __m256i left = _mm256_slli_epi32(m_value, Count);
     __m256i right = _mm256_srli_epi32(m_value, 32 - Count);
@@ -422,7 +1732,187 @@ template <> class int32_v<8> {
   }
 };
 
-int32_v<1> float_v<1>::cast_to_int32() const {
+#endif /* SIMD_HAS_AVX2 */
+
+#ifdef SIMD_HAS_AVX512
+template <> class int32_v<16> {
+ private:
+  __m512i m_value;
+
+ public:
+  int32_v() = default;
+  int32_v(__m512i v) : m_value(v) {}
+  int32_v(int32_t v) : m_value(_mm512_set1_epi32(v)) {}
+  int32_v(int32_v<8> low, int32_v<8> high)
+      : m_value(_mm512_inserti64x4(
+            _mm512_castsi256_si512(low.m256i()), high.m256i(), 1)) {}
+  int32_v(const int32_t *values)
+      : m_value(_mm512_loadu_si512(values)) {}
+
+  __m512i m512i() const { return m_value; }
+
+  static int32_v load(const int32_t *src) {
+    return _mm512_load_si512(src);
+  }
+
+  static int32_v loadu(const int32_t *src) {
+    return _mm512_loadu_si512(src);
+  }
+
+  static int32_v load_partial(const int32_t *src,
+                               unsigned int count) {
+    return _mm512_maskz_loadu_epi32(float_v<16>::first_lanes(count),
+                                    src);
+  }
+
+  static int32_v gather(const int32_t *base, int32_v indices) {
+    return _mm512_i32gather_epi32(indices.m512i(), base, 4);
+  }
+
+  void store(int32_t *dst) const { _mm512_store_si512(dst, m_value); }
+
+  void storeu(int32_t *dst) const {
+    _mm512_storeu_si512(dst, m_value);
+  }
+
+  void store_partial(int32_t *dst, unsigned int count) const {
+    _mm512_mask_storeu_epi32(dst, float_v<16>::first_lanes(count),
+                             m_value);
+  }
+
+  void store_uint16(uint16_t *dst) const {
+    _mm256_storeu_si256((__m256i *)dst,
+                        _mm512_cvtepi32_epi16(m_value));
+  }
+
+  void store_uint8(uint8_t *dst) const {
+    _mm_storeu_si128((__m128i *)dst, _mm512_cvtepi32_epi8(m_value));
+  }
+
+  friend int32_v operator+(int32_v a, int32_v b) {
+    return _mm512_add_epi32(a.m512i(), b.m512i());
+  }
+
+  friend int32_v operator-(int32_v a, int32_v b) {
+    return _mm512_sub_epi32(a.m512i(), b.m512i());
+  }
+
+  friend int32_v operator*(int32_v a, int32_v b) {
+    return _mm512_mullo_epi32(a.m512i(), b.m512i());
+  }
+
+  friend int32_v operator^(int32_v a, int32_v b) {
+    return _mm512_xor_si512(a.m512i(), b.m512i());
+  }
+
+  friend mask_v<16> operator<(int32_v a, int32_v b) {
+    return _mm512_cmp_epi32_mask(a.m512i(), b.m512i(), _MM_CMPINT_LT);
+  }
+
+  friend mask_v<16> operator<=(int32_v a, int32_v b) {
+    return _mm512_cmp_epi32_mask(a.m512i(), b.m512i(), _MM_CMPINT_LE);
+  }
+
+  friend mask_v<16> operator>(int32_v a, int32_v b) {
+    return _mm512_cmp_epi32_mask(a.m512i(), b.m512i(),
+                                 _MM_CMPINT_NLE);
+  }
+
+  friend mask_v<16> operator>=(int32_v a, int32_v b) {
+    return _mm512_cmp_epi32_mask(a.m512i(), b.m512i(),
+                                 _MM_CMPINT_NLT);
+  }
+
+  friend mask_v<16> operator==(int32_v a, int32_v b) {
+    return _mm512_cmp_epi32_mask(a.m512i(), b.m512i(), _MM_CMPINT_EQ);
+  }
+
+  friend mask_v<16> operator!=(int32_v a, int32_v b) {
+    return _mm512_cmp_epi32_mask(a.m512i(), b.m512i(),
+                                 _MM_CMPINT_NE);
+  }
+
+  friend int32_v operator&(int32_v a, int32_v b) {
+    return _mm512_and_si512(a.m512i(), b.m512i());
+  }
+
+  friend int32_v operator|(int32_v a, int32_v b) {
+    return _mm512_or_si512(a.m512i(), b.m512i());
+  }
+
+  /* Bits of `a` that are not set in `b`. */
+  friend int32_v andnot(int32_v a, int32_v b) {
+    return _mm512_andnot_si512(b.m512i(), a.m512i());
+  }
+
+  friend int32_v min(int32_v a, int32_v b) {
+    return _mm512_min_epi32(a.m512i(), b.m512i());
+  }
+
+  friend int32_v max(int32_v a, int32_v b) {
+    return _mm512_max_epi32(a.m512i(), b.m512i());
+  }
+
+  friend int32_v abs(int32_v a) {
+    return _mm512_abs_epi32(a.m512i());
+  }
+
+  friend int32_v select(mask_v<16> mask, int32_v a, int32_v b) {
+    return _mm512_mask_blend_epi32(mask.mmask16(), b.m512i(),
+                                   a.m512i());
+  }
+
+  template <unsigned int Count> int32_v shift_left() const {
+    return _mm512_slli_epi32(m_value, Count);
+  }
+
+  template <unsigned int Count> int32_v shift_right() const {
+    return _mm512_srli_epi32(m_value, Count);
+  }
+
+  template <unsigned int Count>
+  int32_v shift_right_arithmetic() const {
+    return _mm512_srai_epi32(m_value, Count);
+  }
+
+  template <unsigned int Count> int32_v rotate() const {
+    return _mm512_rol_epi32(m_value, Count);
+  }
+
+  int32_v<8> low() const { return _mm512_castsi512_si256(m_value); }
+
+  int32_v<8> high() const {
+    return _mm512_extracti64x4_epi64(m_value, 1);
+  }
+
+  float_v<16> as_float() const {
+    return _mm512_cvtepi32_ps(m_value);
+  }
+
+  friend std::ostream &operator<<(std::ostream &stream, int32_v v) {
+    stream << "(" << v.low() << ", " << v.high() << ")";
+    return stream;
+  }
+
+  template <int Index> int32_t get() const {
+    static_assert(Index < 16, "invalid index");
+    const int LowIndex = Index < 8 ? Index : 0;
+    const int HighIndex = Index < 8 ? 0 : Index - 8;
+    if (Index < 8) {
+      return low().template get<LowIndex>();
+    } else {
+      return high().template get<HighIndex>();
+    }
+  }
+};
+#endif /* SIMD_HAS_AVX512 */
+
+inline float_v<1> float_v<1>::gather(const float *base,
+                                     int32_v<1> indices) {
+  return base[indices.value()];
+}
+
+inline int32_v<1> float_v<1>::cast_to_int32() const {
   union {
     float f;
     int i;
@@ -436,22 +1926,155 @@ int32_v<N> float_v<N>::cast_to_int32() const {
   return int32_v<N>(m_low.cast_to_int32(), m_high.cast_to_int32());
 }
 
-int32_v<4> float_v<4>::cast_to_int32() const {
-  return _mm_castps_si128(m_value);
+template <unsigned int N> int32_v<N> float_v<N>::as_int32() const {
+  return int32_v<N>(m_low.as_int32(), m_high.as_int32());
 }
 
-int32_v<8> float_v<8>::cast_to_int32() const {
-  return _mm256_castps_si256(m_value);
+/* Rounds to nearest like cvtps2dq. Values outside of the int32 range
+ * and NaN give INT32_MIN (the "integer indefinite" value of the
+ * vector conversions), instead of being undefined behavior. */
+inline int32_v<1> float_v<1>::as_int32() const {
+  float rounded = std::nearbyint(m_value);
+  if (!(rounded >= -2147483648.0f && rounded < 2147483648.0f)) {
+    return int32_v<1>(INT32_MIN);
+  }
+  return int32_v<1>((int32_t)rounded);
+}
+
+#ifdef SIMD_HAS_SSE41
+inline float_v<4> float_v<4>::gather(const float *base,
+                                     int32_v<4> indices) {
+  return float_v<4>(base[indices.get<0>()], base[indices.get<1>()],
+                    base[indices.get<2>()], base[indices.get<3>()]);
 }
 
-int32_v<1> float_v<1>::as_int32() const {
-  return int32_v<1>((int32_t)m_value);
+inline int32_v<4> float_v<4>::cast_to_int32() const {
+  return _mm_castps_si128(m_value);
 }
 
-int32_v<4> float_v<4>::as_int32() const {
+inline int32_v<4> float_v<4>::as_int32() const {
   return _mm_cvtps_epi32(m_value);
 }
+#endif
+
+#ifdef SIMD_HAS_AVX2
+inline float_v<8> float_v<8>::gather(const float *base,
+                                     int32_v<8> indices) {
+  return _mm256_i32gather_ps(base, indices.m256i(), 4);
+}
+
+inline int32_v<8> float_v<8>::cast_to_int32() const {
+  return _mm256_castps_si256(m_value);
+}
 
-int32_v<8> float_v<8>::as_int32() const {
+inline int32_v<8> float_v<8>::as_int32() const {
   return _mm256_cvtps_epi32(m_value);
 }
+#endif
+
+#ifdef SIMD_HAS_AVX512
+inline float_v<16> float_v<16>::gather(const float *base,
+                                       int32_v<16> indices) {
+  return _mm512_i32gather_ps(indices.m512i(), base, 4);
+}
+
+inline int32_v<16> float_v<16>::cast_to_int32() const {
+  return _mm512_castps_si512(m_value);
+}
+
+inline int32_v<16> float_v<16>::as_int32() const {
+  return _mm512_cvtps_epi32(m_value);
+}
+#endif
+
+/* The IEEE half precision value nearest to every lane, rounded to
+ * nearest even, in the low 16 bits of the lanes. This is the software
+ * version of vcvtps2ph, including its handling of NaN payloads. */
+template <unsigned int N> int32_v<N> float16_bits(float_v<N> value) {
+  int32_v<N> bits = value.cast_to_int32();
+  int32_v<N> sign =
+      bits.template shift_right<16>() & int32_v<N>(0x8000);
+  int32_v<N> magnitude = bits & int32_v<N>(0x7fffffff);
+
+  /* Rebias the exponent and round the 13 dropped mantissa bits. A
+   * carry out of the mantissa correctly increments the exponent, up
+   * to infinity. */
+  int32_v<N> odd =
+      magnitude.template shift_right<13>() & int32_v<N>(1);
+  int32_v<N> bias = int32_v<N>((int32_t)0xc8000fff);
+  int32_v<N> normal =
+      (magnitude + bias + odd).template shift_right<13>();
+  /* Below 2^-14 the result is subnormal. Scaling by 2^24 is exact and
+   * the conversion rounds to nearest even. */
+  int32_v<N> subnormal = (abs(value) * 16777216.0f).as_int32();
+  int32_v<N> nan =
+      (magnitude.template shift_right<13>() & int32_v<N>(0x3ff)) |
+      int32_v<N>(0x7e00);
+  int32_v<N> special = select(magnitude > int32_v<N>(0x7f800000), nan,
+                              int32_v<N>(0x7c00));
+
+  int32_v<N> result =
+      select(magnitude >= int32_v<N>(0x47800000), special, normal);
+  result = select(magnitude < int32_v<N>(0x38800000), subnormal,
+                  result);
+  return result | sign;
+}
+
+/* The upper 16 bits of every lane after rounding to nearest even,
+ * which is the bfloat16 value nearest to it. NaN keeps its sign and
+ * the upper payload bits and is made quiet, instead of being rounded
+ * to infinity. */
+template <unsigned int N>
+int32_v<N> bfloat16_bits(float_v<N> value) {
+  int32_v<N> bits = value.cast_to_int32();
+  int32_v<N> sign =
+      bits.template shift_right<16>() & int32_v<N>(0x8000);
+  int32_v<N> magnitude = bits & int32_v<N>(0x7fffffff);
+  int32_v<N> upper = magnitude.template shift_right<16>();
+
+  /* Clamping to infinity first keeps the sum from overflowing for
+   * NaN, which is replaced afterwards. */
+  int32_v<N> rounded = (min(magnitude, int32_v<N>(0x7f800000)) +
+                        int32_v<N>(0x7fff) + (upper & int32_v<N>(1)))
+                           .template shift_right<16>();
+  int32_v<N> nan = upper | int32_v<N>(0x40);
+  return select(magnitude > int32_v<N>(0x7f800000), nan, rounded) |
+         sign;
+}
+
+inline void float_v<1>::store_float16(uint16_t *dst) const {
+  float16_bits(*this).store_uint16(dst);
+}
+
+#ifdef SIMD_HAS_SSE41
+inline void float_v<4>::store_float16(uint16_t *dst) const {
+#ifdef SIMD_HAS_F16C
+  _mm_storel_epi64((__m128i *)dst,
+                   _mm_cvtps_ph(m_value, _MM_FROUND_TO_NEAREST_INT));
+#else
+  float16_bits(*this).store_uint16(dst);
+#endif
+}
+#endif
+
+#ifdef SIMD_HAS_AVX2
+inline void float_v<8>::store_float16(uint16_t *dst) const {
+#ifdef SIMD_HAS_F16C
+  _mm_storeu_si128(
+      (__m128i *)dst,
+      _mm256_cvtps_ph(m_value, _MM_FROUND_TO_NEAREST_INT));
+#else
+  float16_bits(*this).store_uint16(dst);
+#endif
+}
+#endif
+
+#ifdef SIMD_HAS_AVX512
+inline void float_v<16>::store_float16(uint16_t *dst) const {
+  _mm256_storeu_si256(
+      (__m256i *)dst,
+      _mm512_cvtps_ph(m_value, _MM_FROUND_TO_NEAREST_INT));
+}
+#endif
+
+SIMD_NAMESPACE_END
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "noise_kernels.hpp"
+
+/* Access to a table that every per tier build defines in its own
+ * namespace, e.g. the NoiseKernels of noise_kernels_impl.cpp. The
+ * SIMD_BUILD_* definitions say which tiers are compiled in.
+ *
+ *   SIMD_DECLARE_PER_TIER(BenchKernelList, bench_kernels)
+ *
+ *   static const BenchKernelList *
+ *   bench_kernels_for_tier(SimdTier tier) {
+ *     SIMD_SELECT_PER_TIER(tier, bench_kernels);
+ *   }
+ */
+
+#ifdef SIMD_BUILD_SSE41
+#define SIMD_IF_BUILD_SSE41(...) __VA_ARGS__
+#else
+#define SIMD_IF_BUILD_SSE41(...)
+#endif
+#ifdef SIMD_BUILD_AVX2
+#define SIMD_IF_BUILD_AVX2(...) __VA_ARGS__
+#else
+#define SIMD_IF_BUILD_AVX2(...)
+#endif
+#ifdef SIMD_BUILD_AVX512
+#define SIMD_IF_BUILD_AVX512(...) __VA_ARGS__
+#else
+#define SIMD_IF_BUILD_AVX512(...)
+#endif
+
+/* Declare `const Type name` in the namespace of every tier. */
+#define SIMD_DECLARE_PER_TIER(Type, name)                            \
+  namespace simd_scalar {                                            \
+  extern const Type name;                                            \
+  }                                                                  \
+  SIMD_IF_BUILD_SSE41(namespace simd_sse41 {                         \
+    extern const Type name;                                          \
+  })                                                                 \
+  SIMD_IF_BUILD_AVX2(namespace simd_avx2 {                           \
+    extern const Type name;                                          \
+  })                                                                 \
+  SIMD_IF_BUILD_AVX512(namespace simd_avx512 {                       \
+    extern const Type name;                                          \
+  })
+
+/* Return the address of `name` in the namespace of `tier`, or null
+ * when the tier is not compiled in. */
+#define SIMD_SELECT_PER_TIER(tier, name)                             \
+  switch (tier) {                                                    \
+  case SimdTier::Scalar:                                             \
+    return &simd_scalar::name;                                       \
+    SIMD_IF_BUILD_SSE41(case SimdTier::SSE41                         \
+                        : return &simd_sse41::name;)                 \
+    SIMD_IF_BUILD_AVX2(case SimdTier::AVX2                           \
+                       : return &simd_avx2::name;)                   \
+    SIMD_IF_BUILD_AVX512(case SimdTier::AVX512                       \
+                         : return &simd_avx512::name;)               \
+  default:                                                           \
+    return nullptr;                                                  \
+  }
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "noise_common.hpp"
+
+SIMD_NAMESPACE_BEGIN
+
+/* Contribution of one simplex corner: (r^2 - d^2)^4 * dot(g, d),
+ * or zero outside of the corner's radius. */
+template <unsigned int N>
+static float_v<N> simplex_corner(float_v<N> radius_squared,
+                                 float_v<N> distance_squared,
+                                 float_v<N> dot) {
+  float_v<N> t = max(radius_squared - distance_squared, 0.0f);
+  t = t * t;
+  return t * t * dot;
+}
+
+/* Evaluate 3D simplex noise at N separate positions. Space is split
+ * into tetrahedra, so only 4 corners are hashed instead of the 8 of a
+ * cube. The corner ordering within the skewed cell is computed
+ * branchlessly with masks. Follows Stefan Gustavson's reference
+ * implementation; the result lies within about [-1, 1]. */
+template <unsigned int N>
+static float_v<N> eval_simplex_noise(float_v<N> x, float_v<N> y,
+                                     float_v<N> z,
+                                     int32_v<N> seed = 0) {
+  const float skew = 1.0f / 3.0f;
+  const float unskew = 1.0f / 6.0f;
+
+  /* Find the skewed cell and the offset to its origin. */
+  float_v<N> s = (x + y + z) * skew;
+  float_v<N> i = (x + s).floor();
+  float_v<N> j = (y + s).floor();
+  float_v<N> k = (z + s).floor();
+  float_v<N> t = (i + j + k) * unskew;
+  float_v<N> x0 = x - (i - t);
+  float_v<N> y0 = y - (j - t);
+  float_v<N> z0 = z - (k - t);
+
+  /* Pick the tetrahedron from the order of the offsets. */
+  mask_v<N> xy = x0 >= y0;
+  mask_v<N> yz = y0 >= z0;
+  mask_v<N> xz = x0 >= z0;
+  float_v<N> one = 1.0f;
+  float_v<N> zero = 0.0f;
+  float_v<N> i1 = select(xy & xz, one, zero);
+  float_v<N> j1 = select((!xy) & yz, one, zero);
+  float_v<N> k1 = select((!xz) & (!yz), one, zero);
+  float_v<N> i2 = select(xy | xz, one, zero);
+  float_v<N> j2 = select((!xy) | yz, one, zero);
+  float_v<N> k2 = select(!(xz & yz), one, zero);
+
+  float_v<N> x1 = x0 - i1 + unskew;
+  float_v<N> y1 = y0 - j1 + unskew;
+  float_v<N> z1 = z0 - k1 + unskew;
+  float_v<N> x2 = x0 - i2 + 2.0f * unskew;
+  float_v<N> y2 = y0 - j2 + 2.0f * unskew;
+  float_v<N> z2 = z0 - k2 + 2.0f * unskew;
+  float_v<N> x3 = x0 - 1.0f + 3.0f * unskew;
+  float_v<N> y3 = y0 - 1.0f + 3.0f * unskew;
+  float_v<N> z3 = z0 - 1.0f + 3.0f * unskew;
+
+  int32_v<N> i_id = i.as_int32();
+  int32_v<N> j_id = j.as_int32();
+  int32_v<N> k_id = k.as_int32();
+  auto hash = [seed](int32_v<N> i, int32_v<N> j, int32_v<N> k) {
+    const int32_v<N> ids[3] = {i, j, k};
+    return hash_position_bits(ids, seed);
+  };
+  int32_v<N> h0 = hash(i_id, j_id, k_id);
+  int32_v<N> h1 = hash(i_id + i1.as_int32(), j_id + j1.as_int32(),
+                       k_id + k1.as_int32());
+  int32_v<N> h2 = hash(i_id + i2.as_int32(), j_id + j2.as_int32(),
+                       k_id + k2.as_int32());
+  int32_v<N> h3 = hash(i_id + int32_v<N>(1), j_id + int32_v<N>(1),
+                       k_id + int32_v<N>(1));
+
+  const float_v<N> r2 = 0.6f;
+  float_v<N> n0 = simplex_corner(r2, x0 * x0 + y0 * y0 + z0 * z0,
+                                 gradient_dot(h0, x0, y0, z0));
+  float_v<N> n1 = simplex_corner(r2, x1 * x1 + y1 * y1 + z1 * z1,
+                                 gradient_dot(h1, x1, y1, z1));
+  float_v<N> n2 = simplex_corner(r2, x2 * x2 + y2 * y2 + z2 * z2,
+                                 gradient_dot(h2, x2, y2, z2));
+  float_v<N> n3 = simplex_corner(r2, x3 * x3 + y3 * y3 + z3 * z3,
+                                 gradient_dot(h3, x3, y3, z3));
+  return (n0 + n1 + n2 + n3) * 32.0f;
+}
+
+/* Evaluate 4D simplex noise at N separate positions. 5 corners are
+ * hashed instead of the 16 of a hypercube. The corner ordering is
+ * derived from the rank of every offset among the four, which is
+ * counted with masks. */
+template <unsigned int N>
+static float_v<N> eval_simplex_noise(float_v<N> x, float_v<N> y,
+                                     float_v<N> z, float_v<N> w,
+                                     int32_v<N> seed = 0) {
+  /* (sqrt(5) - 1) / 4 and (5 - sqrt(5)) / 20. */
+  const float skew = 0.309016994f;
+  const float unskew = 0.138196601f;
+
+  float_v<N> s = (x + y + z + w) * skew;
+  float_v<N> i = (x + s).floor();
+  float_v<N> j = (y + s).floor();
+  float_v<N> k = (z + s).floor();
+  float_v<N> l = (w + s).floor();
+  float_v<N> t = (i + j + k + l) * unskew;
+  float_v<N> x0 = x - (i - t);
+  float_v<N> y0 = y - (j - t);
+  float_v<N> z0 = z - (k - t);
+  float_v<N> w0 = w - (l - t);
+
+  /* Rank of every offset: the number of other offsets it beats. */
+  float_v<N> one = 1.0f;
+  float_v<N> zero = 0.0f;
+  mask_v<N> xy = x0 > y0;
+  mask_v<N> xz = x0 > z0;
+  mask_v<N> xw = x0 > w0;
+  mask_v<N> yz = y0 > z0;
+  mask_v<N> yw = y0 > w0;
+  mask_v<N> zw = z0 > w0;
+  float_v<N> rank_x = select(xy, one, zero) + select(xz, one, zero) +
+                      select(xw, one, zero);
+  float_v<N> rank_y = select(xy, zero, one) + select(yz, one, zero) +
+                      select(yw, one, zero);
+  float_v<N> rank_z = select(xz, zero, one) + select(yz, zero, one) +
+                      select(zw, one, zero);
+  float_v<N> rank_w = select(xw, zero, one) + select(yw, zero, one) +
+                      select(zw, zero, one);
+
+  /* The n-th corner steps along the axes of rank >= 4 - n. */
+  float_v<N> offsets_x[3], offsets_y[3], offsets_z[3], offsets_w[3];
+  for (int corner = 0; corner < 3; corner++) {
+    float_v<N> threshold = float_v<N>(3.0f - corner);
+    offsets_x[corner] = select(rank_x >= threshold, one, zero);
+    offsets_y[corner] = select(rank_y >= threshold, one, zero);
+    offsets_z[corner] = select(rank_z >= threshold, one, zero);
+    offsets_w[corner] = select(rank_w >= threshold, one, zero);
+  }
+
+  int32_v<N> i_id = i.as_int32();
+  int32_v<N> j_id = j.as_int32();
+  int32_v<N> k_id = k.as_int32();
+  int32_v<N> l_id = l.as_int32();
+
+  auto hash = [seed](int32_v<N> i, int32_v<N> j, int32_v<N> k,
+                     int32_v<N> l) {
+    const int32_v<N> ids[4] = {i, j, k, l};
+    return hash_position_bits(ids, seed);
+  };
+
+  const float_v<N> r2 = 0.6f;
+  float_v<N> result = simplex_corner(
+      r2, x0 * x0 + y0 * y0 + z0 * z0 + w0 * w0,
+      gradient_dot(hash(i_id, j_id, k_id, l_id), x0, y0, z0, w0));
+
+  for (int corner = 0; corner < 4; corner++) {
+    float_v<N> dx = corner < 3 ? offsets_x[corner] : one;
+    float_v<N> dy = corner < 3 ? offsets_y[corner] : one;
+    float_v<N> dz = corner < 3 ? offsets_z[corner] : one;
+    float_v<N> dw = corner < 3 ? offsets_w[corner] : one;
+    float_v<N> corner_unskew = float_v<N>((corner + 1) * unskew);
+    float_v<N> xn = x0 - dx + corner_unskew;
+    float_v<N> yn = y0 - dy + corner_unskew;
+    float_v<N> zn = z0 - dz + corner_unskew;
+    float_v<N> wn = w0 - dw + corner_unskew;
+    int32_v<N> h = hash(i_id + dx.as_int32(), j_id + dy.as_int32(),
+                        k_id + dz.as_int32(), l_id + dw.as_int32());
+    result = result + simplex_corner(
+                          r2, xn * xn + yn * yn + zn * zn + wn * wn,
+                          gradient_dot(h, xn, yn, zn, wn));
+  }
+  return result * 27.0f;
+}
+
+SIMD_NAMESPACE_END
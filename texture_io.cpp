@@ -0,0 +1,220 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "noise_kernels.hpp"
+#include "texture_io.hpp"
+
+static const uint32_t raw_texture_version = 1;
+
+size_t texture_bytes_per_pixel(TextureFormat format) {
+  switch (format) {
+  case TextureFormat::RawFloat32:
+  case TextureFormat::PFM:
+    return 4;
+  case TextureFormat::RawUNorm16:
+  case TextureFormat::PGM16:
+  case TextureFormat::RawFloat16:
+  case TextureFormat::RawBFloat16:
+    return 2;
+  case TextureFormat::RawUNorm8:
+  case TextureFormat::PGM8:
+    return 1;
+  }
+  return 0;
+}
+
+size_t texture_header(TextureFormat format, unsigned int width,
+                      unsigned int height, float min_value,
+                      float max_value, char *dst) {
+  switch (format) {
+  case TextureFormat::RawFloat32:
+  case TextureFormat::RawUNorm16:
+  case TextureFormat::RawUNorm8:
+  case TextureFormat::RawFloat16:
+  case TextureFormat::RawBFloat16: {
+    RawTextureHeader header;
+    memcpy(header.magic, "NTEX", 4);
+    header.version = raw_texture_version;
+    header.format = (uint32_t)format;
+    header.width = width;
+    header.height = height;
+    header.min_value = min_value;
+    header.max_value = max_value;
+    header.reserved = 0;
+    memcpy(dst, &header, sizeof(header));
+    return sizeof(header);
+  }
+  case TextureFormat::PGM8:
+    return snprintf(dst, 64, "P5\n%u %u\n255\n", width, height);
+  case TextureFormat::PGM16:
+    return snprintf(dst, 64, "P5\n%u %u\n65535\n", width, height);
+  case TextureFormat::PFM:
+    /* A negative scale marks little endian data. */
+    return snprintf(dst, 64, "Pf\n%u %u\n-1.0\n", width, height);
+  }
+  return 0;
+}
+
+void encode_texture_pixels(TextureFormat format, const float *pixels,
+                           size_t count, float min_value,
+                           float max_value, void *dst) {
+  PixelFormat pixel_format;
+  switch (format) {
+  case TextureFormat::RawFloat32:
+  case TextureFormat::PFM:
+    memcpy(dst, pixels, count * sizeof(float));
+    return;
+  case TextureFormat::RawUNorm16:
+    pixel_format = PixelFormat::UNorm16;
+    break;
+  case TextureFormat::PGM16:
+    /* PGM stores 16 bit values as big endian. */
+    pixel_format = PixelFormat::UNorm16BigEndian;
+    break;
+  case TextureFormat::RawUNorm8:
+  case TextureFormat::PGM8:
+    pixel_format = PixelFormat::UNorm8;
+    break;
+  case TextureFormat::RawFloat16:
+    pixel_format = PixelFormat::Float16;
+    break;
+  case TextureFormat::RawBFloat16:
+    pixel_format = PixelFormat::BFloat16;
+    break;
+  default:
+    return;
+  }
+  noise_kernels().pack_pixels(pixels, count, pixel_format, min_value,
+                              max_value, dst);
+}
+
+TextureWriter::TextureWriter(int fd, TextureFormat format,
+                             unsigned int width, unsigned int height,
+                             float min_value, float max_value)
+    : m_fd(fd), m_format(format), m_width(width), m_height(height),
+      m_min_value(min_value), m_max_value(max_value),
+      m_failed(false) {
+  m_file_offset = lseek(fd, 0, SEEK_CUR);
+  m_seekable = m_file_offset >= 0;
+  if (!m_seekable) {
+    m_file_offset = 0;
+  }
+  m_next_sequential_offset = 0;
+
+  char header[64];
+  m_header_size = texture_header(format, width, height, min_value,
+                                 max_value, header);
+  this->write_at(0, header, m_header_size);
+}
+
+bool TextureWriter::write_rows(unsigned int y, unsigned int row_count,
+                               const float *pixels) {
+  return this->write_row_range(y, row_count, pixels, false);
+}
+
+bool TextureWriter::write_encoded_rows(unsigned int y,
+                                       unsigned int row_count,
+                                       const void *pixels) {
+  return this->write_row_range(y, row_count, pixels, true);
+}
+
+bool TextureWriter::write_row_range(unsigned int y,
+                                    unsigned int row_count,
+                                    const void *pixels,
+                                    bool encoded) {
+  if (m_failed || y + row_count > m_height) {
+    m_failed = true;
+    return false;
+  }
+
+  size_t bytes_per_pixel = texture_bytes_per_pixel(m_format);
+  size_t row_bytes = m_width * bytes_per_pixel;
+  size_t input_row_bytes =
+      m_width * (encoded ? bytes_per_pixel : sizeof(float));
+  auto write = [&](int64_t offset, const char *input, size_t count) {
+    if (encoded) {
+      this->write_at(offset, input, count * bytes_per_pixel);
+    } else {
+      this->write_pixels(offset, (const float *)input, count);
+    }
+  };
+
+  const char *input = (const char *)pixels;
+  if (this->bottom_to_top()) {
+    /* The rows are stored bottom to top. Going through them in
+     * reverse keeps the file offsets increasing for sequential
+     * output. */
+    for (unsigned int i = row_count; i-- > 0;) {
+      int64_t row_in_file = m_height - 1 - (y + i);
+      write(m_header_size + row_in_file * row_bytes,
+            input + i * input_row_bytes, m_width);
+    }
+  } else {
+    write(m_header_size + (int64_t)y * row_bytes, input,
+          (size_t)row_count * m_width);
+  }
+  return !m_failed;
+}
+
+bool TextureWriter::write_pixels(int64_t offset, const float *pixels,
+                                 size_t count) {
+  /* Convert a bounded number of pixels at a time, so that the memory
+   * use does not depend on the size of the texture. */
+  const size_t chunk_size = 4096;
+  char buffer[chunk_size * sizeof(float)];
+  size_t bytes_per_pixel = texture_bytes_per_pixel(m_format);
+
+  for (size_t i = 0; i < count && !m_failed; i += chunk_size) {
+    size_t chunk = std::min(chunk_size, count - i);
+    encode_texture_pixels(m_format, pixels + i, chunk, m_min_value,
+                          m_max_value, buffer);
+    this->write_at(offset + i * bytes_per_pixel, buffer,
+                   chunk * bytes_per_pixel);
+  }
+  return !m_failed;
+}
+
+bool TextureWriter::write_at(int64_t offset, const void *data,
+                             size_t size) {
+  if (!m_seekable && offset != m_next_sequential_offset) {
+    /* Rows have to be written in file order. */
+    m_failed = true;
+    return false;
+  }
+
+  const char *bytes = (const char *)data;
+  while (size > 0 && !m_failed) {
+    ssize_t written;
+    if (m_seekable) {
+      written = pwrite(m_fd, bytes, size, m_file_offset + offset);
+    } else {
+      written = write(m_fd, bytes, size);
+    }
+    if (written <= 0) {
+      m_failed = true;
+      break;
+    }
+    bytes += written;
+    offset += written;
+    size -= written;
+  }
+  m_next_sequential_offset = offset;
+  return !m_failed;
+}
+
+void write_texture_json(std::ostream &stream, const float *pixels,
+                        unsigned int width, unsigned int height) {
+  size_t count = (size_t)width * height;
+  stream << "{\"width\":" << width << ", \"height\":" << height
+         << ", \"pixels\":[";
+  for (size_t i = 0; i < count; i++) {
+    stream << pixels[i];
+    if (i < count - 1) {
+      stream << ",";
+    }
+  }
+  stream << "]}\n";
+}
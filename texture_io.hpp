@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+/* Binary texture output. The pixels are converted and written in
+ * chunks of rows, so that large textures can be streamed to a file
+ * while they are generated, without holding an encoded copy of the
+ * whole image in memory. */
+
+enum class TextureFormat {
+  /* Raw pixels that follow a RawTextureHeader. */
+  RawFloat32,
+  RawUNorm16,
+  RawUNorm8,
+  /* Binary greymap (P5) with 8 or 16 bits per pixel. */
+  PGM8,
+  PGM16,
+  /* Little endian greyscale float map (Pf). */
+  PFM,
+  /* Raw half precision and bfloat16 pixels. */
+  RawFloat16,
+  RawBFloat16,
+};
+
+/* Header of the raw formats. All fields are little endian. */
+struct RawTextureHeader {
+  char magic[4]; /* "NTEX" */
+  uint32_t version;
+  uint32_t format; /* TextureFormat */
+  uint32_t width;
+  uint32_t height;
+  /* Range of the noise values that is mapped to [0, 1] for the
+   * normalized integer formats. */
+  float min_value;
+  float max_value;
+  uint32_t reserved;
+};
+static_assert(sizeof(RawTextureHeader) == 32,
+              "unexpected header size");
+
+size_t texture_bytes_per_pixel(TextureFormat format);
+
+/* Write the header of the format into `dst` and return its size in
+ * bytes. `dst` has to have space for at least 64 bytes. */
+size_t texture_header(TextureFormat format, unsigned int width,
+                      unsigned int height, float min_value,
+                      float max_value, char *dst);
+
+/* Convert `count` pixels into the pixel encoding of the format with
+ * the pack_pixels kernel of the selected tier. This can also be used
+ * to write into a memory mapped file directly, or to store tiles at
+ * their final precision while they are generated. */
+void encode_texture_pixels(TextureFormat format, const float *pixels,
+                           size_t count, float min_value,
+                           float max_value, void *dst);
+
+/* Streams a texture to a file descriptor. The rows can be written in
+ * any order when the file descriptor is seekable. Otherwise they have
+ * to be written in the order in which they appear in the file, which
+ * is bottom to top for PFM. */
+class TextureWriter {
+ private:
+  int m_fd;
+  TextureFormat m_format;
+  unsigned int m_width;
+  unsigned int m_height;
+  float m_min_value;
+  float m_max_value;
+  size_t m_header_size;
+  bool m_seekable;
+  int64_t m_file_offset;
+  int64_t m_next_sequential_offset;
+  bool m_failed;
+
+ public:
+  TextureWriter(int fd, TextureFormat format, unsigned int width,
+                unsigned int height, float min_value = -1.0f,
+                float max_value = 1.0f);
+
+  /* Write `row_count` rows starting at row `y`. The rows are given
+   * top to bottom with `width` pixels each. */
+  bool write_rows(unsigned int y, unsigned int row_count,
+                  const float *pixels);
+
+  /* Same as write_rows for pixels that are already in the encoding of
+   * the format, see encode_texture_pixels. */
+  bool write_encoded_rows(unsigned int y, unsigned int row_count,
+                          const void *pixels);
+
+  TextureFormat format() const { return m_format; }
+  float min_value() const { return m_min_value; }
+  float max_value() const { return m_max_value; }
+
+  bool failed() const { return m_failed; }
+
+  /* True when the last row of the image comes first in the file. */
+  bool bottom_to_top() const {
+    return m_format == TextureFormat::PFM;
+  }
+
+ private:
+  bool write_row_range(unsigned int y, unsigned int row_count,
+                       const void *pixels, bool encoded);
+  bool write_pixels(int64_t offset, const float *pixels,
+                    size_t count);
+  bool write_at(int64_t offset, const void *data, size_t size);
+};
+
+/* Write the texture as JSON. This is meant for debugging, the binary
+ * formats are much smaller and faster to write. */
+void write_texture_json(std::ostream &stream, const float *pixels,
+                        unsigned int width, unsigned int height);
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "timeit.hpp"
+
+/* Fixed size thread pool that runs parallel loops. Every worker owns
+ * a range of the loop indices and processes it from the front.
+ * Workers that run out of work steal the back half of the largest
+ * remaining range of another worker, so uneven work is balanced
+ * without a central queue. */
+class ThreadPool {
+ public:
+  using Function = std::function<void(size_t index,
+                                      unsigned int thread_index)>;
+
+ private:
+  struct WorkerRange {
+    std::mutex mutex;
+    size_t begin = 0;
+    size_t end = 0;
+  };
+
+  std::vector<std::thread> m_threads;
+  std::vector<std::unique_ptr<WorkerRange>> m_ranges;
+
+  std::mutex m_mutex;
+  std::condition_variable m_job_started;
+  std::condition_variable m_job_finished;
+  unsigned int m_job_id = 0;
+  unsigned int m_active_workers = 0;
+  bool m_shutdown = false;
+
+  const Function *m_function = nullptr;
+  const char *m_timer_name = nullptr;
+
+ public:
+  explicit ThreadPool(unsigned int thread_count = 0) {
+    if (thread_count == 0) {
+      thread_count = std::thread::hardware_concurrency();
+    }
+    if (thread_count == 0) {
+      thread_count = 1;
+    }
+    for (unsigned int i = 0; i < thread_count; i++) {
+      m_ranges.emplace_back(new WorkerRange());
+    }
+    for (unsigned int i = 0; i < thread_count; i++) {
+      m_threads.emplace_back([this, i]() { this->worker_main(i); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_shutdown = true;
+    }
+    m_job_started.notify_all();
+    for (std::thread &thread : m_threads) {
+      thread.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool &other) = delete;
+  ThreadPool &operator=(const ThreadPool &other) = delete;
+
+  unsigned int thread_count() const {
+    return (unsigned int)m_threads.size();
+  }
+
+  /* Call `function` for every index in [0, count) and wait until all
+   * calls are done. When `timer_name` is given, every worker records
+   * the time it spent on this loop as a profile zone. */
+  void parallel_for(size_t count, const Function &function,
+                    const char *timer_name = nullptr) {
+    if (count == 0) {
+      return;
+    }
+
+    /* Give every worker an equally sized contiguous range. */
+    size_t thread_count = m_threads.size();
+    for (size_t i = 0; i < thread_count; i++) {
+      WorkerRange &range = *m_ranges[i];
+      std::lock_guard<std::mutex> lock(range.mutex);
+      range.begin = count * i / thread_count;
+      range.end = count * (i + 1) / thread_count;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_function = &function;
+    m_timer_name = timer_name;
+    m_active_workers = (unsigned int)thread_count;
+    m_job_id++;
+    m_job_started.notify_all();
+    m_job_finished.wait(lock, [this]() {
+      return m_active_workers == 0;
+    });
+    m_function = nullptr;
+  }
+
+ private:
+  void worker_main(unsigned int thread_index) {
+    unsigned int last_job_id = 0;
+    while (true) {
+      const Function *function;
+#ifdef SIMD_PROFILE
+      const char *timer_name;
+#endif
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_job_started.wait(lock, [&]() {
+          return m_shutdown || m_job_id != last_job_id;
+        });
+        if (m_shutdown) {
+          return;
+        }
+        last_job_id = m_job_id;
+        function = m_function;
+#ifdef SIMD_PROFILE
+        timer_name = m_timer_name;
+#endif
+      }
+
+      {
+#ifdef SIMD_PROFILE
+        ProfileZone zone(timer_name);
+#endif
+
+        size_t index;
+        while (this->pop_index(thread_index, &index) ||
+               this->steal_index(thread_index, &index)) {
+          (*function)(index, thread_index);
+        }
+      }
+
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_active_workers--;
+      if (m_active_workers == 0) {
+        m_job_finished.notify_one();
+      }
+    }
+  }
+
+  bool pop_index(unsigned int thread_index, size_t *r_index) {
+    WorkerRange &range = *m_ranges[thread_index];
+    std::lock_guard<std::mutex> lock(range.mutex);
+    if (range.begin == range.end) {
+      return false;
+    }
+    *r_index = range.begin++;
+    return true;
+  }
+
+  bool steal_index(unsigned int thread_index, size_t *r_index) {
+    size_t thread_count = m_ranges.size();
+    while (true) {
+      /* Find the victim with the most remaining work. */
+      size_t victim = thread_count;
+      size_t victim_size = 0;
+      for (size_t i = 0; i < thread_count; i++) {
+        WorkerRange &range = *m_ranges[i];
+        std::lock_guard<std::mutex> lock(range.mutex);
+        size_t size = range.end - range.begin;
+        if (size > victim_size) {
+          victim = i;
+          victim_size = size;
+        }
+      }
+      if (victim == thread_count) {
+        return false;
+      }
+
+      size_t begin, end;
+      {
+        WorkerRange &range = *m_ranges[victim];
+        std::lock_guard<std::mutex> lock(range.mutex);
+        if (range.begin == range.end) {
+          /* The work was taken in the meantime, look again. */
+          continue;
+        }
+        size_t mid = range.end - (range.end - range.begin + 1) / 2;
+        begin = mid;
+        end = range.end;
+        range.end = mid;
+      }
+
+      /* Keep the first stolen index and make the rest available in
+       * the own range. */
+      *r_index = begin;
+      WorkerRange &own = *m_ranges[thread_index];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      own.begin = begin + 1;
+      own.end = end;
+      return true;
+    }
+  }
+};
@@ -0,0 +1,379 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "noise_kernels.hpp"
+#include "tile_cache.hpp"
+
+/* Has to change with every change of the file layout. */
+static const uint32_t tile_cache_version = 1;
+static const size_t tile_cache_page_size = 4096;
+
+struct TileCacheHeader {
+  char magic[8]; /* "NTILES\0\0" */
+  uint32_t version;
+  uint32_t tile_size;
+  uint64_t identity;
+  uint32_t capacity;
+  uint32_t reserved;
+  /* Incremented for every use of a tile, see TileCacheEntry. */
+  uint64_t clock;
+};
+
+struct TileCacheEntry {
+  TileKey key;
+  /* Written last, so that a tile that was interrupted while it was
+   * generated is never read. */
+  uint32_t valid;
+  uint32_t reserved;
+  /* Value of the header clock at the last use. */
+  uint64_t last_use;
+};
+static_assert(sizeof(TileCacheEntry) == 40, "unexpected entry size");
+
+static size_t round_up_to_page(size_t size) {
+  return (size + tile_cache_page_size - 1) / tile_cache_page_size *
+         tile_cache_page_size;
+}
+
+/* 64 bit FNV-1a. */
+static uint64_t hash_bytes(uint64_t hash, const void *data,
+                           size_t size) {
+  const unsigned char *bytes = (const unsigned char *)data;
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+uint64_t tile_cache_kernel_identity() {
+  const NoiseKernels &kernels = noise_kernels();
+  const size_t count = 64;
+  float xs[count], ys[count], zs[count];
+  double xs_double[count], ys_double[count], zs_double[count];
+  float out[4 * count];
+  for (size_t i = 0; i < count; i++) {
+    xs[i] = i * 1.37f - 40.0f;
+    ys[i] = i * 0.61f + 3.3f;
+    zs[i] = i * -0.29f;
+    xs_double[i] = i * 1.37 + 4294967296.0;
+    ys_double[i] = i * 0.61 - 1e9;
+    zs_double[i] = 0.0;
+  }
+  kernels.eval_noise_batch(xs, ys, zs, out, count);
+  kernels.perlin_noise_batch(xs, ys, zs, out + count, count, 3.5f);
+  kernels.perlin_noise_row_2d(xs, 7.3f, out + 2 * count, count, 5.0f);
+  kernels.perlin_noise_batch_double(xs_double, ys_double, zs_double,
+                                    nullptr, out + 3 * count, count,
+                                    5.0f);
+
+  uint64_t hash = 0xcbf29ce484222325ull;
+  hash = hash_bytes(hash, out, sizeof(out));
+  return hash_bytes(hash, kernels.name, strlen(kernels.name));
+}
+
+size_t TileCache::KeyHash::operator()(const TileKey &key) const {
+  return (size_t)hash_bytes(0xcbf29ce484222325ull, &key, sizeof(key));
+}
+
+bool TileCache::KeyEqual::operator()(const TileKey &a,
+                                     const TileKey &b) const {
+  return memcmp(&a, &b, sizeof(TileKey)) == 0;
+}
+
+TileCacheHandle::TileCacheHandle(TileCache *cache, uint32_t slot)
+    : m_cache(cache), m_slot(slot) {
+  m_cache->m_slots[m_slot].pins++;
+}
+
+TileCacheHandle::TileCacheHandle(const TileCacheHandle &other)
+    : m_cache(other.m_cache), m_slot(other.m_slot) {
+  if (m_cache) {
+    m_cache->m_slots[m_slot].pins++;
+  }
+}
+
+TileCacheHandle::TileCacheHandle(TileCacheHandle &&other) noexcept
+    : m_cache(other.m_cache), m_slot(other.m_slot) {
+  other.m_cache = nullptr;
+}
+
+TileCacheHandle &
+TileCacheHandle::operator=(TileCacheHandle other) noexcept {
+  std::swap(m_cache, other.m_cache);
+  std::swap(m_slot, other.m_slot);
+  return *this;
+}
+
+TileCacheHandle::~TileCacheHandle() {
+  if (m_cache) {
+    m_cache->m_slots[m_slot].pins--;
+  }
+}
+
+const float *TileCacheHandle::pixels() const {
+  return m_cache->slot_pixels(m_slot);
+}
+
+unsigned int TileCacheHandle::size() const {
+  return m_cache->m_settings.tile_size;
+}
+
+TileCache::TileCache(const char *path,
+                     const TileCacheSettings &settings)
+    : m_settings(settings) {
+  size_t tile_bytes =
+      (size_t)settings.tile_size * settings.tile_size * sizeof(float);
+  m_slot_bytes = round_up_to_page(tile_bytes);
+
+  /* Header page, index and tiles have to fit into max_bytes. */
+  size_t available = settings.max_bytes > tile_cache_page_size
+                         ? settings.max_bytes - tile_cache_page_size
+                         : 0;
+  m_capacity = (uint32_t)std::max<size_t>(
+      available / (m_slot_bytes + sizeof(TileCacheEntry)), 1);
+  size_t index_bytes =
+      round_up_to_page(m_capacity * sizeof(TileCacheEntry));
+  while (m_capacity > 1 &&
+         tile_cache_page_size + index_bytes +
+                 m_capacity * m_slot_bytes >
+             settings.max_bytes) {
+    m_capacity--;
+    index_bytes =
+        round_up_to_page(m_capacity * sizeof(TileCacheEntry));
+  }
+  m_file_bytes =
+      tile_cache_page_size + index_bytes + m_capacity * m_slot_bytes;
+
+  if (!this->map_file(path)) {
+    m_capacity = 0;
+    m_file_bytes = 0;
+    return;
+  }
+  m_entries = (TileCacheEntry *)(m_mapping + tile_cache_page_size);
+  m_tiles = m_mapping + tile_cache_page_size + index_bytes;
+  this->load_index();
+}
+
+TileCache::~TileCache() {
+  if (m_mapping) {
+    munmap(m_mapping, m_file_bytes);
+  }
+  if (m_fd >= 0) {
+    /* Also releases the lock. */
+    close(m_fd);
+  }
+}
+
+bool TileCache::map_file(const char *path) {
+  m_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (m_fd < 0) {
+    return false;
+  }
+  if (flock(m_fd, LOCK_EX | LOCK_NB) != 0) {
+    close(m_fd);
+    m_fd = -1;
+    return false;
+  }
+
+  TileCacheHeader expected = {};
+  memcpy(expected.magic, "NTILES\0\0", 8);
+  expected.version = tile_cache_version;
+  expected.tile_size = m_settings.tile_size;
+  expected.identity =
+      tile_cache_kernel_identity() ^
+      (m_settings.generator_version * 0x9e3779b97f4a7c15ull);
+  expected.capacity = m_capacity;
+
+  TileCacheHeader header;
+  struct stat file_stat;
+  bool reuse =
+      fstat(m_fd, &file_stat) == 0 &&
+      (size_t)file_stat.st_size == m_file_bytes &&
+      pread(m_fd, &header, sizeof(header), 0) ==
+          (ssize_t)sizeof(header) &&
+      memcmp(&header, &expected,
+             offsetof(TileCacheHeader, clock)) == 0;
+  if (!reuse) {
+    /* Start over with an empty index. The file is sparse, so the
+     * tiles only take disk space once they are written. */
+    if (ftruncate(m_fd, 0) != 0 ||
+        ftruncate(m_fd, (off_t)m_file_bytes) != 0 ||
+        pwrite(m_fd, &expected, sizeof(expected), 0) !=
+            (ssize_t)sizeof(expected)) {
+      close(m_fd);
+      m_fd = -1;
+      return false;
+    }
+  }
+
+  void *mapping = mmap(nullptr, m_file_bytes, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, m_fd, 0);
+  if (mapping == MAP_FAILED) {
+    close(m_fd);
+    m_fd = -1;
+    return false;
+  }
+  m_mapping = (char *)mapping;
+  m_header = (TileCacheHeader *)m_mapping;
+  return true;
+}
+
+void TileCache::load_index() {
+  m_slots.reset(new Slot[m_capacity]);
+  std::vector<std::pair<uint64_t, uint32_t>> used;
+  for (uint32_t i = 0; i < m_capacity; i++) {
+    const TileCacheEntry &entry = m_entries[i];
+    if (entry.valid && m_table.emplace(entry.key, i).second) {
+      used.emplace_back(entry.last_use, i);
+    } else {
+      m_entries[i].valid = 0;
+      m_free_slots.push_back(i);
+    }
+  }
+  /* Rebuild the LRU list, the most recent tile ends up in front. */
+  std::sort(used.begin(), used.end());
+  for (const auto &tile : used) {
+    m_slots[tile.second].state = SlotState::Ready;
+    this->lru_push_front(tile.second);
+  }
+  std::reverse(m_free_slots.begin(), m_free_slots.end());
+
+  m_stats.capacity_tiles = m_capacity;
+  m_stats.file_bytes = m_file_bytes;
+}
+
+float *TileCache::slot_pixels(uint32_t slot) const {
+  return (float *)(m_tiles + slot * m_slot_bytes);
+}
+
+void TileCache::lru_unlink(uint32_t slot) {
+  Slot &s = m_slots[slot];
+  if (s.lru_prev >= 0) {
+    m_slots[s.lru_prev].lru_next = s.lru_next;
+  } else {
+    m_lru_head = s.lru_next;
+  }
+  if (s.lru_next >= 0) {
+    m_slots[s.lru_next].lru_prev = s.lru_prev;
+  } else {
+    m_lru_tail = s.lru_prev;
+  }
+  s.lru_prev = -1;
+  s.lru_next = -1;
+}
+
+void TileCache::lru_push_front(uint32_t slot) {
+  Slot &s = m_slots[slot];
+  s.lru_prev = -1;
+  s.lru_next = m_lru_head;
+  if (m_lru_head >= 0) {
+    m_slots[m_lru_head].lru_prev = (int32_t)slot;
+  } else {
+    m_lru_tail = (int32_t)slot;
+  }
+  m_lru_head = (int32_t)slot;
+}
+
+void TileCache::touch(uint32_t slot) {
+  m_entries[slot].last_use = ++m_header->clock;
+  this->lru_unlink(slot);
+  this->lru_push_front(slot);
+}
+
+int32_t TileCache::allocate_slot() {
+  if (!m_free_slots.empty()) {
+    uint32_t slot = m_free_slots.back();
+    m_free_slots.pop_back();
+    return (int32_t)slot;
+  }
+  /* Only ready tiles are in the LRU list. */
+  for (int32_t slot = m_lru_tail; slot >= 0;
+       slot = m_slots[slot].lru_prev) {
+    Slot &s = m_slots[slot];
+    if (s.pins == 0) {
+      this->lru_unlink(slot);
+      m_table.erase(m_entries[slot].key);
+      m_entries[slot].valid = 0;
+      s.state = SlotState::Free;
+      m_stats.evictions++;
+      return slot;
+    }
+  }
+  return -1;
+}
+
+TileCacheHandle TileCache::find(const TileKey &key) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_table.find(key);
+  if (it == m_table.end() ||
+      m_slots[it->second].state != SlotState::Ready) {
+    return TileCacheHandle();
+  }
+  m_stats.hits++;
+  this->touch(it->second);
+  return TileCacheHandle(this, it->second);
+}
+
+TileCacheHandle TileCache::get(const TileKey &key,
+                               const Generate &generate) {
+  if (!this->is_open()) {
+    return TileCacheHandle();
+  }
+  std::unique_lock<std::mutex> lock(m_mutex);
+  auto it = m_table.find(key);
+  while (it != m_table.end() &&
+         m_slots[it->second].state == SlotState::Pending) {
+    m_tile_ready.wait(lock);
+    it = m_table.find(key);
+  }
+  if (it != m_table.end()) {
+    m_stats.hits++;
+    this->touch(it->second);
+    return TileCacheHandle(this, it->second);
+  }
+
+  int32_t slot = this->allocate_slot();
+  if (slot < 0) {
+    m_stats.rejected++;
+    return TileCacheHandle();
+  }
+  m_stats.misses++;
+  m_slots[slot].state = SlotState::Pending;
+  m_table.emplace(key, (uint32_t)slot);
+  TileCacheHandle handle(this, (uint32_t)slot);
+
+  lock.unlock();
+  generate(key, this->slot_pixels(slot));
+  lock.lock();
+
+  TileCacheEntry &entry = m_entries[slot];
+  entry.key = key;
+  entry.last_use = ++m_header->clock;
+  std::atomic_thread_fence(std::memory_order_release);
+  entry.valid = 1;
+  m_slots[slot].state = SlotState::Ready;
+  this->lru_push_front(slot);
+  m_tile_ready.notify_all();
+  return handle;
+}
+
+void TileCache::flush() {
+  if (m_mapping) {
+    msync(m_mapping, m_file_bytes, MS_SYNC);
+  }
+}
+
+TileCacheStats TileCache::stats() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  TileCacheStats stats = m_stats;
+  stats.cached_tiles = m_capacity - m_free_slots.size();
+  return stats;
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/* Persistent cache of generated noise tiles in a memory mapped file,
+ * for offline bakes that evaluate the same tiles in every run.
+ *
+ * The file starts with a header page, followed by the index and the
+ * tiles. Every tile starts at a page boundary, so cached tiles are
+ * used straight from the mapping without a copy, and only the pages
+ * that are actually read are loaded from disk. The capacity follows
+ * from the size limit when the file is created. When it is full, the
+ * least recently used tile that is not in use is replaced. The use
+ * order is part of the index, so it carries over to later runs.
+ *
+ * The header records the format version, the tile size and the
+ * identity of the noise kernels (see tile_cache_kernel_identity). A
+ * file that does not match is cleared, so tiles of an older
+ * hash_position or of another instruction set are never served.
+ *
+ * Only one process can use a cache file at a time. */
+
+struct TileKey {
+  /* Tells apart noise functions that share a cache file. */
+  uint32_t seed;
+  float octaves;
+  float scale;
+  int32_t x;
+  int32_t y;
+  uint32_t lod;
+};
+
+struct TileCacheSettings {
+  /* Width and height of a tile in texels. */
+  unsigned int tile_size = 64;
+  /* Upper bound for the size of the cache file. At least one tile is
+   * always kept. */
+  size_t max_bytes = 256 << 20;
+  /* Part of the identity of the file. It has to change whenever the
+   * generator that is passed to TileCache::get changes. */
+  uint64_t generator_version = 0;
+};
+
+struct TileCacheStats {
+  /* Tiles that were found in the file. */
+  uint64_t hits;
+  /* Tiles that were generated. */
+  uint64_t misses;
+  /* Cached tiles that were dropped to make room for new ones. */
+  uint64_t evictions;
+  /* Requests that could not be served because every tile was in
+   * use. */
+  uint64_t rejected;
+  size_t cached_tiles;
+  size_t capacity_tiles;
+  size_t file_bytes;
+};
+
+class TileCache;
+
+/* Keeps a cached tile alive, like ChunkHandle. The pixels point into
+ * the mapped file. Handles have to be released before the cache is
+ * destroyed. */
+class TileCacheHandle {
+ private:
+  TileCache *m_cache = nullptr;
+  uint32_t m_slot = 0;
+
+  friend class TileCache;
+  TileCacheHandle(TileCache *cache, uint32_t slot);
+
+ public:
+  TileCacheHandle() = default;
+  TileCacheHandle(const TileCacheHandle &other);
+  TileCacheHandle(TileCacheHandle &&other) noexcept;
+  TileCacheHandle &operator=(TileCacheHandle other) noexcept;
+  ~TileCacheHandle();
+
+  explicit operator bool() const { return m_cache != nullptr; }
+
+  /* tile_size x tile_size texels, row by row. */
+  const float *pixels() const;
+  unsigned int size() const;
+};
+
+struct TileCacheHeader;
+struct TileCacheEntry;
+
+class TileCache {
+ public:
+  /* Fills the tile_size x tile_size texels of a tile. */
+  using Generate =
+      std::function<void(const TileKey &key, float *pixels)>;
+
+ private:
+  friend class TileCacheHandle;
+
+  enum class SlotState : uint8_t { Free, Pending, Ready };
+
+  struct Slot {
+    SlotState state = SlotState::Free;
+    std::atomic<uint32_t> pins{0};
+    int32_t lru_prev = -1;
+    int32_t lru_next = -1;
+  };
+
+  /* Keys are compared bitwise, so that e.g. -0 and 0 are different
+   * scales, like they would be for the file. */
+  struct KeyHash {
+    size_t operator()(const TileKey &key) const;
+  };
+  struct KeyEqual {
+    bool operator()(const TileKey &a, const TileKey &b) const;
+  };
+
+  TileCacheSettings m_settings;
+  int m_fd = -1;
+  char *m_mapping = nullptr;
+  size_t m_file_bytes = 0;
+  size_t m_slot_bytes = 0;
+  uint32_t m_capacity = 0;
+  TileCacheHeader *m_header = nullptr;
+  TileCacheEntry *m_entries = nullptr;
+  char *m_tiles = nullptr;
+
+  std::unique_ptr<Slot[]> m_slots;
+  std::vector<uint32_t> m_free_slots;
+  int32_t m_lru_head = -1;
+  int32_t m_lru_tail = -1;
+  std::unordered_map<TileKey, uint32_t, KeyHash, KeyEqual> m_table;
+
+  TileCacheStats m_stats = {};
+  mutable std::mutex m_mutex;
+  std::condition_variable m_tile_ready;
+
+ public:
+  /* Open or create the cache file at `path`. When it can not be
+   * opened, locked or mapped, the cache stays closed and get()
+   * returns empty handles. */
+  explicit TileCache(const char *path,
+                     const TileCacheSettings &settings = {});
+  ~TileCache();
+
+  TileCache(const TileCache &) = delete;
+  TileCache &operator=(const TileCache &) = delete;
+
+  bool is_open() const { return m_mapping != nullptr; }
+
+  /* Return the tile if it is cached, without generating it. */
+  TileCacheHandle find(const TileKey &key);
+
+  /* Return the cached tile, or generate it straight into the file on
+   * the calling thread. Concurrent calls for the same tile wait for
+   * the first one. The handle is empty when the cache is not open or
+   * every tile is in use. */
+  TileCacheHandle get(const TileKey &key, const Generate &generate);
+
+  /* Write the changed pages to disk. The kernel also does this on its
+   * own, this only matters for a crash of the whole system. */
+  void flush();
+
+  TileCacheStats stats() const;
+  const TileCacheSettings &settings() const { return m_settings; }
+
+ private:
+  bool map_file(const char *path);
+  void load_index();
+
+  void lru_unlink(uint32_t slot);
+  void lru_push_front(uint32_t slot);
+  void touch(uint32_t slot);
+
+  /* Take a free slot or evict the least recently used tile that is
+   * not pinned. Returns -1 when there is none. */
+  int32_t allocate_slot();
+
+  float *slot_pixels(uint32_t slot) const;
+};
+
+/* Identity of the noise kernels of the selected instruction set. It
+ * is a hash of their output at fixed positions and of the name of
+ * the instruction set, so any change of the noise functions or of the
+ * lattice hash gives a different identity. */
+uint64_t tile_cache_kernel_identity();
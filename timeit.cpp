@@ -0,0 +1,366 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "timeit.hpp"
+
+/* Accumulated statistics of one zone path. Node 0 of every thread is
+ * the root, which is not a zone itself. */
+struct ProfileNode {
+  const char *name;
+  uint32_t parent;
+  uint64_t count;
+  int64_t total_ns;
+  int64_t min_ns;
+  int64_t max_ns;
+  uint64_t counters[profile_counter_count];
+};
+
+struct ProfileEvent {
+  uint32_t node;
+  int64_t start_ns;
+  int64_t duration_ns;
+  uint64_t counters[profile_counter_count];
+};
+
+/* Upper bound for the stored invocations of each thread, so that
+ * long runs do not grow without limit. Later invocations still count
+ * in the statistics. */
+static const size_t profile_max_events = 1 << 20;
+
+struct ProfileThread {
+  unsigned int index;
+  std::vector<ProfileNode> nodes;
+  uint32_t current = 0;
+  std::vector<ProfileEvent> events;
+  uint64_t dropped_events = 0;
+  /* perf_event_open group, the first one is the leader. */
+  int counter_fds[profile_counter_count];
+  bool counters = false;
+
+  /* Find or add the child of `parent` with the given name. Names are
+   * compared by content, because equal literals in different
+   * translation units need not share an address. */
+  uint32_t child(uint32_t parent, const char *name) {
+    for (uint32_t i = 1; i < nodes.size(); i++) {
+      const ProfileNode &node = nodes[i];
+      if (node.parent == parent &&
+          (node.name == name || strcmp(node.name, name) == 0)) {
+        return i;
+      }
+    }
+    ProfileNode node = {};
+    node.name = name;
+    node.parent = parent;
+    node.min_ns = INT64_MAX;
+    nodes.push_back(node);
+    return (uint32_t)nodes.size() - 1;
+  }
+};
+
+static std::mutex profile_mutex;
+static std::vector<std::unique_ptr<ProfileThread>> profile_threads;
+static bool profile_counters_requested = false;
+static thread_local ProfileThread *profile_current_thread = nullptr;
+
+static int64_t profile_now_ns() {
+  using Clock = std::chrono::steady_clock;
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             Clock::now().time_since_epoch())
+      .count();
+}
+
+#ifdef __linux__
+static int open_counter(uint64_t config, int group_fd) {
+  perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.read_format = PERF_FORMAT_GROUP;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd,
+                      0);
+}
+#endif
+
+static bool open_counters(ProfileThread &thread) {
+#ifdef __linux__
+  const uint64_t configs[profile_counter_count] = {
+      PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_MISSES};
+  for (unsigned int i = 0; i < profile_counter_count; i++) {
+    int group_fd = i == 0 ? -1 : thread.counter_fds[0];
+    thread.counter_fds[i] = open_counter(configs[i], group_fd);
+    if (thread.counter_fds[i] < 0) {
+      for (unsigned int j = 0; j < i; j++) {
+        close(thread.counter_fds[j]);
+      }
+      return false;
+    }
+  }
+  thread.counters = true;
+  return true;
+#else
+  (void)thread;
+  return false;
+#endif
+}
+
+/* One read of the whole group. */
+static void read_counters(const ProfileThread &thread,
+                          uint64_t *values) {
+#ifdef __linux__
+  uint64_t buffer[1 + profile_counter_count];
+  if (read(thread.counter_fds[0], buffer, sizeof(buffer)) ==
+      (ssize_t)sizeof(buffer)) {
+    memcpy(values, buffer + 1,
+           sizeof(uint64_t) * profile_counter_count);
+    return;
+  }
+#endif
+  (void)thread;
+  memset(values, 0, sizeof(uint64_t) * profile_counter_count);
+}
+
+static ProfileThread &profile_thread() {
+  if (profile_current_thread == nullptr) {
+    std::lock_guard<std::mutex> lock(profile_mutex);
+    profile_threads.emplace_back(new ProfileThread());
+    ProfileThread &thread = *profile_threads.back();
+    thread.index = (unsigned int)profile_threads.size() - 1;
+    thread.nodes.push_back(ProfileNode());
+    if (profile_counters_requested) {
+      open_counters(thread);
+    }
+    profile_current_thread = &thread;
+  }
+  return *profile_current_thread;
+}
+
+const char *profile_counter_name(ProfileCounter counter) {
+  switch (counter) {
+  case ProfileCounter::Cycles:
+    return "cycles";
+  case ProfileCounter::Instructions:
+    return "instructions";
+  case ProfileCounter::CacheMisses:
+    return "cache_misses";
+  }
+  return "";
+}
+
+ProfileZone::ProfileZone(const char *name) : m_thread(nullptr) {
+  if (name == nullptr) {
+    return;
+  }
+  ProfileThread &thread = profile_thread();
+  m_thread = &thread;
+  m_node = thread.child(thread.current, name);
+  thread.current = m_node;
+  if (thread.counters) {
+    read_counters(thread, m_start_counters);
+  }
+  m_start_ns = profile_now_ns();
+}
+
+ProfileZone::~ProfileZone() {
+  if (m_thread == nullptr) {
+    return;
+  }
+  int64_t end_ns = profile_now_ns();
+  ProfileThread &thread = *m_thread;
+  ProfileEvent event = {};
+  event.node = m_node;
+  event.start_ns = m_start_ns;
+  event.duration_ns = end_ns - m_start_ns;
+  if (thread.counters) {
+    read_counters(thread, event.counters);
+    for (unsigned int i = 0; i < profile_counter_count; i++) {
+      event.counters[i] -= m_start_counters[i];
+    }
+  }
+
+  ProfileNode &node = thread.nodes[m_node];
+  node.count++;
+  node.total_ns += event.duration_ns;
+  node.min_ns = std::min(node.min_ns, event.duration_ns);
+  node.max_ns = std::max(node.max_ns, event.duration_ns);
+  for (unsigned int i = 0; i < profile_counter_count; i++) {
+    node.counters[i] += event.counters[i];
+  }
+  if (thread.events.size() < profile_max_events) {
+    thread.events.push_back(event);
+  } else {
+    thread.dropped_events++;
+  }
+  thread.current = node.parent;
+}
+
+bool profile_enable_counters() {
+  {
+    std::lock_guard<std::mutex> lock(profile_mutex);
+    profile_counters_requested = true;
+  }
+  ProfileThread &thread = profile_thread();
+  return thread.counters || open_counters(thread);
+}
+
+void profile_reset() {
+  std::lock_guard<std::mutex> lock(profile_mutex);
+  for (auto &thread : profile_threads) {
+    thread->nodes.resize(1);
+    thread->current = 0;
+    thread->events.clear();
+    thread->dropped_events = 0;
+  }
+}
+
+static std::string node_path(const ProfileThread &thread,
+                             uint32_t node) {
+  std::string path = thread.nodes[node].name;
+  for (node = thread.nodes[node].parent; node != 0;
+       node = thread.nodes[node].parent) {
+    path = std::string(thread.nodes[node].name) + "/" + path;
+  }
+  return path;
+}
+
+static void write_summary_nodes(std::ostream &stream,
+                                const ProfileThread &thread,
+                                uint32_t parent, unsigned int depth) {
+  for (uint32_t i = 1; i < thread.nodes.size(); i++) {
+    const ProfileNode &node = thread.nodes[i];
+    if (node.parent != parent || node.count == 0) {
+      continue;
+    }
+    char line[512];
+    int length = snprintf(
+        line, sizeof(line),
+        "%*s%s: %llu x, avg %.3f ms, min %.3f ms, max %.3f ms",
+        depth * 2, "", node.name, (unsigned long long)node.count,
+        node.total_ns * 1e-6 / node.count, node.min_ns * 1e-6,
+        node.max_ns * 1e-6);
+    if (thread.counters && length > 0 &&
+        (size_t)length < sizeof(line)) {
+      double cycles = std::max((double)node.counters[0], 1.0);
+      snprintf(line + length, sizeof(line) - length,
+               ", IPC %.2f, %.0f cache misses",
+               node.counters[1] / cycles,
+               node.counters[2] / (double)node.count);
+    }
+    stream << line << "\n";
+    write_summary_nodes(stream, thread, i, depth + 1);
+  }
+}
+
+void profile_write_summary(std::ostream &stream) {
+  std::lock_guard<std::mutex> lock(profile_mutex);
+  for (const auto &thread : profile_threads) {
+    if (thread->nodes.size() > 1) {
+      stream << "Thread " << thread->index << "\n";
+      write_summary_nodes(stream, *thread, 0, 1);
+    }
+  }
+}
+
+static void write_json_string(std::ostream &stream,
+                              const std::string &value) {
+  stream << '"';
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      stream << '\\';
+    }
+    stream << c;
+  }
+  stream << '"';
+}
+
+void profile_write_chrome_trace(std::ostream &stream) {
+  std::lock_guard<std::mutex> lock(profile_mutex);
+  /* Timestamps start at the first recorded zone. */
+  int64_t origin_ns = INT64_MAX;
+  for (const auto &thread : profile_threads) {
+    for (const ProfileEvent &event : thread->events) {
+      origin_ns = std::min(origin_ns, event.start_ns);
+    }
+  }
+
+  const char *separator = "\n";
+  stream << "{\"displayTimeUnit\": \"ms\",\n\"traceEvents\": [";
+  for (const auto &thread : profile_threads) {
+    for (const ProfileEvent &event : thread->events) {
+      char numbers[128];
+      snprintf(numbers, sizeof(numbers),
+               "\"ph\": \"X\", \"pid\": 0, \"tid\": %u, "
+               "\"ts\": %.3f, \"dur\": %.3f",
+               thread->index, (event.start_ns - origin_ns) * 1e-3,
+               event.duration_ns * 1e-3);
+      stream << separator << "{\"name\": ";
+      write_json_string(stream, thread->nodes[event.node].name);
+      stream << ", " << numbers;
+      if (thread->counters) {
+        stream << ", \"args\": {";
+        for (unsigned int i = 0; i < profile_counter_count; i++) {
+          stream << (i > 0 ? ", " : "") << "\""
+                 << profile_counter_name((ProfileCounter)i)
+                 << "\": " << event.counters[i];
+        }
+        stream << "}";
+      }
+      stream << "}";
+      separator = ",\n";
+    }
+  }
+
+  separator = "\n";
+  stream << "],\n\"zones\": [";
+  for (const auto &thread : profile_threads) {
+    for (uint32_t i = 1; i < thread->nodes.size(); i++) {
+      const ProfileNode &node = thread->nodes[i];
+      if (node.count == 0) {
+        continue;
+      }
+      char numbers[256];
+      snprintf(numbers, sizeof(numbers),
+               "\"thread\": %u, \"count\": %llu, "
+               "\"total_ms\": %.6f, \"min_ms\": %.6f, "
+               "\"avg_ms\": %.6f, \"max_ms\": %.6f",
+               thread->index, (unsigned long long)node.count,
+               node.total_ns * 1e-6, node.min_ns * 1e-6,
+               node.total_ns * 1e-6 / node.count,
+               node.max_ns * 1e-6);
+      stream << separator << "{\"path\": ";
+      write_json_string(stream, node_path(*thread, i));
+      stream << ", " << numbers;
+      if (thread->counters) {
+        for (unsigned int c = 0; c < profile_counter_count; c++) {
+          stream << ", \"" << profile_counter_name((ProfileCounter)c)
+                 << "\": " << node.counters[c];
+        }
+      }
+      stream << "}";
+      separator = ",\n";
+    }
+  }
+  /* Invocations beyond profile_max_events that are missing in
+   * traceEvents. */
+  uint64_t dropped_events = 0;
+  for (const auto &thread : profile_threads) {
+    dropped_events += thread->dropped_events;
+  }
+  stream << "],\n\"dropped_events\": " << dropped_events << "}\n";
+}
@@ -1,28 +1,81 @@
 #pragma once
 
-#include <chrono>
-#include <iostream>
+#include <cstdint>
+#include <ostream>
 
-class ScopedTimer {
- private:
-  using Clock = std::chrono::high_resolution_clock;
-  using Duration = std::chrono::duration<float>;
+/* Hierarchical profiling. PROFILE_ZONE(name) measures the rest of the
+ * enclosing scope. Zones that are opened while another one is open
+ * on the same thread become its children, so every thread builds a
+ * tree of zone paths. Each path accumulates its invocation count and
+ * the total, minimum and maximum duration, and every single
+ * invocation is kept for the trace output.
+ *
+ * Zones are only recorded when SIMD_PROFILE is defined. Otherwise
+ * the macro expands to nothing and has no cost at all.
+ *
+ * Zone names are stored as pointers and must outlive the profile,
+ * string literals are the intended use. */
+
+#define PROFILE_CONCAT__(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT__(a, b)
+
+#ifdef SIMD_PROFILE
+#define PROFILE_ZONE(name)                                           \
+  ProfileZone PROFILE_CONCAT(profile_zone_, __COUNTER__)(name)
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#endif
+
+/* The former name of PROFILE_ZONE. */
+#define SCOPED_TIMER(name) PROFILE_ZONE(name)
+
+/* Hardware counters that are read at the start and end of every
+ * zone when enabled with profile_enable_counters. */
+enum class ProfileCounter {
+  Cycles,
+  Instructions,
+  CacheMisses,
+};
+const unsigned int profile_counter_count = 3;
+
+const char *profile_counter_name(ProfileCounter counter);
 
-  const char *m_name;
-  Clock::time_point m_start;
+struct ProfileThread;
+
+class ProfileZone {
+ private:
+  ProfileThread *m_thread;
+  uint32_t m_node;
+  int64_t m_start_ns;
+  uint64_t m_start_counters[profile_counter_count];
 
  public:
-  ScopedTimer(const char *name = "") {
-    m_name = name;
-    m_start = Clock::now();
-  }
-
-  ~ScopedTimer() {
-    Clock::time_point end = Clock::now();
-    Duration duration = end - m_start;
-    double ms = duration.count() * 1000.0f;
-    std::cout << "Timer '" << m_name << "' took " << ms << " ms\n";
-  }
+  /* A null name records nothing. */
+  explicit ProfileZone(const char *name);
+  ~ProfileZone();
+
+  ProfileZone(const ProfileZone &other) = delete;
+  ProfileZone &operator=(const ProfileZone &other) = delete;
 };
 
-#define SCOPED_TIMER(name) ScopedTimer t(name);
+/* Read cycles, instructions and cache misses of the calling thread
+ * in every zone that is opened afterwards, through perf_event_open.
+ * Only available on Linux, and only when the kernel allows it (see
+ * /proc/sys/kernel/perf_event_paranoid). Returns whether the
+ * counters could be opened on the calling thread. */
+bool profile_enable_counters();
+
+/* The following functions must not run while zones are open on
+ * other threads. */
+
+/* Drop all recorded zones. */
+void profile_reset();
+
+/* Indented tree of all zone paths per thread with their count and
+ * minimum, average and maximum duration. */
+void profile_write_summary(std::ostream &stream);
+
+/* Every recorded zone invocation as a complete event ("ph": "X") in
+ * the Chrome trace event format, which chrome://tracing and Perfetto
+ * can open. The per path statistics are stored in "zones". */
+void profile_write_chrome_trace(std::ostream &stream);